@@ -0,0 +1,416 @@
+/***
+ * Giả lập AS608 ở mức byte, dùng thay cổng Serial2 khi không có cảm biến.
+ *
+ * AS608Emulator là một Stream: Adafruit_Fingerprint ghi gói lệnh vào và đọc
+ * gói ACK ra như với UART thật, nên toàn bộ driver (AS608FingerSensor +
+ * Adafruit_Fingerprint) chạy nguyên vẹn. Định dạng gói:
+ *
+ *   [EF 01][addr:4][pid:1][len:2][payload][checksum:2]
+ *   checksum = tổng pid + 2 byte len + payload, len = payload + 2
+ *
+ * Hỗ trợ: GetImage, Img2Tz, Match, Search/HiSpeedSearch, RegModel, Store,
+ * LoadChar, UpChar, DownChar, DeleteChar, Empty, ReadSysPara, VfyPwd,
+ * TemplateNum, ReadIndexTable.
+ *
+ * Ngón tay được mô phỏng bằng một "identity" 16 bit: placeFinger(identity)
+ * rồi GetImage/Img2Tz sẽ tạo template suy ra từ identity đó. quality < 30 là
+ * ảnh nhòe, < 50 thiếu đặc trưng, 50-100 cho điểm khớp 50-200. Mỗi lệnh có thể
+ * đặt độ trễ riêng (cộng thêm thời gian truyền UART theo baud) và bơm lỗi.
+ * Search/HiSpeedSearch tốn thêm setSearchCost() µs cho mỗi template đã dùng
+ * được so trước khi khớp, nên thời gian tìm 1:N tăng theo cỡ thư viện như
+ * cảm biến thật, còn Match/LoadChar không đổi.
+ ***/
+
+#pragma once
+#include <Arduino.h>
+
+class AS608Emulator : public Stream
+{
+public:
+    static constexpr uint16_t CAPACITY = 128;     // số slot template
+    static constexpr uint16_t TEMPLATE_SIZE = 512;
+    static constexpr uint16_t PACKET_DATA = 128;  // packet_len = 128 (mã 2)
+    static constexpr uint8_t CMD_COUNT = 0x20;
+
+    explicit AS608Emulator(uint32_t baud = 57600) : _baud(baud)
+    {
+        // Độ trễ mặc định gần giống AS608 thật (ms)
+        _latency[0x01] = 60;  // GetImage
+        _latency[0x02] = 40;  // Img2Tz
+        _latency[0x03] = 10;  // Match
+        _latency[0x04] = 20;  // Search
+        _latency[0x1B] = 20;  // HiSpeedSearch
+        _latency[0x05] = 30;  // RegModel
+        _latency[0x06] = 30;  // Store
+        _latency[0x07] = 10;  // LoadChar
+        _latency[0x0D] = 50;  // Empty
+    }
+
+    // ---------- Điều khiển mô phỏng ----------
+    void placeFinger(uint16_t identity, uint8_t quality = 100)
+    {
+        _fingerPresent = true;
+        _identity = identity;
+        _quality = quality;
+    }
+
+    void liftFinger() { _fingerPresent = false; }
+
+    void setLatency(uint8_t cmd, uint16_t ms)
+    {
+        if (cmd < CMD_COUNT) _latency[cmd] = ms;
+    }
+
+    // Thời gian so một template khi Search (µs)
+    void setSearchCost(uint16_t us) { _searchCostUs = us; }
+
+    // `count` phản hồi kế tiếp cho lệnh cmd sẽ trả mã lỗi code
+    void injectError(uint8_t cmd, uint8_t code, uint8_t count = 1)
+    {
+        if (cmd >= CMD_COUNT) return;
+        _errorCode[cmd] = code;
+        _errorCount[cmd] = count;
+    }
+
+    // Ghi template của identity vào slot, như đã enroll sẵn
+    bool preload(uint16_t page, uint16_t identity)
+    {
+        if (page >= CAPACITY) return false;
+        _db[page] = identity;
+        setUsed(page, true);
+        return true;
+    }
+
+    uint32_t roundTrips(uint8_t cmd) const { return cmd < CMD_COUNT ? _roundTrips[cmd] : 0; }
+
+    void resetStats()
+    {
+        for (uint8_t i = 0; i < CMD_COUNT; i++) _roundTrips[i] = 0;
+    }
+
+    void printStats(Print &out) const
+    {
+        for (uint8_t i = 0; i < CMD_COUNT; i++)
+        {
+            if (_roundTrips[i]) out.printf("cmd 0x%02X: %lu round trips\n", i, (unsigned long)_roundTrips[i]);
+        }
+    }
+
+    // ---------- Stream ----------
+    int available() override
+    {
+        if (millis() < _readyAt) return 0;
+        return _txLen - _txPos;
+    }
+
+    int read() override
+    {
+        if (available() <= 0) return -1;
+        uint8_t b = _tx[_txPos++];
+        if (_txPos == _txLen) _txPos = _txLen = 0;
+        return b;
+    }
+
+    int peek() override
+    {
+        if (available() <= 0) return -1;
+        return _tx[_txPos];
+    }
+
+    size_t write(uint8_t b) override
+    {
+        // Đồng bộ lại theo start code
+        if (_rxLen == 0 && b != 0xEF) return 1;
+        if (_rxLen == 1 && b != 0x01) { _rxLen = 0; return 1; }
+        if (_rxLen >= sizeof(_rx)) { _rxLen = 0; return 1; }
+        _rx[_rxLen++] = b;
+        if (_rxLen >= 9)
+        {
+            uint16_t len = (_rx[7] << 8) | _rx[8];
+            if (_rxLen == 9u + len)
+            {
+                handlePacket(_rx[6], _rx + 9, len);
+                _rxLen = 0;
+            }
+        }
+        return 1;
+    }
+    using Print::write;
+
+private:
+    uint32_t _baud;
+    uint8_t _rx[9 + PACKET_DATA + 2];
+    uint16_t _rxLen = 0;
+    uint8_t _tx[(TEMPLATE_SIZE / PACKET_DATA + 1) * (PACKET_DATA + 11) + 64];
+    uint16_t _txLen = 0;
+    uint16_t _txPos = 0;
+    unsigned long _readyAt = 0;
+
+    uint16_t _latency[CMD_COUNT] = {};
+    uint16_t _searchCostUs = 800;
+    uint8_t _errorCode[CMD_COUNT] = {};
+    uint8_t _errorCount[CMD_COUNT] = {};
+    uint32_t _roundTrips[CMD_COUNT] = {};
+
+    bool _fingerPresent = false;
+    bool _imageReady = false;
+    uint16_t _identity = 0;
+    uint8_t _quality = 100;
+
+    uint8_t _charBuf[2][TEMPLATE_SIZE] = {};
+    uint16_t _db[CAPACITY] = {}; // chỉ lưu identity; template được dựng lại khi LoadChar
+    uint8_t _used[CAPACITY / 8] = {};
+
+    // Đang nhận DownChar: buffer đích (1/2) và số byte đã nhận
+    uint8_t _downBuf = 0;
+    uint16_t _downLen = 0;
+
+    // Template giả: 2 byte đầu là identity, phần còn lại là mẫu suy ra từ identity
+    static void makeTemplate(uint8_t *out, uint16_t identity)
+    {
+        out[0] = identity >> 8;
+        out[1] = identity & 0xFF;
+        uint32_t x = identity * 2654435761u + 1;
+        for (uint16_t i = 2; i < TEMPLATE_SIZE; i++)
+        {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            out[i] = x & 0xFF;
+        }
+    }
+
+    static uint16_t identityOf(const uint8_t *tpl) { return (tpl[0] << 8) | tpl[1]; }
+
+    bool used(uint16_t page) const { return _used[page / 8] & (1 << (page % 8)); }
+
+    void setUsed(uint16_t page, bool on)
+    {
+        if (on) _used[page / 8] |= 1 << (page % 8);
+        else _used[page / 8] &= ~(1 << (page % 8));
+    }
+
+    uint8_t *charBuf(uint8_t id) { return _charBuf[id == 2 ? 1 : 0]; }
+
+    void queuePacket(uint8_t pid, const uint8_t *payload, uint16_t n)
+    {
+        if ((size_t)_txLen + n + 11 > sizeof(_tx)) return;
+        uint16_t len = n + 2;
+        uint8_t head[9] = {0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, pid, (uint8_t)(len >> 8), (uint8_t)len};
+        memcpy(_tx + _txLen, head, 9);
+        memcpy(_tx + _txLen + 9, payload, n);
+        uint16_t sum = pid + (len >> 8) + (len & 0xFF);
+        for (uint16_t i = 0; i < n; i++) sum += payload[i];
+        _tx[_txLen + 9 + n] = sum >> 8;
+        _tx[_txLen + 10 + n] = sum & 0xFF;
+        _txLen += n + 11;
+    }
+
+    void ack(uint8_t cmd, const uint8_t *payload, uint16_t n, uint32_t extraMs = 0)
+    {
+        // Trễ xử lý của lệnh + thời gian truyền gói lệnh và gói trả về (10 bit/byte)
+        uint32_t wireMs = ((uint32_t)(n + 11 + 12) * 10 * 1000) / _baud;
+        _readyAt = millis() + (cmd < CMD_COUNT ? _latency[cmd] : 0) + extraMs + wireMs;
+        queuePacket(0x07, payload, n);
+    }
+
+    void ackCode(uint8_t cmd, uint8_t code) { ack(cmd, &code, 1); }
+
+    void handlePacket(uint8_t pid, const uint8_t *p, uint16_t len)
+    {
+        if (len < 2) return;
+        uint16_t n = len - 2;
+        uint16_t sum = pid + (len >> 8) + (len & 0xFF);
+        for (uint16_t i = 0; i < n; i++) sum += p[i];
+        if (sum != ((p[n] << 8) | p[n + 1]))
+        {
+            ackCode(0, 0x01); // lỗi nhận gói
+            return;
+        }
+
+        if (pid == 0x02 || pid == 0x08)
+        {
+            receiveData(pid, p, n);
+            return;
+        }
+        if (pid != 0x01 || n == 0) return;
+
+        uint8_t cmd = p[0];
+        if (cmd < CMD_COUNT)
+        {
+            _roundTrips[cmd]++;
+            if (_errorCount[cmd])
+            {
+                _errorCount[cmd]--;
+                ackCode(cmd, _errorCode[cmd]);
+                return;
+            }
+        }
+        handleCommand(cmd, p + 1, n - 1);
+    }
+
+    void handleCommand(uint8_t cmd, const uint8_t *arg, uint16_t n)
+    {
+        switch (cmd)
+        {
+        case 0x01: // GetImage
+            _imageReady = _fingerPresent;
+            ackCode(cmd, _fingerPresent ? 0x00 : 0x02);
+            break;
+
+        case 0x02: // Img2Tz
+            if (!_imageReady) { ackCode(cmd, 0x15); break; }
+            if (_quality < 30) { ackCode(cmd, 0x06); break; }
+            if (_quality < 50) { ackCode(cmd, 0x07); break; }
+            makeTemplate(charBuf(arg[0]), _identity);
+            ackCode(cmd, 0x00);
+            break;
+
+        case 0x03: // Match buffer 1 với buffer 2
+        {
+            bool match = identityOf(_charBuf[0]) == identityOf(_charBuf[1]);
+            uint16_t score = match ? matchScore() : 0;
+            uint8_t r[3] = {(uint8_t)(match ? 0x00 : 0x08), (uint8_t)(score >> 8), (uint8_t)score};
+            ack(cmd, r, 3);
+            break;
+        }
+
+        case 0x04: // Search
+        case 0x1B: // HiSpeedSearch
+        {
+            uint16_t start = (arg[1] << 8) | arg[2];
+            uint16_t count = (arg[3] << 8) | arg[4];
+            uint16_t want = identityOf(charBuf(arg[0]));
+            uint32_t compared = 0;
+            for (uint32_t page = start; page < (uint32_t)start + count && page < CAPACITY; page++)
+            {
+                if (!used(page)) continue;
+                compared++;
+                if (_db[page] == want)
+                {
+                    uint16_t score = matchScore();
+                    uint8_t r[5] = {0x00, (uint8_t)(page >> 8), (uint8_t)page, (uint8_t)(score >> 8), (uint8_t)score};
+                    ack(cmd, r, 5, compared * _searchCostUs / 1000);
+                    return;
+                }
+            }
+            uint8_t r[5] = {0x09, 0, 0, 0, 0};
+            ack(cmd, r, 5, compared * _searchCostUs / 1000);
+            break;
+        }
+
+        case 0x05: // RegModel
+            if (identityOf(_charBuf[0]) != identityOf(_charBuf[1])) { ackCode(cmd, 0x0A); break; }
+            memcpy(_charBuf[1], _charBuf[0], TEMPLATE_SIZE);
+            ackCode(cmd, 0x00);
+            break;
+
+        case 0x06: // Store
+        {
+            uint16_t page = (arg[1] << 8) | arg[2];
+            if (page >= CAPACITY) { ackCode(cmd, 0x0B); break; }
+            _db[page] = identityOf(charBuf(arg[0]));
+            setUsed(page, true);
+            ackCode(cmd, 0x00);
+            break;
+        }
+
+        case 0x07: // LoadChar
+        {
+            uint16_t page = (arg[1] << 8) | arg[2];
+            if (page >= CAPACITY) { ackCode(cmd, 0x0B); break; }
+            if (!used(page)) { ackCode(cmd, 0x0C); break; }
+            makeTemplate(charBuf(arg[0]), _db[page]);
+            ackCode(cmd, 0x00);
+            break;
+        }
+
+        case 0x08: // UpChar: ACK rồi các gói data, gói cuối pid 0x08
+        {
+            ackCode(cmd, 0x00);
+            const uint8_t *tpl = charBuf(arg[0]);
+            for (uint16_t off = 0; off < TEMPLATE_SIZE; off += PACKET_DATA)
+            {
+                bool last = off + PACKET_DATA >= TEMPLATE_SIZE;
+                queuePacket(last ? 0x08 : 0x02, tpl + off, PACKET_DATA);
+            }
+            break;
+        }
+
+        case 0x09: // DownChar: ACK rồi nhận các gói data
+            _downBuf = arg[0];
+            _downLen = 0;
+            ackCode(cmd, 0x00);
+            break;
+
+        case 0x0C: // DeleteChar
+        {
+            uint16_t page = (arg[0] << 8) | arg[1];
+            uint16_t count = (arg[2] << 8) | arg[3];
+            if (page + count > CAPACITY) { ackCode(cmd, 0x10); break; }
+            for (uint16_t i = 0; i < count; i++) setUsed(page + i, false);
+            ackCode(cmd, 0x00);
+            break;
+        }
+
+        case 0x0D: // Empty
+            memset(_used, 0, sizeof(_used));
+            ackCode(cmd, 0x00);
+            break;
+
+        case 0x0F: // ReadSysPara
+        {
+            uint8_t r[17] = {0x00,
+                             0x00, 0x00,                  // status
+                             0x00, 0x09,                  // system id
+                             0x00, (uint8_t)CAPACITY,     // capacity
+                             0x00, 0x03,                  // security level
+                             0xFF, 0xFF, 0xFF, 0xFF,      // address
+                             0x00, 0x02,                  // packet size: 128
+                             0x00, (uint8_t)(_baud / 9600)};
+            ack(cmd, r, sizeof(r));
+            break;
+        }
+
+        case 0x13: // VfyPwd (mật khẩu mặc định 0)
+        {
+            bool ok = n >= 4 && arg[0] == 0 && arg[1] == 0 && arg[2] == 0 && arg[3] == 0;
+            ackCode(cmd, ok ? 0x00 : 0x13);
+            break;
+        }
+
+        case 0x1D: // TemplateNum
+        {
+            uint16_t count = 0;
+            for (uint16_t i = 0; i < CAPACITY; i++) count += used(i);
+            uint8_t r[3] = {0x00, (uint8_t)(count >> 8), (uint8_t)count};
+            ack(cmd, r, 3);
+            break;
+        }
+
+        case 0x1F: // ReadIndexTable: 32 byte bitmap cho trang 0 (256 slot)
+        {
+            uint8_t r[33] = {0x00};
+            if (n >= 1 && arg[0] == 0) memcpy(r + 1, _used, sizeof(_used));
+            ack(cmd, r, sizeof(r));
+            break;
+        }
+
+        default:
+            ackCode(cmd, 0x01);
+            break;
+        }
+    }
+
+    void receiveData(uint8_t pid, const uint8_t *p, uint16_t n)
+    {
+        if (_downBuf == 0) return;
+        uint8_t *dst = charBuf(_downBuf);
+        uint16_t room = TEMPLATE_SIZE - _downLen;
+        uint16_t take = n < room ? n : room;
+        memcpy(dst + _downLen, p, take);
+        _downLen += take;
+        if (pid == 0x08) _downBuf = 0;
+    }
+
+    // Điểm khớp tỉ lệ với chất lượng ảnh: quality 50 -> 50, 100 -> 200
+    uint16_t matchScore() const { return _quality >= 50 ? _quality * 3 - 100 : 50; }
+};
@@ -1,9 +1,13 @@
 #pragma once
 #include <Arduino.h>
 #include <Adafruit_Fingerprint.h>
+#include "LatencyBench.h"
 
 class AS608FingerSensor {
   public:
+    static constexpr int NO_FINGER = -2; // trySearch(): chưa có ngón tay
+    static constexpr uint8_t CMD_MATCH = 0x03; // so buffer 1 với buffer 2, Adafruit không định nghĩa
+
     // Constructor: truyền số Serial và chân RX/TX
     AS608FingerSensor(HardwareSerial *serialPort, uint8_t rxPin, uint8_t txPin, uint32_t baud = 57600) {
       _serial = serialPort;
@@ -13,10 +17,21 @@ class AS608FingerSensor {
       _finger = new Adafruit_Fingerprint(_serial);
     }
 
+    // Constructor cho Stream bất kỳ (vd. AS608Emulator), không cần cấu hình UART
+    AS608FingerSensor(Stream *stream) {
+      _serial = nullptr;
+      _rxPin = 0;
+      _txPin = 0;
+      _baud = 0;
+      _finger = new Adafruit_Fingerprint(stream);
+    }
+
     // Khởi tạo cảm biến
     bool begin() {
-      _serial->begin(_baud, SERIAL_8N1, _rxPin, _txPin);
-      delay(100);
+      if (_serial) {
+        _serial->begin(_baud, SERIAL_8N1, _rxPin, _txPin);
+        delay(100);
+      }
       if (_finger->verifyPassword()) {
         Serial.println("Found fingerprint sensor!");
         _finger->getParameters();
@@ -51,44 +66,28 @@ class AS608FingerSensor {
       }
     }
 
-    // Hàm enroll vân tay với ID
-    bool enroll(uint16_t id) {
-      int p = -1;
+    // Hàm enroll vân tay với ID. timeoutMs > 0: cả lần enroll (2 lần đặt + nhấc ngón)
+    // phải xong trong thời gian này, không thì trả false thay vì chờ mãi
+    bool enroll(uint16_t id, uint32_t timeoutMs = 0) {
+      uint32_t start = millis();
       Serial.print("Waiting for valid finger to enroll as #"); Serial.println(id);
 
       // Lấy ảnh
-      while (p != FINGERPRINT_OK) {
-        p = _finger->getImage();
-        switch (p) {
-          case FINGERPRINT_OK: Serial.println("Image taken"); break;
-          case FINGERPRINT_NOFINGER: Serial.print("."); break;
-          case FINGERPRINT_PACKETRECIEVEERR: Serial.println("Communication error"); return false;
-          case FINGERPRINT_IMAGEFAIL: Serial.println("Imaging error"); return false;
-          default: Serial.println("Unknown error"); return false;
-        }
-      }
+      if (!waitImage(start, timeoutMs)) return false;
 
       // Chuyển ảnh thành template
-      p = _finger->image2Tz(1);
+      int p = _finger->image2Tz(1);
       if (p != FINGERPRINT_OK) { Serial.println("Image conversion failed"); return false; }
 
       Serial.println("Remove finger");
       delay(2000);
-      while (_finger->getImage() != FINGERPRINT_NOFINGER);
+      while (_finger->getImage() != FINGERPRINT_NOFINGER) {
+        if (expired(start, timeoutMs)) { Serial.println("Timeout"); return false; }
+      }
 
       // Lấy ảnh lần 2
-      p = -1;
       Serial.println("Place same finger again");
-      while (p != FINGERPRINT_OK) {
-        p = _finger->getImage();
-        switch (p) {
-          case FINGERPRINT_OK: Serial.println("Image taken"); break;
-          case FINGERPRINT_NOFINGER: Serial.print("."); break;
-          case FINGERPRINT_PACKETRECIEVEERR: Serial.println("Communication error"); return false;
-          case FINGERPRINT_IMAGEFAIL: Serial.println("Imaging error"); return false;
-          default: Serial.println("Unknown error"); return false;
-        }
-      }
+      if (!waitImage(start, timeoutMs)) return false;
 
       p = _finger->image2Tz(2);
       if (p != FINGERPRINT_OK) { Serial.println("Image conversion failed"); return false; }
@@ -120,26 +119,98 @@ class AS608FingerSensor {
           default: Serial.println("Unknown error"); return -1;
         }
       }
+      return match();
+    }
+
+    // Chụp thử một lần, không chờ ngón tay: NO_FINGER nếu cảm biến trống,
+    // ngược lại như search(). Mỗi lần gọi là một round trip GetImage (~60 ms)
+    int trySearch() {
+      int p = _finger->getImage();
+      if (p == FINGERPRINT_NOFINGER) return NO_FINGER;
+      if (p != FINGERPRINT_OK) return -1;
+      return match();
+    }
+
+    // Như trySearch() nhưng xác minh 1:1 bằng verify()
+    int tryVerify(uint16_t first, uint16_t count) {
+      int p = _finger->getImage();
+      if (p == FINGERPRINT_NOFINGER) return NO_FINGER;
+      if (p != FINGERPRINT_OK) return -1;
+      return verify(first, count);
+    }
+
+    // Điểm khớp của lần match()/verify() gần nhất, 0 nếu không khớp
+    uint16_t confidence() const { return _confidence; }
+
+    // Ngón tay còn đặt trên cảm biến không (để chờ nhấc ra sau trySearch())
+    bool present() {
+      return _finger->getImage() == FINGERPRINT_OK;
+    }
+
+    // Tìm ảnh vừa chụp trong bộ nhớ
+    int match() {
+      BENCH_BEGIN(BENCH_FINGER_MATCH);
+      BENCH_SPAN(BENCH_COST_UART);
+      _confidence = 0;
 
       // Chuyển ảnh thành template
-      p = _finger->image2Tz();
-      if (p != FINGERPRINT_OK) { Serial.println("Could not convert image"); return -1; }
+      int p = _finger->image2Tz();
+      if (p != FINGERPRINT_OK) return -1;
 
       // Tìm kiếm trong bộ nhớ
       p = _finger->fingerFastSearch();
       if (p == FINGERPRINT_OK) {
-        Serial.print("Found ID #"); 
-        Serial.print(_finger->fingerID); 
+        _confidence = _finger->confidence;
         return _finger->fingerID;
-      } else if (p == FINGERPRINT_NOTFOUND) {
-        Serial.println("No match found");
-        return 0;
-      } else {
-        Serial.println("Search error");
-        return -1;
       }
+      return p == FINGERPRINT_NOTFOUND ? 0 : -1;
     }
 
+    // Xác minh 1:1: chỉ so ảnh vừa chụp với các slot [first, first + count) của
+    // một người, thời gian không phụ thuộc số vân tay đã enroll. Một slot thì
+    // LoadChar + Match trực tiếp, nhiều slot thì HiSpeedSearch giới hạn dải.
+    // Trả ID khớp, 0 nếu không khớp (kể cả slot trống), -1 nếu lỗi. Không in Serial:
+    // match()/verify() nằm trên đường mở khóa và được đo bằng benchmark
+    int verify(uint16_t first, uint16_t count) {
+      BENCH_BEGIN(BENCH_FINGER_VERIFY);
+      BENCH_SPAN(BENCH_COST_UART);
+      _confidence = 0;
+
+      if (count == 1) {
+        // Ảnh vào buffer 2, template của slot vào buffer 1 rồi Match
+        if (_finger->image2Tz(2) != FINGERPRINT_OK) return -1;
+        int p = _finger->loadModel(first);
+        if (p == FINGERPRINT_DBREADFAIL || p == FINGERPRINT_BADLOCATION) return 0; // slot trống
+        if (p != FINGERPRINT_OK) return -1;
+        uint8_t cmd[] = {CMD_MATCH};
+        uint8_t score[2];
+        p = command(cmd, sizeof(cmd), score, sizeof(score));
+        if (p == FINGERPRINT_OK) {
+          _confidence = (score[0] << 8) | score[1];
+          return first;
+        }
+        return p == FINGERPRINT_NOMATCH ? 0 : -1;
+      }
+
+      if (_finger->image2Tz(1) != FINGERPRINT_OK) return -1;
+      uint8_t cmd[] = {FINGERPRINT_HISPEEDSEARCH, 0x01, (uint8_t)(first >> 8), (uint8_t)first,
+                       (uint8_t)(count >> 8), (uint8_t)count};
+      uint8_t reply[4];
+      int p = command(cmd, sizeof(cmd), reply, sizeof(reply));
+      if (p == FINGERPRINT_OK) {
+        uint16_t id = (reply[0] << 8) | reply[1];
+        _confidence = (reply[2] << 8) | reply[3];
+        return id;
+      }
+      return p == FINGERPRINT_NOTFOUND ? 0 : -1;
+    }
+
+    // Từng bước enroll để EnrollJob chạy không chặn; trả mã FINGERPRINT_*
+    uint8_t getImage() { return _finger->getImage(); }
+    uint8_t image2Tz(uint8_t slot) { return _finger->image2Tz(slot); }
+    uint8_t createModel() { return _finger->createModel(); }
+    uint8_t storeModel(uint16_t id) { return _finger->storeModel(id); }
+
     // Hàm xóa toàn bộ dữ liệu vân tay
     int emptyDatabase() {
       int res = _finger->emptyDatabase();
@@ -153,9 +224,40 @@ class AS608FingerSensor {
     }
 
   private:
+    static bool expired(uint32_t start, uint32_t timeoutMs) {
+      return timeoutMs && millis() - start >= timeoutMs;
+    }
+
+    // Chờ ảnh cho enroll(): false nếu lỗi hoặc hết thời gian
+    bool waitImage(uint32_t start, uint32_t timeoutMs) {
+      while (true) {
+        int p = _finger->getImage();
+        switch (p) {
+          case FINGERPRINT_OK: Serial.println("Image taken"); return true;
+          case FINGERPRINT_NOFINGER: Serial.print("."); break;
+          case FINGERPRINT_PACKETRECIEVEERR: Serial.println("Communication error"); return false;
+          case FINGERPRINT_IMAGEFAIL: Serial.println("Imaging error"); return false;
+          default: Serial.println("Unknown error"); return false;
+        }
+        if (expired(start, timeoutMs)) { Serial.println("Timeout"); return false; }
+      }
+    }
+
+    // Lệnh thư viện Adafruit không có (Match, HiSpeedSearch theo dải): gửi gói lệnh,
+    // trả mã xác nhận, phần còn lại của gói trả về chép vào reply
+    uint8_t command(uint8_t *data, uint16_t len, uint8_t *reply = nullptr, uint16_t replyLen = 0) {
+      Adafruit_Fingerprint_Packet packet(FINGERPRINT_COMMANDPACKET, len, data);
+      _finger->writeStructuredPacket(packet);
+      if (_finger->getStructuredPacket(&packet) != FINGERPRINT_OK) return FINGERPRINT_PACKETRECIEVEERR;
+      if (packet.type != FINGERPRINT_ACKPACKET) return FINGERPRINT_PACKETRECIEVEERR;
+      if (reply) memcpy(reply, packet.data + 1, replyLen);
+      return packet.data[0];
+    }
+
     HardwareSerial *_serial;
     Adafruit_Fingerprint *_finger;
     uint8_t _rxPin;
     uint8_t _txPin;
     uint32_t _baud;
+    uint16_t _confidence = 0;
 };
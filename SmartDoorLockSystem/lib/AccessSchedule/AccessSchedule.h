@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/***
+ * Lịch truy cập theo tuần cho từng chủ thể: PIN dùng chung (chủ thể 0) và
+ * từng vân tay (chủ thể = ID 1-127).
+ *
+ * Mỗi lịch là bitmap 7 ngày × 96 ô 15 phút = 672 bit = 84 byte, biên dịch sẵn
+ * trên máy (tools/schedule.py) rồi gửi xuống bằng lệnh MQTT, nên khóa không
+ * phải phân tích luật lúc có người mở cửa: allowed() chỉ tra một bit. Ô s nằm ở
+ * byte s / 8, bit s % 8 (LSB trước); tuần bắt đầu Chủ nhật 00:00 như tm_wday.
+ *
+ * Chủ thể chưa có lịch thì không bị giới hạn. Bảng nằm trọn trong RAM
+ * (128 × 84 byte), main.cpp lưu từng lịch vào flash và nạp lại lúc khởi động.
+ ***/
+class AccessSchedule {
+public:
+    static constexpr uint8_t SLOT_MINUTES = 15;
+    static constexpr uint16_t SLOTS = 7 * 24 * 60 / SLOT_MINUTES;
+    static constexpr uint8_t BYTES = SLOTS / 8;
+    static constexpr uint8_t SUBJECTS = 128;
+    static constexpr uint8_t SUBJECT_PIN = 0;
+    static_assert(SLOTS % 8 == 0, "bitmap phải đủ byte");
+
+    // Ô 15 phút trong tuần của giờ địa phương t
+    static uint16_t slotOf(const tm &t) {
+        return (t.tm_wday * 24 * 60 + t.tm_hour * 60 + t.tm_min) / SLOT_MINUTES;
+    }
+
+    bool restricted(uint8_t subject) const {
+        return subject < SUBJECTS && (_restricted[subject >> 3] >> (subject & 7) & 1);
+    }
+
+    bool allowed(uint8_t subject, uint16_t slot) const {
+        if (!restricted(subject)) return true;
+        return slot < SLOTS && (_bits[subject][slot >> 3] >> (slot & 7) & 1);
+    }
+
+    void set(uint8_t subject, const uint8_t *bits) {
+        if (subject >= SUBJECTS) return;
+        memcpy(_bits[subject], bits, BYTES);
+        _restricted[subject >> 3] |= 1 << (subject & 7);
+    }
+
+    void clear(uint8_t subject) {
+        if (subject >= SUBJECTS) return;
+        _restricted[subject >> 3] &= ~(1 << (subject & 7));
+    }
+
+    uint8_t count() const {
+        uint8_t n = 0;
+        for (uint8_t b : _restricted) n += __builtin_popcount(b);
+        return n;
+    }
+
+private:
+    uint8_t _restricted[SUBJECTS / 8] = {};
+    uint8_t _bits[SUBJECTS][BYTES] = {};
+};
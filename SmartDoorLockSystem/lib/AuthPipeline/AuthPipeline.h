@@ -0,0 +1,72 @@
+#pragma once
+#include <stdint.h>
+
+/***
+ * Gộp các yếu tố xác thực (PIN, vân tay) đến song song từ loop().
+ *
+ * Bàn phím và cảm biến vân tay được quét cùng lúc, yếu tố nào xong thì gọi
+ * submit(). ANY: yếu tố đúng đầu tiên mở khóa. BOTH (2FA): cần cả PIN và vân
+ * tay đúng, yếu tố thứ hai phải tới trong WINDOW_MS kể từ yếu tố đầu; quá hạn
+ * thì yếu tố đang giữ bị bỏ (expire()). Yếu tố sai luôn bị từ chối ngay và xóa
+ * yếu tố đang chờ, nên không ghép được PIN đúng với nhiều lần thử vân tay.
+ *
+ * OTP (mã một lần do dashboard cấp cho khách) tự nó đủ mở khóa ở cả hai chính
+ * sách: khách không có vân tay, và mã đã giới hạn thời gian, chỉ dùng một lần.
+ ***/
+class AuthPipeline {
+public:
+    static constexpr uint32_t WINDOW_MS = 20000;
+
+    enum Factor : uint8_t {
+        PIN = 1 << 0,
+        FINGER = 1 << 1,
+        OTP = 1 << 2,
+    };
+    enum Policy : uint8_t {
+        ANY,
+        BOTH,
+    };
+    enum Decision : uint8_t {
+        GRANTED,
+        PENDING, // đúng, chờ yếu tố còn lại
+        DENIED,
+    };
+
+    void setPolicy(Policy policy) {
+        _policy = policy;
+        reset();
+    }
+    Policy policy() const { return _policy; }
+
+    Decision submit(Factor factor, bool ok, uint32_t now) {
+        expire(now);
+        if (!ok) {
+            reset();
+            return DENIED;
+        }
+        if (_policy == ANY || factor == OTP) {
+            reset();
+            return GRANTED;
+        }
+        if (_have == 0) _since = now;
+        _have |= factor;
+        if (_have != (PIN | FINGER)) return PENDING;
+        reset();
+        return GRANTED;
+    }
+
+    // Trả true đúng một lần khi yếu tố đang giữ hết hạn
+    bool expire(uint32_t now) {
+        if (_have == 0 || now - _since < WINDOW_MS) return false;
+        reset();
+        return true;
+    }
+
+    bool pending() const { return _have != 0; }
+    void reset() { _have = 0; }
+
+private:
+    Policy _policy = ANY;
+    uint8_t _have = 0; // mặt nạ Factor đã đúng
+    uint32_t _since = 0;
+};
@@ -0,0 +1,229 @@
+#pragma once
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <atomic>
+#include <type_traits>
+#include <utility>
+
+/***
+ * Log nhị phân bất đồng bộ thay cho Serial.printf trên đường chạy nóng.
+ *
+ * BLOG(ID, args...) chỉ ghi một frame vài chục byte vào ring buffer rồi trả về
+ * (không format chuỗi, không chờ UART); task "binlog" mức ưu tiên thấp trên core
+ * 0 đẩy ring ra Serial. Mỗi format có mức riêng trong LogFormats.h, bản ghi dưới
+ * BLOG_LEVEL bị loại lúc biên dịch bằng if constexpr: không sinh code, không
+ * tính đối số. Số và kiểu đối số được kiểm tra với format bằng static_assert.
+ *
+ * Ring là SPSC không khóa: chỉ loop task (task gọi begin()) được ghi, bản ghi từ
+ * task khác bị bỏ và tính vào dropped(); ring đầy cũng vậy. report() gửi số bản
+ * ghi bị bỏ thành bản ghi DROPPED.
+ *
+ * Frame: A5 <len> <id u16> <µs u32> <đối số> <xor của len byte từ id>, số
+ * nguyên LE. Số = 4 byte, chuỗi = 1 byte độ dài + tối đa STR_MAX byte. Text Serial
+ * khác (thư viện, console) vẫn xen giữa các frame; tools/logdecode.py tách ra.
+ ***/
+
+#define BLOG_NONE 0
+#define BLOG_ERROR 1
+#define BLOG_WARN 2
+#define BLOG_INFO 3
+#define BLOG_DEBUG 4
+#ifndef BLOG_LEVEL
+#define BLOG_LEVEL BLOG_INFO
+#endif
+
+#include "LogFormats.h"
+
+enum LogId : uint16_t {
+#define BLOG_FORMAT_ENUM(name, level, fmt) LOGF_##name,
+    BLOG_FORMATS(BLOG_FORMAT_ENUM)
+#undef BLOG_FORMAT_ENUM
+    LOGF_COUNT
+};
+
+namespace LogTable {
+    struct Format {
+        uint8_t level;
+        const char *fmt;
+    };
+
+    constexpr Format FORMATS[] = {
+#define BLOG_FORMAT_ROW(name, level, fmt) {level, fmt},
+        BLOG_FORMATS(BLOG_FORMAT_ROW)
+#undef BLOG_FORMAT_ROW
+    };
+
+    // Vị trí ký tự chuyển đổi (d, u, s...) của đặc tả bắt đầu ở f[i] == '%'
+    constexpr size_t conversionAt(const char *f, size_t i) {
+        i++;
+        while (f[i] == '-' || f[i] == '+' || f[i] == ' ' || f[i] == '0' || f[i] == '#') i++;
+        while ((f[i] >= '0' && f[i] <= '9') || f[i] == '.') i++;
+        while (f[i] == 'l' || f[i] == 'h') i++;
+        return i;
+    }
+
+    // Ký tự chuyển đổi của đối số thứ index, '\0' nếu không có
+    constexpr char conversion(const char *f, size_t index) {
+        for (size_t i = 0; f[i]; i++) {
+            if (f[i] != '%') continue;
+            if (f[i + 1] == '%') {
+                i++;
+                continue;
+            }
+            i = conversionAt(f, i);
+            if (index-- == 0) return f[i];
+        }
+        return '\0';
+    }
+
+    constexpr size_t argCount(const char *f) {
+        size_t n = 0;
+        while (conversion(f, n)) n++;
+        return n;
+    }
+
+    // FNV-1a của mức + format mọi dòng; decoder tính lại để phát hiện bảng lệch phiên bản
+    constexpr uint32_t hash() {
+        uint32_t h = 2166136261u;
+        for (const Format &row : FORMATS) {
+            h = (h ^ row.level) * 16777619u;
+            for (size_t i = 0; row.fmt[i]; i++) h = (h ^ (uint8_t)row.fmt[i]) * 16777619u;
+            h = (h ^ 0) * 16777619u;
+        }
+        return h;
+    }
+}
+
+class BinLog {
+public:
+    static constexpr uint8_t SYNC = 0xA5;
+    static constexpr size_t RING_SIZE = 4096; // lũy thừa của 2
+    static constexpr size_t STR_MAX = 48;
+    static constexpr size_t HEADER_LEN = 8;   // sync, len, id, µs
+    static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "RING_SIZE phải là lũy thừa của 2");
+
+    // Gọi đầu setup() từ loop task
+    void begin(Print &out) {
+        _out = &out;
+        _producer = xTaskGetCurrentTaskHandle();
+        xTaskCreatePinnedToCore(&BinLog::drainTask, "binlog", 2048, this, 1, nullptr, 0);
+    }
+
+    template <LogId ID, typename... A>
+    void write(A... args) {
+        constexpr const char *fmt = LogTable::FORMATS[ID].fmt;
+        static_assert(LogTable::argCount(fmt) == sizeof...(A), "số đối số khác format");
+        static_assert(argsMatch<ID, A...>(std::index_sequence_for<A...>{}), "%s cần chuỗi, các đặc tả khác cần số nguyên");
+        static_assert(HEADER_LEN - 2 + (0 + ... + argBytes<A>()) <= 255, "frame quá dài");
+
+        if (xTaskGetCurrentTaskHandle() != _producer) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        uint8_t frame[HEADER_LEN + (0 + ... + argBytes<A>()) + 1];
+        size_t n = 2;
+        put32(frame, n, (uint32_t)ID, 2);
+        put32(frame, n, (uint32_t)esp_timer_get_time(), 4);
+        (putArg(frame, n, args), ...);
+        frame[0] = SYNC;
+        frame[1] = n - 2;
+        uint8_t sum = 0;
+        for (size_t i = 2; i < n; i++) sum ^= frame[i];
+        frame[n++] = sum;
+        push(frame, n);
+    }
+
+    // Gọi từ loop(): ghi số bản ghi bị bỏ kể từ lần trước
+    void report() {
+        uint32_t dropped = _dropped.load(std::memory_order_relaxed);
+        if (dropped == _reported) return;
+        _reported = dropped;
+        write<LOGF_DROPPED>(dropped);
+    }
+
+    uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+    uint8_t _ring[RING_SIZE];
+    std::atomic<uint32_t> _head{0}; // chỉ loop task ghi
+    std::atomic<uint32_t> _tail{0}; // chỉ task drain ghi
+    std::atomic<uint32_t> _dropped{0};
+    uint32_t _reported = 0;
+    Print *_out = nullptr;
+    TaskHandle_t _producer = nullptr;
+
+    template <typename T>
+    static constexpr bool isString() {
+        using D = std::decay_t<T>;
+        return std::is_same<D, const char *>::value || std::is_same<D, char *>::value;
+    }
+
+    template <typename T>
+    static constexpr size_t argBytes() {
+        static_assert(isString<T>() || std::is_integral<T>::value || std::is_enum<T>::value, "kiểu đối số không hỗ trợ");
+        return isString<T>() ? 1 + STR_MAX : 4;
+    }
+
+    template <LogId ID, typename... A, size_t... I>
+    static constexpr bool argsMatch(std::index_sequence<I...>) {
+        return (true && ... && (isString<A>() == (LogTable::conversion(LogTable::FORMATS[ID].fmt, I) == 's')));
+    }
+
+    static void put32(uint8_t *f, size_t &n, uint32_t v, uint8_t bytes) {
+        for (uint8_t i = 0; i < bytes; i++) f[n++] = v >> (8 * i);
+    }
+
+    static void putArg(uint8_t *f, size_t &n, const char *s) {
+        size_t len = strnlen(s, STR_MAX);
+        f[n++] = len;
+        memcpy(f + n, s, len);
+        n += len;
+    }
+
+    template <typename T, typename std::enable_if<!std::is_pointer<T>::value, int>::type = 0>
+    static void putArg(uint8_t *f, size_t &n, T v) {
+        put32(f, n, (uint32_t)v, 4);
+    }
+
+    void push(const uint8_t *frame, size_t n) {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        uint32_t tail = _tail.load(std::memory_order_acquire);
+        if (RING_SIZE - (head - tail) < n) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        size_t at = head & (RING_SIZE - 1);
+        size_t first = n < RING_SIZE - at ? n : RING_SIZE - at;
+        memcpy(_ring + at, frame, first);
+        memcpy(_ring, frame + first, n - first);
+        _head.store(head + n, std::memory_order_release);
+    }
+
+    // Đẩy phần liền mạch của ring ra Serial; false nếu ring rỗng
+    bool drain() {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        uint32_t head = _head.load(std::memory_order_acquire);
+        if (head == tail) return false;
+        size_t at = tail & (RING_SIZE - 1);
+        size_t n = head - tail < RING_SIZE - at ? head - tail : RING_SIZE - at;
+        _out->write(_ring + at, n); // chờ UART ở đây, không phải ở loop task
+        _tail.store(tail + n, std::memory_order_release);
+        return true;
+    }
+
+    static void drainTask(void *arg) {
+        BinLog *self = static_cast<BinLog *>(arg);
+        for (;;) {
+            if (!self->drain()) vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+};
+
+extern BinLog binLog; // định nghĩa trong main.cpp
+
+// Ghi bản ghi ID (tên trong LogFormats.h, không có tiền tố LOGF_)
+#define BLOG(id, ...)                                                       \
+    do {                                                                    \
+        if constexpr (LogTable::FORMATS[LOGF_##id].level <= BLOG_LEVEL)     \
+            binLog.write<LOGF_##id>(__VA_ARGS__);                           \
+    } while (0)
@@ -0,0 +1,71 @@
+#pragma once
+
+/***
+ * Bảng format của BinLog: X(tên, mức, "format").
+ *
+ * ID của bản ghi là thứ tự trong bảng, chuỗi format chỉ nằm trong firmware để
+ * tính hash; tools/logdecode.py đọc chính file này để dịch log nhị phân. Chỉ
+ * thêm vào cuối hoặc giữ nguyên thứ tự khi sửa, và dùng decoder cùng phiên bản.
+ *
+ * Đối số: %d %u %x %c (lưu 32 bit) và %s (chép tối đa BinLog::STR_MAX byte).
+ * Không ghi mật khẩu vào log.
+ ***/
+#define BLOG_FORMATS(X)                                                                             \
+    X(BOOT, BLOG_INFO, "log start, table %08x, reset %u")                                           \
+    X(DROPPED, BLOG_WARN, "%u log records dropped")                                                 \
+    X(READY, BLOG_INFO, "system ready")                                                             \
+    X(DOOR_ID, BLOG_INFO, "door id %s, group %s")                                                   \
+    X(PASSWORD_LOADED, BLOG_INFO, "password loaded from %s")                                        \
+    X(WARM_RESUMED, BLOG_INFO, "warm restart #%u: resumed in %u ms (fails %u, relocked %u)")        \
+    X(OTA_PENDING_VERIFY, BLOG_INFO, "new OTA image, waiting for MQTT before confirming")           \
+    X(WIFI_CONNECTING, BLOG_INFO, "wifi connecting to %s")                                          \
+    X(WIFI_BACKGROUND, BLOG_INFO, "warm restart, wifi connecting in background")                    \
+    X(WIFI_CONNECTED, BLOG_INFO, "wifi connected in %u ms, ip %u.%u.%u.%u, rssi %d dBm")            \
+    X(WIFI_FAILED, BLOG_WARN, "wifi not connected after %u ms, offline mode")                       \
+    X(MQTT_SERVER, BLOG_INFO, "mqtt server %s:%u")                                                  \
+    X(MQTT_CONNECTING, BLOG_INFO, "mqtt connecting as %s (user %s)")                                \
+    X(MQTT_CONNECTED, BLOG_INFO, "mqtt connected")                                                  \
+    X(MQTT_CONNECT_FAILED, BLOG_WARN, "mqtt connect failed, rc=%d %s")                              \
+    X(MQTT_SUB, BLOG_DEBUG, "sub %s")                                                               \
+    X(CMD_IN, BLOG_INFO, "command in [%s] %s (class %x)")                                           \
+    X(REQ_BAD_HEADER, BLOG_WARN, "bad request header, ignored")                                     \
+    X(REQ_DUPLICATE, BLOG_INFO, "duplicate request %s suppressed")                                  \
+    X(CMD_NOT_ALLOWED, BLOG_WARN, "command not allowed on %s, ignored")                             \
+    X(CMD_CLEAR_FINGERS, BLOG_INFO, "processing clear all fingers")                                 \
+    X(CMD_CHANGE_PASSWORD, BLOG_INFO, "processing password change")                                 \
+    X(PASS_BAD_LENGTH, BLOG_WARN, "password must be exactly 4 digits (got %u)")                     \
+    X(PASS_BAD_CHAR, BLOG_WARN, "password char %u is not a digit (0x%02x)")                         \
+    X(PASS_CHANGED, BLOG_INFO, "password changed, saved to flash %u")                               \
+    X(GROUP_CHANGED, BLOG_INFO, "group topic %s")                                                   \
+    X(BATCH_ROLLBACK, BLOG_WARN, "batch failed, password/group rolled back")                        \
+    X(BENCH_REGRESSION, BLOG_WARN, "latency regression vs baseline")                                \
+    X(OTA_SESSION, BLOG_INFO, "ota session: %u bytes, crc %08x")                                    \
+    X(OTA_WRITTEN, BLOG_INFO, "ota image written, rebooting")                                       \
+    X(OTA_FAILED, BLOG_ERROR, "ota failed: %s")                                                     \
+    X(OTA_CONFIRMED, BLOG_INFO, "ota image confirmed, rollback cancelled")                          \
+    X(STALL, BLOG_ERROR, "stall %s at %s site_pc=%08x task_pc=%08x stalled_ms=%u reset=%u")         \
+    X(CLEAR_FINGERS, BLOG_INFO, "clear all fingers: %s")                                            \
+    X(MENU_TIMEOUT, BLOG_INFO, "menu timeout, auto exiting")                                        \
+    X(PIN_OK, BLOG_INFO, "password correct")                                                        \
+    X(PIN_WRONG, BLOG_INFO, "wrong password, attempt %u")                                           \
+    X(REPLAY_WIFI, BLOG_DEBUG, "[replay] wifi status %u")                                           \
+    X(FINGER_RESULT, BLOG_INFO, "finger search: id %d (0 = no match, -1 = error)")                  \
+    X(AUTH_PENDING, BLOG_INFO, "2fa: %s ok, waiting for second factor")                             \
+    X(AUTH_EXPIRED, BLOG_INFO, "2fa: second factor timed out")                                      \
+    X(AUTH_POLICY, BLOG_INFO, "auth policy %s")                                                     \
+    X(ENROLL_START, BLOG_INFO, "enroll job started, slot %u")                                       \
+    X(ENROLL_PHASE, BLOG_INFO, "%s")                                                                \
+    X(SCHEDULES_LOADED, BLOG_INFO, "%u access schedules loaded")                                    \
+    X(TIME_SYNCED, BLOG_INFO, "time synced, epoch %u")                                              \
+    X(SCHEDULE_DENIED, BLOG_INFO, "subject %u outside schedule (clock synced %u)")                  \
+    X(LAN_LISTENING, BLOG_INFO, "lan server on port %u (token set %u)")                             \
+    X(LAN_TOKEN, BLOG_INFO, "lan token %s")                                                         \
+    X(OTP_RESULT, BLOG_INFO, "one-time code %s, step %u")                                           \
+    X(TOTP_SECRET, BLOG_INFO, "totp secret %s")                                                     \
+    X(FINGER_USER, BLOG_INFO, "finger user %u -> slots %u+%u")                                      \
+    X(FINGER_USER_UNKNOWN, BLOG_INFO, "unknown finger user %u")                                     \
+    X(FINGER_VERIFY, BLOG_INFO, "finger verify user %u -> %d")                                      \
+    X(FINGER_SESSION, BLOG_INFO, "finger session -> %d, confidence %u, %u captures, %u ms")          \
+    X(REPLAY_LATE, BLOG_INFO, "[replay] type %u at %u ms late by %u ms")                            \
+    X(REPLAY_DONE, BLOG_INFO, "[replay] done after %u ms")                                          \
+    X(OTA_KEY, BLOG_INFO, "ota key: %s")
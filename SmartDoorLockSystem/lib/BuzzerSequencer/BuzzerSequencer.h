@@ -0,0 +1,153 @@
+#pragma once
+#include <Arduino.h>
+#include <esp_timer.h>
+
+/***
+ * Phát chuỗi âm báo nền cho còi bằng LEDC + esp_timer.
+ *
+ * play() chỉ đưa mẫu vào hàng đợi rồi trả về ngay; các nốt được bật/tắt bởi
+ * timer nên âm báo không cộng thêm độ trễ nào vào đường xử lý phím. advance()
+ * chỉ chạy trong callback của timer (task esp_timer), nên không bao giờ chạy
+ * song song với chính nó; play() muốn phát ngay thì hẹn timer 0 µs.
+ *
+ * Còi chủ động (chỉ cần mức HIGH) dùng duty 100%; còi thụ động dùng tần số
+ * của từng nốt. Kênh LEDC mặc định là 2 (timer LEDC 1) để không đụng tần số
+ * 50Hz của servo ở kênh 0.
+ ***/
+struct BuzzerNote {
+    uint16_t freq; // Hz, 0 = nghỉ
+    uint16_t ms;
+};
+
+struct BuzzerPattern {
+    const BuzzerNote *notes;
+    uint8_t count;
+    uint8_t repeats; // số lần phát thêm sau lần đầu
+};
+
+// ---------- Mẫu âm báo ----------
+namespace Beep {
+    constexpr BuzzerNote KEYPRESS_NOTES[] = {{2700, 30}};
+    constexpr BuzzerNote SCAN_NOTES[] = {{2700, 50}};
+    constexpr BuzzerNote MENU_NOTES[] = {{2700, 100}};
+    constexpr BuzzerNote SUCCESS_NOTES[] = {{2000, 60}, {0, 40}, {2700, 100}};
+    constexpr BuzzerNote FAILURE_NOTES[] = {{1200, 200}};
+    constexpr BuzzerNote LOCKOUT_NOTES[] = {{1200, 150}, {0, 100}};
+
+    constexpr BuzzerPattern KEYPRESS = {KEYPRESS_NOTES, 1, 0};
+    constexpr BuzzerPattern SCAN = {SCAN_NOTES, 1, 0};
+    constexpr BuzzerPattern MENU = {MENU_NOTES, 1, 0};
+    constexpr BuzzerPattern SUCCESS = {SUCCESS_NOTES, 3, 0};
+    constexpr BuzzerPattern FAILURE = {FAILURE_NOTES, 1, 0};
+    constexpr BuzzerPattern LOCKOUT = {LOCKOUT_NOTES, 2, 4};
+}
+
+class BuzzerSequencer {
+public:
+    static constexpr uint8_t QUEUE_SIZE = 4;
+
+    void begin(uint8_t pin, uint8_t channel = 2, bool activeBuzzer = true) {
+        _channel = channel;
+        _active = activeBuzzer;
+        ledcSetup(_channel, 2000, 10);
+        ledcAttachPin(pin, _channel);
+        ledcWrite(_channel, 0);
+
+        esp_timer_create_args_t args = {};
+        args.callback = &BuzzerSequencer::onTimer;
+        args.arg = this;
+        args.name = "buzzer";
+        esp_timer_create(&args, &_timer);
+    }
+
+    // Đưa mẫu vào hàng đợi; interrupt = true thì bỏ mọi thứ đang phát
+    void play(const BuzzerPattern &p, bool interrupt = false) {
+        portENTER_CRITICAL(&_mux);
+        if (interrupt) {
+            _head = _tail = 0;
+            _current = nullptr;
+        }
+        uint8_t next = (_tail + 1) % QUEUE_SIZE;
+        if (next != _head) { // đầy thì bỏ mẫu mới
+            _queue[_tail] = &p;
+            _tail = next;
+        }
+        bool idle = _current == nullptr;
+        portEXIT_CRITICAL(&_mux);
+
+        if (idle) {
+            // Nhường cho callback: nếu nó đang chạy và đã hẹn timer thì start_once
+            // này thất bại, lần hẹn đó sẽ lấy mẫu mới từ hàng đợi
+            if (interrupt) esp_timer_stop(_timer);
+            esp_timer_start_once(_timer, 0);
+        }
+    }
+
+    void stop() {
+        portENTER_CRITICAL(&_mux);
+        _head = _tail = 0;
+        _current = nullptr;
+        portEXIT_CRITICAL(&_mux);
+        esp_timer_stop(_timer);
+        ledcWrite(_channel, 0);
+    }
+
+    bool playing() const { return _current != nullptr; }
+
+private:
+    uint8_t _channel = 2;
+    bool _active = true;
+    esp_timer_handle_t _timer = nullptr;
+    portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+
+    const BuzzerPattern *_queue[QUEUE_SIZE] = {};
+    uint8_t _head = 0;
+    uint8_t _tail = 0;
+
+    const BuzzerPattern *volatile _current = nullptr;
+    uint8_t _note = 0;
+    uint8_t _repeat = 0;
+
+    static void onTimer(void *arg) {
+        static_cast<BuzzerSequencer *>(arg)->advance();
+    }
+
+    void tone(uint16_t freq) {
+        if (freq == 0) {
+            ledcWrite(_channel, 0);
+        } else if (_active) {
+            ledcWrite(_channel, (1 << 10) - 1);
+        } else {
+            ledcWriteTone(_channel, freq);
+        }
+    }
+
+    // Chuyển sang nốt kế tiếp và hẹn giờ cho nốt đó
+    void advance() {
+        const BuzzerNote *note = nullptr;
+        portENTER_CRITICAL(&_mux);
+        if (_current) {
+            _note++;
+            if (_note >= _current->count) {
+                _note = 0;
+                if (_repeat < _current->repeats) _repeat++;
+                else _current = nullptr;
+            }
+        }
+        if (!_current && _head != _tail) {
+            _current = _queue[_head];
+            _head = (_head + 1) % QUEUE_SIZE;
+            _note = 0;
+            _repeat = 0;
+        }
+        if (_current) note = &_current->notes[_note];
+        portEXIT_CRITICAL(&_mux);
+
+        if (!note) {
+            ledcWrite(_channel, 0);
+            return;
+        }
+        tone(note->freq);
+        esp_timer_start_once(_timer, (uint64_t)note->ms * 1000);
+    }
+};
@@ -0,0 +1,259 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/***
+ * Áp bản vá nhị phân (delta) theo luồng, không phụ thuộc ESP32.
+ *
+ * Bản vá (trước khi nén) gồm header rồi chuỗi lệnh, số nguyên là varint LE:
+ *   "DLT1" u32 oldSize u32 oldCrc u32 newSize u32 newCrc   (u32 little-endian)
+ *   0x01 COPY   <off> <len>         out += old[off, off+len)
+ *   0x02 ADD    <off> <len> <bytes> out += old[off+i] + bytes[i]   (mod 256)
+ *   0x03 INSERT <len> <bytes>       out += bytes
+ *   0x00 END
+ * ADD là ý tưởng của bsdiff: code bị dời địa chỉ chỉ khác vài byte con trỏ nên
+ * phần hiệu gần như toàn số 0 và nén rất tốt. oldSize = 0 là ảnh đầy đủ (chỉ
+ * INSERT), không kiểm tra ảnh gốc.
+ *
+ * feed() nhận từng mẩu bất kỳ của luồng đã giải nén; dữ liệu ra được đẩy qua
+ * callback ngay nên không cần giữ cả ảnh trong RAM. Tạo/kiểm tra bản vá trên
+ * PC: tools/ota_delta.py (cùng định dạng).
+ ***/
+class DeltaPatch {
+public:
+    using ReadOld = bool (*)(void *ctx, uint32_t offset, uint8_t *buf, size_t len);
+    using WriteNew = bool (*)(void *ctx, const uint8_t *buf, size_t len);
+
+    enum Status : int8_t {
+        IN_PROGRESS = 0,
+        DONE = 1,
+        ERR_MAGIC = -1,
+        ERR_BASE = -2,  // ảnh đang chạy không phải ảnh gốc của bản vá
+        ERR_OP = -3,
+        ERR_READ = -4,
+        ERR_WRITE = -5,
+        ERR_SIZE = -6,
+        ERR_CRC = -7,
+    };
+
+    static constexpr uint8_t OP_END = 0x00;
+    static constexpr uint8_t OP_COPY = 0x01;
+    static constexpr uint8_t OP_ADD = 0x02;
+    static constexpr uint8_t OP_INSERT = 0x03;
+    static constexpr size_t HEADER_LEN = 20;
+    static constexpr size_t CHUNK = 256;
+
+    static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t len) {
+        crc = ~crc;
+        while (len--) {
+            crc ^= *data++;
+            for (uint8_t k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+        return ~crc;
+    }
+
+    void begin(ReadOld readOld, WriteNew writeNew, void *ctx) {
+        _readOld = readOld;
+        _writeNew = writeNew;
+        _ctx = ctx;
+        _state = S_HEADER;
+        _status = IN_PROGRESS;
+        _headerLen = 0;
+        _written = 0;
+        _crc = 0;
+    }
+
+    Status feed(const uint8_t *data, size_t len) {
+        while (len && _status == IN_PROGRESS) {
+            size_t used = step(data, len);
+            data += used;
+            len -= used;
+        }
+        return _status;
+    }
+
+    Status status() const { return _status; }
+    uint32_t oldSize() const { return _oldSize; }
+    uint32_t newSize() const { return _newSize; }
+    uint32_t written() const { return _written; }
+
+private:
+    enum State : uint8_t { S_HEADER, S_OP, S_OFF, S_LEN, S_ADD, S_INSERT, S_END };
+
+    ReadOld _readOld = nullptr;
+    WriteNew _writeNew = nullptr;
+    void *_ctx = nullptr;
+    State _state = S_HEADER;
+    Status _status = IN_PROGRESS;
+
+    uint8_t _header[HEADER_LEN];
+    uint8_t _headerLen = 0;
+    uint32_t _oldSize = 0, _oldCrc = 0, _newSize = 0, _newCrc = 0;
+
+    uint8_t _op = 0;
+    uint32_t _varint = 0;
+    uint8_t _shift = 0;
+    uint32_t _off = 0;
+    uint32_t _remain = 0;
+    uint32_t _written = 0;
+    uint32_t _crc = 0;
+
+    static uint32_t u32(const uint8_t *p) {
+        return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+    }
+
+    Status fail(Status s) { return _status = s; }
+
+    bool emit(const uint8_t *buf, size_t len) {
+        if (_written + len > _newSize) {
+            fail(ERR_SIZE);
+            return false;
+        }
+        if (!_writeNew(_ctx, buf, len)) {
+            fail(ERR_WRITE);
+            return false;
+        }
+        _crc = crc32(_crc, buf, len);
+        _written += len;
+        return true;
+    }
+
+    bool parseHeader() {
+        if (memcmp(_header, "DLT1", 4) != 0) {
+            fail(ERR_MAGIC);
+            return false;
+        }
+        _oldSize = u32(_header + 4);
+        _oldCrc = u32(_header + 8);
+        _newSize = u32(_header + 12);
+        _newCrc = u32(_header + 16);
+        if (_oldSize == 0) return true;
+
+        // Bản vá chỉ đúng với đúng ảnh gốc: so CRC của ảnh đang chạy
+        uint8_t buf[CHUNK];
+        uint32_t crc = 0;
+        for (uint32_t off = 0; off < _oldSize; off += CHUNK) {
+            size_t n = _oldSize - off < CHUNK ? _oldSize - off : CHUNK;
+            if (!_readOld(_ctx, off, buf, n)) {
+                fail(ERR_READ);
+                return false;
+            }
+            crc = crc32(crc, buf, n);
+        }
+        if (crc != _oldCrc) {
+            fail(ERR_BASE);
+            return false;
+        }
+        return true;
+    }
+
+    // Varint xong thì trả true, giá trị trong _varint
+    bool varint(uint8_t b) {
+        if (_shift > 28) {
+            fail(ERR_OP);
+            return false;
+        }
+        _varint |= (uint32_t)(b & 0x7F) << _shift;
+        _shift += 7;
+        return !(b & 0x80);
+    }
+
+    void startVarint(State next) {
+        _state = next;
+        _varint = 0;
+        _shift = 0;
+    }
+
+    bool copy(uint32_t off, uint32_t len) {
+        uint8_t buf[CHUNK];
+        if (off + len > _oldSize || off + len < off) {
+            fail(ERR_OP);
+            return false;
+        }
+        while (len) {
+            size_t n = len < CHUNK ? len : CHUNK;
+            if (!_readOld(_ctx, off, buf, n)) {
+                fail(ERR_READ);
+                return false;
+            }
+            if (!emit(buf, n)) return false;
+            off += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    // Xử lý một phần đầu của data, trả số byte đã dùng
+    size_t step(const uint8_t *data, size_t len) {
+        switch (_state) {
+        case S_HEADER: {
+            size_t n = HEADER_LEN - _headerLen < len ? HEADER_LEN - _headerLen : len;
+            memcpy(_header + _headerLen, data, n);
+            _headerLen += n;
+            if (_headerLen == HEADER_LEN && parseHeader()) _state = S_OP;
+            return n;
+        }
+        case S_OP:
+            _op = data[0];
+            if (_op == OP_END) {
+                _state = S_END;
+                if (_written != _newSize) fail(ERR_SIZE);
+                else if (_crc != _newCrc) fail(ERR_CRC);
+                else _status = DONE;
+            } else if (_op == OP_COPY || _op == OP_ADD) {
+                startVarint(S_OFF);
+            } else if (_op == OP_INSERT) {
+                startVarint(S_LEN);
+            } else {
+                fail(ERR_OP);
+            }
+            return 1;
+        case S_OFF:
+            if (varint(data[0])) {
+                _off = _varint;
+                startVarint(S_LEN);
+            }
+            return 1;
+        case S_LEN:
+            if (varint(data[0])) {
+                _remain = _varint;
+                if (_op == OP_COPY) {
+                    if (copy(_off, _remain)) _state = S_OP;
+                } else if (_op == OP_ADD && _off + _remain > _oldSize) {
+                    fail(ERR_OP);
+                } else {
+                    _state = _op == OP_ADD ? S_ADD : S_INSERT;
+                    if (_remain == 0) _state = S_OP;
+                }
+            }
+            return 1;
+        case S_ADD: {
+            uint8_t old[CHUNK];
+            size_t n = _remain < len ? _remain : len;
+            if (n > CHUNK) n = CHUNK;
+            if (!_readOld(_ctx, _off, old, n)) {
+                fail(ERR_READ);
+                return n;
+            }
+            for (size_t i = 0; i < n; i++) old[i] += data[i];
+            if (!emit(old, n)) return n;
+            _off += n;
+            _remain -= n;
+            if (_remain == 0) _state = S_OP;
+            return n;
+        }
+        case S_INSERT: {
+            size_t n = _remain < len ? _remain : len;
+            if (!emit(data, n)) return n;
+            _remain -= n;
+            if (_remain == 0) _state = S_OP;
+            return n;
+        }
+        case S_END:
+        default:
+            fail(ERR_OP); // dữ liệu sau END
+            return len;
+        }
+    }
+};
@@ -0,0 +1,562 @@
+/***
+ * Topic và định dạng bản tin MQTT của khóa cửa.
+ *
+ * Chỉ phụ thuộc thư viện C chuẩn nên dùng chung được cho firmware, công cụ
+ * chạy trên PC (giả lập nhiều khóa, tạo tải cho broker/Node-RED) và test.
+ * Mọi chuỗi lệnh/sự kiện nằm ở đây, sửa định dạng thì sửa một chỗ.
+ ***/
+
+#pragma once
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+namespace DoorProtocol
+{
+    // ---------- Topics ----------
+    // Mỗi khóa có namespace riêng site/<door-id>/..., door-id là eFuse MAC dạng
+    // hex (cùng giá trị với client ID) nên không khóa nào nhận lệnh của khóa khác.
+    // Dashboard dùng wildcard site/+/status, site/+/fingerprint.
+    constexpr const char *SITE = "site";
+    constexpr const char *SUB_STATUS = "status";      // khóa -> dashboard
+    constexpr const char *SUB_CMD = "command";        // dashboard -> khóa
+    constexpr const char *SUB_FINGER = "fingerprint"; // khóa -> dashboard
+    constexpr const char *SUB_BENCH = "bench";
+    constexpr const char *SUB_INPUTS = "inputs";
+    constexpr const char *SUB_ACK = "ack";            // khóa -> dashboard, trả lời lệnh có request ID
+    constexpr const char *SUB_METRICS = "metrics";
+    constexpr const char *SUB_OTA = "ota";               // dashboard -> khóa, mẩu bản vá nhị phân
+    constexpr const char *SUB_OTA_STATUS = "ota_status"; // khóa -> dashboard
+
+    // Lệnh cho cả nhóm / mọi khóa. door-id là hex nên không trùng "group"/"all"
+    constexpr const char *TOPIC_BROADCAST_CMD = "site/all/command";
+    constexpr const char *DEFAULT_GROUP = "default";   // site/group/<tên>/command
+
+    constexpr size_t DOOR_ID_LEN = 13;  // 12 hex + '\0'
+    constexpr const char *CLIENT_ID_PREFIX = "ESP32_Door_";
+    constexpr size_t CLIENT_ID_LEN = 11 + DOOR_ID_LEN; // "ESP32_Door_" + door-id + '\0'
+    constexpr size_t PASS_LEN = 4;
+    constexpr size_t GROUP_LEN = 17;
+    constexpr size_t TOPIC_LEN = 48;
+
+    // Topic của một khóa, dựng một lần lúc khởi động hoặc khi đổi nhóm
+    struct DoorTopics
+    {
+        char doorId[DOOR_ID_LEN];
+        char group[GROUP_LEN];
+        char status[TOPIC_LEN];
+        char command[TOPIC_LEN];
+        char finger[TOPIC_LEN];
+        char bench[TOPIC_LEN];
+        char inputs[TOPIC_LEN];
+        char ack[TOPIC_LEN];
+        char metrics[TOPIC_LEN];
+        char groupCommand[TOPIC_LEN];
+        char ota[TOPIC_LEN];
+        char otaStatus[TOPIC_LEN];
+
+        void build(const char *id, const char *groupName)
+        {
+            snprintf(doorId, sizeof(doorId), "%s", id);
+            snprintf(group, sizeof(group), "%s", groupName);
+            snprintf(status, sizeof(status), "%s/%s/%s", SITE, doorId, SUB_STATUS);
+            snprintf(command, sizeof(command), "%s/%s/%s", SITE, doorId, SUB_CMD);
+            snprintf(finger, sizeof(finger), "%s/%s/%s", SITE, doorId, SUB_FINGER);
+            snprintf(bench, sizeof(bench), "%s/%s/%s", SITE, doorId, SUB_BENCH);
+            snprintf(inputs, sizeof(inputs), "%s/%s/%s", SITE, doorId, SUB_INPUTS);
+            snprintf(ack, sizeof(ack), "%s/%s/%s", SITE, doorId, SUB_ACK);
+            snprintf(metrics, sizeof(metrics), "%s/%s/%s", SITE, doorId, SUB_METRICS);
+            snprintf(ota, sizeof(ota), "%s/%s/%s", SITE, doorId, SUB_OTA);
+            snprintf(otaStatus, sizeof(otaStatus), "%s/%s/%s", SITE, doorId, SUB_OTA_STATUS);
+            snprintf(groupCommand, sizeof(groupCommand), "%s/group/%s/%s", SITE, group, SUB_CMD);
+        }
+    };
+
+    // Tên nhóm chỉ gồm [a-z0-9_-] để không chèn được '/', '+', '#' vào topic
+    inline bool validGroupName(const char *name)
+    {
+        size_t n = strlen(name);
+        if (n == 0 || n >= GROUP_LEN) return false;
+        for (size_t i = 0; i < n; i++)
+        {
+            char c = name[i];
+            if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_' || c == '-')) return false;
+        }
+        return true;
+    }
+
+    // ---------- Lệnh trên topic command ----------
+    constexpr const char *CMD_UNLOCK = "unlock";
+    constexpr const char *CMD_CLEAR_FINGERS = "clear_all_fingers";
+    constexpr const char *CMD_CHANGE_PASSWORD = "change_password"; // + 4 chữ số
+    constexpr const char *CMD_BENCH_REPORT = "bench_report";
+    constexpr const char *CMD_BENCH_RESET = "bench_reset";
+    constexpr const char *CMD_DUMP_INPUTS = "dump_inputs";
+    constexpr const char *CMD_SET_GROUP = "set_group ";          // + tên nhóm
+    constexpr const char *CMD_METRICS = "metrics";               // JSON trên topic metrics
+    constexpr const char *CMD_FINGER_STATS = "finger_stats";     // confidence theo ID vân tay, trên topic metrics
+    constexpr const char *CMD_OTA_BEGIN = "ota_begin ";          // + <số byte bản vá> <crc32 hex> <hmac-sha256 hex>
+    constexpr const char *CMD_OTA_ABORT = "ota_abort";
+    constexpr const char *CMD_AUTH_POLICY = "auth_policy ";      // + any | both
+    constexpr const char *CMD_SCHEDULE = "schedule ";            // + <pin|1-127> <bitmap hex> | always
+    constexpr const char *SCHEDULE_PIN = "pin";                  // chủ thể PIN dùng chung
+    constexpr const char *SCHEDULE_ALWAYS = "always";            // bỏ giới hạn
+    constexpr const char *CMD_ENROLL = "enroll";                 // [+ " <slot 1-127>"], chạy nền
+    constexpr const char *CMD_ENROLL_CANCEL = "enroll_cancel";
+    constexpr const char *CMD_FINGER_USER = "finger_user ";      // + <mã 1-999> <slot đầu> <số slot> | <mã> off
+    constexpr const char *FINGER_USER_OFF = "off";
+    constexpr const char *CMD_LAN_TOKEN = "lan_token ";          // + token 16-64 ký tự | off
+    constexpr const char *LAN_TOKEN_OFF = "off";                 // tắt server LAN
+    constexpr const char *CMD_TOTP_SECRET = "totp_secret ";      // + secret 20 byte dạng hex | off
+    constexpr const char *TOTP_SECRET_OFF = "off";
+    constexpr const char *AUTH_POLICY_ANY = "any";               // PIN hoặc vân tay
+    constexpr const char *AUTH_POLICY_BOTH = "both";             // PIN và vân tay (2FA)
+
+    // Lô lệnh: "batch <mode>\n<lệnh 1>\n<lệnh 2>..." -> một bản tin batch_result.
+    // atomic: kiểm tra cả lô trước, lỗi lúc chạy thì khôi phục mật khẩu/nhóm.
+    // stop_on_error: chạy lần lượt, dừng ở lệnh lỗi đầu tiên.
+    constexpr const char *CMD_BATCH = "batch ";
+    constexpr const char *BATCH_ATOMIC = "atomic";
+    constexpr const char *BATCH_STOP_ON_ERROR = "stop_on_error";
+    constexpr uint8_t BATCH_MAX_OPS = 12; // giữ batch_result dưới buffer MQTT 512 byte
+
+    // Header tùy chọn trước lệnh (hoặc lô lệnh): "req <id> [client-ts]\n<lệnh>".
+    // Khóa trả "ack <id> <client-ts> <rx-ms> <done-ms> <ok|fail|dup>\n<sự kiện>" trên
+    // topic ack; rx/done là millis() của khóa. id lặp lại thì lệnh không chạy lại.
+    constexpr const char *REQ_PREFIX = "req ";
+    constexpr size_t REQ_ID_LEN = 25;   // [A-Za-z0-9_-], tối đa 24 ký tự
+    constexpr size_t REQ_TS_LEN = 21;   // số nguyên bất kỳ, khóa chỉ trả lại nguyên văn
+    constexpr const char *ACK_OK = "ok";
+    constexpr const char *ACK_FAIL = "fail";
+    constexpr const char *ACK_DUP = "dup";
+
+    struct RequestHeader
+    {
+        char id[REQ_ID_LEN];       // rỗng = lệnh không có header
+        char clientTs[REQ_TS_LEN];
+        uint32_t rxMs;
+    };
+
+    // Nhóm lệnh, dùng làm mặt nạ quyền cho từng topic đăng ký
+    enum CommandClass : uint8_t
+    {
+        CMDC_NONE = 0,
+        CMDC_UNLOCK = 1 << 0,
+        CMDC_CONFIG = 1 << 1, // mật khẩu, nhóm, chính sách xác thực, lịch, token/secret
+        CMDC_FINGER = 1 << 2, // quản trị vân tay
+        CMDC_DIAG = 1 << 3,   // bench, metrics, thống kê vân tay
+        CMDC_ADMIN = CMDC_CONFIG | CMDC_FINGER,
+        CMDC_OTA = 1 << 4,    // cập nhật firmware, chỉ topic riêng của khóa
+        CMDC_DUMP = 1 << 5,   // xuất log input, chỉ topic riêng của khóa
+        CMDC_ALL = CMDC_UNLOCK | CMDC_ADMIN | CMDC_DIAG | CMDC_OTA | CMDC_DUMP,
+    };
+
+    // ---------- Sự kiện trên topic status ----------
+    constexpr const char *EVT_CONNECTED = "connected";
+    constexpr const char *EVT_DOOR_LOCKED = "door_locked";
+    constexpr const char *EVT_DOOR_UNLOCKED = "door_unlocked";
+    constexpr const char *EVT_DOOR_OPENED = "door_opened";       // servo tới góc mở
+    constexpr const char *EVT_DOOR_CLOSED = "door_closed";       // servo tự khóa lại
+    constexpr const char *EVT_PASSWORD_CHANGED = "password_changed";
+    constexpr const char *EVT_PASSWORD_ERROR_LENGTH = "password_error_length";
+    constexpr const char *EVT_PASSWORD_ERROR_FORMAT = "password_error_format";
+    constexpr const char *EVT_PASSWORD_ERROR_SAVE = "password_error_save"; // ghi flash lỗi, mật khẩu không đổi
+    constexpr const char *EVT_WRONG_PASS = "wrong_pass";         // "wrong_pass: <n>"
+    constexpr const char *EVT_GROUP_CHANGED = "group_changed";   // "group_changed: <tên>"
+    constexpr const char *EVT_GROUP_ERROR = "group_error";
+    constexpr const char *EVT_AUTH_POLICY = "auth_policy";       // "auth_policy: <any|both>"
+    constexpr const char *EVT_AUTH_POLICY_ERROR = "auth_policy_error";
+    constexpr const char *EVT_SCHEDULE_SET = "schedule_set";         // "schedule_set: <pin|id>"
+    constexpr const char *EVT_SCHEDULE_CLEARED = "schedule_cleared"; // "schedule_cleared: <pin|id>"
+    constexpr const char *EVT_SCHEDULE_ERROR = "schedule_error";
+    // "schedule_denied: <pin|id>": PIN/vân tay đúng nhưng ngoài lịch truy cập
+    constexpr const char *EVT_SCHEDULE_DENIED = "schedule_denied";
+    constexpr const char *EVT_LAN_TOKEN_SET = "lan_token_set";
+    constexpr const char *EVT_LAN_TOKEN_ERROR = "lan_token_error";
+    constexpr const char *EVT_TOTP_SECRET_SET = "totp_secret_set";
+    constexpr const char *EVT_TOTP_SECRET_CLEARED = "totp_secret_cleared";
+    constexpr const char *EVT_TOTP_SECRET_ERROR = "totp_secret_error";
+    // "otp_used: <bước>": mở bằng mã một lần, bước = giờ Unix / 30 của mã đã dùng
+    constexpr const char *EVT_OTP_USED = "otp_used";
+    constexpr const char *EVT_FINGER_USER_SET = "finger_user_set";         // "finger_user_set: <mã>"
+    constexpr const char *EVT_FINGER_USER_CLEARED = "finger_user_cleared"; // "finger_user_cleared: <mã>"
+    constexpr const char *EVT_FINGER_USER_ERROR = "finger_user_error";
+    constexpr const char *EVT_UNKNOWN_COMMAND = "unknown_command";
+    constexpr const char *EVT_BAD_REQUEST = "bad_request";       // header "req" sai (trả lời qua LAN)
+    constexpr const char *EVT_NOT_ALLOWED = "not_allowed";       // lệnh không được phép trên topic này
+    constexpr const char *EVT_NOT_BATCHABLE = "not_batchable";   // unlock mở menu nên không chạy trong lô
+    constexpr const char *EVT_RATE_LIMITED = "rate_limited";     // vượt token bucket, lệnh bị bỏ
+    constexpr const char *EVT_METRICS_SENT = "metrics_sent";
+    constexpr const char *EVT_FINGER_STATS_SENT = "finger_stats_sent";
+    // "stall: <loop|net|crash> <site> site_pc=0x.. task_pc=0x.. stalled_ms=<n> uptime_s=<n> reset=<lý do>"
+    constexpr const char *EVT_STALL = "stall";
+    // "warm_restart: reset=<lý do> seq=<n> resume_ms=<n>": khởi động lại và khôi phục trạng thái từ RTC
+    constexpr const char *EVT_WARM_RESTART = "warm_restart";
+
+    // "batch_result: <ok|failed|rejected> <xong>/<tổng>" + mỗi lệnh đã chạy một dòng "<stt> <sự kiện>"
+    constexpr const char *EVT_BATCH_RESULT = "batch_result";
+    constexpr const char *BATCH_OK = "ok";
+    constexpr const char *BATCH_FAILED = "failed";     // dừng giữa chừng
+    constexpr const char *BATCH_REJECTED = "rejected"; // không lệnh nào được chạy
+
+    // ---------- OTA (topic ota, ota_status) ----------
+    // Mỗi bản tin trên topic ota: u32 offset (little-endian) + tối đa OTA_CHUNK byte
+    // bản vá. Khóa trả "ota_next <offset>" sau ota_begin và sau mỗi mẩu, rồi
+    // "ota_done" (khởi động lại vào ảnh mới) hoặc "ota_error <lý do>".
+    constexpr size_t OTA_CHUNK = 400;
+    constexpr size_t OTA_HEADER_LEN = 4;
+    constexpr size_t OTA_MAC_LEN = 32; // HMAC-SHA256 của bản vá theo khóa OTA riêng của khóa cửa
+    constexpr const char *EVT_OTA_NEXT = "ota_next";
+    constexpr const char *EVT_OTA_DONE = "ota_done";
+    constexpr const char *EVT_OTA_ERROR = "ota_error";
+    constexpr const char *EVT_OTA_ABORTED = "ota_aborted";
+    constexpr const char *EVT_OTA_VALID = "ota_valid";   // ảnh mới chạy ổn, đã hủy rollback
+
+    // ---------- Sự kiện trên topic fingerprint ----------
+    constexpr const char *EVT_CHECK_SUCCESS = "check_success";   // "check_success\nID_found: <id>"
+    constexpr const char *EVT_CHECK_FAIL = "check_fail\nID_not_found";
+    constexpr const char *EVT_ADD_SUCCESS = "add_success";       // "add_success\nnew_id: <id>"
+    constexpr const char *EVT_ADD_FAIL = "add_fail";
+    constexpr const char *EVT_CLEAR_SUCCESS = "clear_all_fingers_success";
+    constexpr const char *EVT_CLEAR_FAIL = "clear_all_fingers_fail";
+    // Enroll từ xa, mỗi pha một bản tin: place -> remove -> place_again -> stored | failed
+    constexpr const char *EVT_ENROLL_PLACE = "enroll_place";             // "enroll_place: <id>"
+    constexpr const char *EVT_ENROLL_REMOVE = "enroll_remove";
+    constexpr const char *EVT_ENROLL_PLACE_AGAIN = "enroll_place_again";
+    constexpr const char *EVT_ENROLL_STORED = "enroll_stored";           // "enroll_stored: <id>"
+    // "enroll_failed: <timeout|image|comm|mismatch|store|cancelled|full|slot|slot_used|busy>"
+    constexpr const char *EVT_ENROLL_FAILED = "enroll_failed";
+    constexpr const char *EVT_ENROLL_IDLE = "enroll_idle";              // enroll_cancel khi không có job
+
+    // ---------- Chẩn đoán (topic bench, inputs) ----------
+    constexpr const char *EVT_BENCH_PASS = "bench_pass";
+    constexpr const char *EVT_BENCH_REGRESSION = "bench_regression";
+    constexpr const char *EVT_BENCH_RESET_OK = "bench_reset_ok";
+    constexpr const char *EVT_DUMP_END = "dump_end";
+    constexpr const char *EVT_DUMP_END_FULL = "dump_end_full";
+
+    // ---------- Định dạng ----------
+    inline int formatWrongPass(char *buf, size_t len, unsigned failCount)
+    {
+        return snprintf(buf, len, "%s: %u", EVT_WRONG_PASS, failCount);
+    }
+
+    inline int formatCheckSuccess(char *buf, size_t len, int id)
+    {
+        return snprintf(buf, len, "%s\nID_found: %d", EVT_CHECK_SUCCESS, id);
+    }
+
+    inline int formatAddSuccess(char *buf, size_t len, int id)
+    {
+        return snprintf(buf, len, "%s\nnew_id: %d", EVT_ADD_SUCCESS, id);
+    }
+
+    // "<sự kiện>: <id>" cho enroll_place / enroll_stored
+    inline int formatEnrollId(char *buf, size_t len, const char *event, unsigned id)
+    {
+        return snprintf(buf, len, "%s: %u", event, id);
+    }
+
+    inline int formatEnrollFailed(char *buf, size_t len, const char *reason)
+    {
+        return snprintf(buf, len, "%s: %s", EVT_ENROLL_FAILED, reason);
+    }
+
+    // Client ID MQTT, trùng door-id để broker log ra được khóa nào
+    inline int formatClientId(char *buf, size_t len, const char *doorId)
+    {
+        return snprintf(buf, len, "%s%s", CLIENT_ID_PREFIX, doorId);
+    }
+
+    inline int formatChangePassword(char *buf, size_t len, const char *newPass)
+    {
+        return snprintf(buf, len, "%s%s", CMD_CHANGE_PASSWORD, newPass);
+    }
+
+    inline int formatGroupChanged(char *buf, size_t len, const char *group)
+    {
+        return snprintf(buf, len, "%s: %s", EVT_GROUP_CHANGED, group);
+    }
+
+    inline int formatOtpUsed(char *buf, size_t len, uint32_t step)
+    {
+        return snprintf(buf, len, "%s: %lu", EVT_OTP_USED, (unsigned long)step);
+    }
+
+    inline int formatFingerUser(char *buf, size_t len, const char *event, unsigned code)
+    {
+        return snprintf(buf, len, "%s: %u", event, code);
+    }
+
+    inline int formatAuthPolicy(char *buf, size_t len, const char *policy)
+    {
+        return snprintf(buf, len, "%s: %s", EVT_AUTH_POLICY, policy);
+    }
+
+    // "<sự kiện>: pin" hoặc "<sự kiện>: <id vân tay>"
+    inline int formatSchedule(char *buf, size_t len, const char *event, uint8_t subject)
+    {
+        if (subject == 0) return snprintf(buf, len, "%s: %s", event, SCHEDULE_PIN);
+        return snprintf(buf, len, "%s: %u", event, subject);
+    }
+
+    inline int formatBatchResult(char *buf, size_t len, const char *status, unsigned done, unsigned total)
+    {
+        return snprintf(buf, len, "%s: %s %u/%u", EVT_BATCH_RESULT, status, done, total);
+    }
+
+    // Nối "\n<stt> <sự kiện>" vào cuối buf, cắt bớt nếu đầy
+    inline void appendBatchLine(char *buf, size_t len, unsigned index, const char *event)
+    {
+        size_t used = strlen(buf);
+        if (used + 1 < len) snprintf(buf + used, len - used, "\n%u %s", index, event);
+    }
+
+    inline int formatAck(char *buf, size_t len, const RequestHeader &req, uint32_t doneMs,
+                         const char *status, const char *event)
+    {
+        return snprintf(buf, len, "ack %s %s %lu %lu %s\n%s", req.id, req.clientTs[0] ? req.clientTs : "0",
+                        (unsigned long)req.rxMs, (unsigned long)doneMs, status, event);
+    }
+
+    inline int formatWarmRestart(char *buf, size_t len, unsigned resetReason, uint32_t seq, uint32_t resumeMs)
+    {
+        return snprintf(buf, len, "%s: reset=%u seq=%lu resume_ms=%lu", EVT_WARM_RESTART, resetReason,
+                        (unsigned long)seq, (unsigned long)resumeMs);
+    }
+
+    inline int formatOtaNext(char *buf, size_t len, uint32_t offset)
+    {
+        return snprintf(buf, len, "%s %lu", EVT_OTA_NEXT, (unsigned long)offset);
+    }
+
+    inline int formatOtaError(char *buf, size_t len, const char *reason)
+    {
+        return snprintf(buf, len, "%s %s", EVT_OTA_ERROR, reason);
+    }
+
+    // ---------- Phân tích ----------
+    inline bool startsWith(const char *msg, const char *prefix)
+    {
+        return strncmp(msg, prefix, strlen(prefix)) == 0;
+    }
+
+    // Tách header "req ..."; trả con trỏ tới lệnh, nullptr nếu header sai.
+    // Không có header thì req.id rỗng và trả nguyên msg.
+    inline const char *parseRequest(const char *msg, RequestHeader &req)
+    {
+        req.id[0] = req.clientTs[0] = '\0';
+        if (!startsWith(msg, REQ_PREFIX)) return msg;
+        const char *nl = strchr(msg, '\n');
+        if (!nl) return nullptr;
+        // ID dài quá bị từ chối thay vì cắt: hai ID dài cùng tiền tố sẽ thành trùng nhau
+        const char *p = msg + strlen(REQ_PREFIX);
+        int idEnd = 0;
+        if (sscanf(p, "%24[A-Za-z0-9_-]%n", req.id, &idEnd) != 1) return nullptr;
+        if (p[idEnd] != ' ' && p[idEnd] != '\n') return nullptr;
+        int tsEnd = 0;
+        if (sscanf(p + idEnd, " %20[0-9]%n", req.clientTs, &tsEnd) == 1) {
+            char next = p[idEnd + tsEnd];
+            if (next != ' ' && next != '\n') return nullptr;
+        }
+        return nl + 1;
+    }
+
+    // Payload MQTT (không có '\0') -> lệnh trong buffer cố định: cắt nếu dài hơn size - 1,
+    // bỏ khoảng trắng / \r\n cuối. Trả độ dài lệnh
+    inline size_t copyCommand(char *dst, size_t size, const uint8_t *payload, size_t len)
+    {
+        if (len >= size) len = size - 1;
+        memcpy(dst, payload, len);
+        while (len > 0 && isspace((unsigned char)dst[len - 1])) len--;
+        dst[len] = '\0';
+        return len;
+    }
+
+    struct PasswordCheck
+    {
+        const char *error; // nullptr nếu hợp lệ, ngược lại là sự kiện lỗi
+        size_t len;        // độ dài sau khi bỏ khoảng trắng
+        int badIndex;      // vị trí ký tự không phải số đầu tiên, -1 nếu không có
+        char badChar;
+    };
+
+    // Đối số của change_password: đúng PASS_LEN chữ số, bỏ khoảng trắng hai đầu.
+    // Hợp lệ thì chép vào out (PASS_LEN + 1 byte)
+    inline PasswordCheck parseNewPassword(const char *arg, char *out)
+    {
+        while (*arg == ' ') arg++;
+        PasswordCheck r = {nullptr, strlen(arg), -1, 0};
+        while (r.len > 0 && isspace((unsigned char)arg[r.len - 1])) r.len--;
+        if (r.len != PASS_LEN) {
+            r.error = EVT_PASSWORD_ERROR_LENGTH;
+            return r;
+        }
+        for (size_t i = 0; i < PASS_LEN; i++) {
+            if (arg[i] < '0' || arg[i] > '9') {
+                r = {EVT_PASSWORD_ERROR_FORMAT, r.len, (int)i, arg[i]};
+                return r;
+            }
+        }
+        memcpy(out, arg, PASS_LEN);
+        out[PASS_LEN] = '\0';
+        return r;
+    }
+
+    // "enroll" (slot = 0: ô trống đầu tiên) hoặc "enroll <1-127>"
+    inline bool parseEnroll(const char *msg, uint16_t &slot)
+    {
+        if (strcmp(msg, CMD_ENROLL) == 0) {
+            slot = 0;
+            return true;
+        }
+        if (!startsWith(msg, CMD_ENROLL) || msg[strlen(CMD_ENROLL)] != ' ') return false;
+        char *end;
+        unsigned long n = strtoul(msg + strlen(CMD_ENROLL) + 1, &end, 10);
+        if (*end != '\0' || n < 1 || n > 127) return false;
+        slot = n;
+        return true;
+    }
+
+    // Lệnh mang bí mật (mật khẩu, token, secret TOTP)
+    constexpr const char *SECRET_COMMANDS[] = {CMD_CHANGE_PASSWORD, CMD_LAN_TOKEN, CMD_TOTP_SECRET};
+
+    // Chép msg (có thể nhiều dòng: header req, lô lệnh) sang out, dòng nào là lệnh mang
+    // bí mật thì chỉ giữ tên lệnh. Dùng trước khi lưu payload ra ngoài RAM. Trả độ dài
+    inline size_t redactSecrets(const char *msg, char *out, size_t size)
+    {
+        size_t n = 0;
+        while (*msg && n + 1 < size) {
+            size_t line = strcspn(msg, "\n");
+            size_t keep = line;
+            for (const char *secret : SECRET_COMMANDS) {
+                size_t verb = strcspn(secret, " ");
+                if (strncmp(msg, secret, verb) == 0 && keep > verb) keep = verb;
+            }
+            if (keep > size - 1 - n) keep = size - 1 - n;
+            memcpy(out + n, msg, keep);
+            n += keep;
+            msg += line;
+            if (*msg == '\n' && n + 1 < size) out[n++] = *msg++;
+            else if (*msg == '\n') break;
+        }
+        out[n] = '\0';
+        return n;
+    }
+
+    // Tên lệnh (từ đầu tiên) để log, không kèm tham số
+    inline void commandVerb(const char *msg, char *out, size_t len)
+    {
+        size_t n = strcspn(msg, " \n");
+        if (n >= len) n = len - 1;
+        memcpy(out, msg, n);
+        out[n] = '\0';
+    }
+
+    inline CommandClass commandClass(const char *msg)
+    {
+        if (strcmp(msg, CMD_UNLOCK) == 0) return CMDC_UNLOCK;
+        if (strcmp(msg, CMD_CLEAR_FINGERS) == 0 || startsWith(msg, CMD_ENROLL) || startsWith(msg, CMD_FINGER_USER))
+            return CMDC_FINGER;
+        if (startsWith(msg, CMD_CHANGE_PASSWORD) || startsWith(msg, CMD_SET_GROUP) || startsWith(msg, CMD_AUTH_POLICY) ||
+            startsWith(msg, CMD_SCHEDULE) || startsWith(msg, CMD_LAN_TOKEN) ||
+            startsWith(msg, CMD_TOTP_SECRET))
+            return CMDC_CONFIG;
+        if (strcmp(msg, CMD_BENCH_REPORT) == 0 || strcmp(msg, CMD_BENCH_RESET) == 0 ||
+            strcmp(msg, CMD_METRICS) == 0 || strcmp(msg, CMD_FINGER_STATS) == 0)
+            return CMDC_DIAG;
+        if (strcmp(msg, CMD_DUMP_INPUTS) == 0) return CMDC_DUMP;
+        if (startsWith(msg, CMD_OTA_BEGIN) || strcmp(msg, CMD_OTA_ABORT) == 0) return CMDC_OTA;
+        return CMDC_NONE;
+    }
+
+    // Chuỗi hex đúng 2 * len ký tự -> len byte
+    inline bool parseHex(const char *p, uint8_t *out, size_t len)
+    {
+        if (strlen(p) != len * 2) return false;
+        for (size_t i = 0; i < len; i++) {
+            unsigned v;
+            if (!isxdigit((unsigned char)p[2 * i]) || !isxdigit((unsigned char)p[2 * i + 1]) ||
+                sscanf(p + 2 * i, "%2x", &v) != 1)
+                return false;
+            out[i] = v;
+        }
+        return true;
+    }
+
+    // "schedule <pin|1-127> <hex>|always"; hex đúng len byte. always = true: bỏ lịch, bits không đổi
+    inline bool parseSchedule(const char *msg, uint8_t &subject, uint8_t *bits, size_t len, bool &always)
+    {
+        const char *p = msg + strlen(CMD_SCHEDULE);
+        if (startsWith(p, SCHEDULE_PIN) && p[strlen(SCHEDULE_PIN)] == ' ') {
+            subject = 0;
+            p += strlen(SCHEDULE_PIN);
+        } else {
+            char *end;
+            unsigned long n = strtoul(p, &end, 10);
+            if (end == p || *end != ' ' || n < 1 || n > 127) return false;
+            subject = n;
+            p = end;
+        }
+        p++;
+        always = strcmp(p, SCHEDULE_ALWAYS) == 0;
+        return always || parseHex(p, bits, len);
+    }
+
+    // "totp_secret <hex>|off"; hex đúng len byte. off = true: tắt mã một lần
+    inline bool parseTotpSecret(const char *msg, uint8_t *secret, size_t len, bool &off)
+    {
+        const char *p = msg + strlen(CMD_TOTP_SECRET);
+        off = strcmp(p, TOTP_SECRET_OFF) == 0;
+        return off || parseHex(p, secret, len);
+    }
+
+    // "finger_user <mã> <slot đầu> <số slot>" hoặc "finger_user <mã> off" (off = true, first/count không đổi).
+    // Chỉ tách số; giới hạn mã và dải do FingerUsers::valid() kiểm tra
+    inline bool parseFingerUser(const char *msg, uint16_t &code, uint8_t &first, uint8_t &count, bool &off)
+    {
+        const char *p = msg + strlen(CMD_FINGER_USER);
+        char *end;
+        unsigned long c = strtoul(p, &end, 10);
+        if (end == p || *end != ' ' || c > 0xFFFF) return false;
+        code = c;
+        p = end + 1;
+        off = strcmp(p, FINGER_USER_OFF) == 0;
+        if (off) return true;
+        unsigned f, n;
+        int used = 0;
+        if (sscanf(p, "%u %u%n", &f, &n, &used) != 2 || p[used] != '\0' || f > 0xFF || n > 0xFF) return false;
+        first = f;
+        count = n;
+        return true;
+    }
+
+    // "ota_begin <bytes> <crc32 hex> <hmac hex>"; mac nhận OTA_MAC_LEN byte
+    inline bool parseOtaBegin(const char *msg, uint32_t &bytes, uint32_t &crc, uint8_t *mac)
+    {
+        unsigned long b, c;
+        int used = 0;
+        if (sscanf(msg + strlen(CMD_OTA_BEGIN), "%lu %lx %n", &b, &c, &used) != 2 || b == 0 || used == 0) return false;
+        bytes = b;
+        crc = c;
+        return parseHex(msg + strlen(CMD_OTA_BEGIN) + used, mac, OTA_MAC_LEN);
+    }
+
+    // ---------- Định tuyến lệnh ----------
+    // Bảng đăng ký: mỗi topic lệnh một dòng kèm mặt nạ nhóm lệnh được phép.
+    // Topic trỏ vào DoorTopics hoặc hằng chuỗi, bảng không tự giữ chuỗi.
+    struct Route
+    {
+        const char *topic;
+        uint8_t allow; // CommandClass
+    };
+
+    inline const Route *findRoute(const Route *table, size_t count, const char *topic)
+    {
+        for (size_t i = 0; i < count; i++)
+            if (strcmp(table[i].topic, topic) == 0) return &table[i];
+        return nullptr;
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <Arduino.h>
+#include "AS608FingerSensorWithAdafruitFingerprintSensorLibrary.h"
+
+/***
+ * Enroll vân tay chạy nền, thay cho AS608FingerSensor::enroll() chặn suốt hai
+ * lần chụp.
+ *
+ * Mỗi poll() gửi nhiều nhất một lệnh UART (GetImage ~60 ms, hoặc chuỗi
+ * Img2Tz/RegModel/Store khi vừa có ảnh) rồi trả về, nên loop() vẫn quét bàn
+ * phím và phục vụ MQTT trong lúc chờ ngón tay. Các pha:
+ *
+ *   PLACE -> (ảnh 1) -> REMOVE -> (nhấc ngón, tối thiểu LIFT_MS) -> PLACE_AGAIN
+ *         -> (ảnh 2, ghép model, lưu) -> STORED
+ *
+ * Lỗi ở bất kỳ pha nào, hoặc một pha chờ quá PHASE_TIMEOUT_MS, kết thúc bằng
+ * FAILED với lý do trong error(). STORED/FAILED là trạng thái cuối, active()
+ * trả false.
+ ***/
+class EnrollJob {
+public:
+    static constexpr uint32_t POLL_MS = 100;
+    static constexpr uint32_t LIFT_MS = 1000;
+    static constexpr uint32_t PHASE_TIMEOUT_MS = 20000;
+
+    enum Phase : uint8_t {
+        IDLE,
+        PLACE,       // chờ ngón tay lần 1
+        REMOVE,      // chờ nhấc ngón tay
+        PLACE_AGAIN, // chờ ngón tay lần 2
+        STORED,
+        FAILED,
+    };
+
+    explicit EnrollJob(AS608FingerSensor &sensor) : _sensor(sensor) {}
+
+    void begin(uint16_t id, uint32_t now) {
+        _id = id;
+        _error = nullptr;
+        enter(PLACE, now);
+    }
+
+    // Trả true khi pha vừa đổi (kể cả sang STORED/FAILED) để báo tiến độ
+    bool poll(uint32_t now) {
+        if (!active() || now - _lastPoll < POLL_MS) return false;
+        _lastPoll = now;
+        if (now - _phaseSince > PHASE_TIMEOUT_MS) return fail("timeout", now);
+
+        uint8_t p = _sensor.getImage();
+        if (p != FINGERPRINT_OK && p != FINGERPRINT_NOFINGER && p != FINGERPRINT_IMAGEFAIL) return fail("comm", now);
+        bool finger = p != FINGERPRINT_NOFINGER; // ảnh lỗi vẫn là có ngón tay (đặt lệch, chưa nhấc hẳn)
+
+        switch (_phase) {
+        case PLACE:
+            if (!finger) return false;
+            if (p != FINGERPRINT_OK || _sensor.image2Tz(1) != FINGERPRINT_OK) return fail("image", now);
+            return enter(REMOVE, now);
+        case REMOVE:
+            if (finger || now - _phaseSince < LIFT_MS) return false;
+            return enter(PLACE_AGAIN, now);
+        case PLACE_AGAIN:
+            if (!finger) return false;
+            if (p != FINGERPRINT_OK || _sensor.image2Tz(2) != FINGERPRINT_OK) return fail("image", now);
+            if (_sensor.createModel() != FINGERPRINT_OK) return fail("mismatch", now);
+            if (_sensor.storeModel(_id) != FINGERPRINT_OK) return fail("store", now);
+            return enter(STORED, now);
+        default:
+            return false;
+        }
+    }
+
+    void cancel(uint32_t now) {
+        if (active()) fail("cancelled", now);
+    }
+
+    bool active() const { return _phase == PLACE || _phase == REMOVE || _phase == PLACE_AGAIN; }
+    Phase phase() const { return _phase; }
+    uint16_t id() const { return _id; }
+    const char *error() const { return _error ? _error : "none"; }
+
+private:
+    AS608FingerSensor &_sensor;
+    Phase _phase = IDLE;
+    uint16_t _id = 0;
+    uint32_t _phaseSince = 0;
+    uint32_t _lastPoll = 0;
+    const char *_error = nullptr;
+
+    bool enter(Phase phase, uint32_t now) {
+        _phase = phase;
+        _phaseSince = now;
+        return true;
+    }
+
+    bool fail(const char *reason, uint32_t now) {
+        _error = reason;
+        return enter(FAILED, now);
+    }
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+#include <soc/gpio_reg.h>
+#include <soc/soc.h>
+
+/***
+ * Tập chân GPIO cố định lúc biên dịch, thao tác thẳng trên thanh ghi.
+ *
+ * Số chân đến từ build flag (ROW0_PIN...), nên mặt nạ của từng bank tính sẵn
+ * lúc biên dịch: bank 0 là GPIO 0-31 (GPIO_OUT_W1TS/W1TC, GPIO_IN), bank 1 là
+ * GPIO 32-39 (GPIO_OUT1_*, GPIO_IN1). Bank không có chân nào thì không sinh
+ * truy cập thanh ghi. Một lần ghi W1TS/W1TC đổi mọi chân trong bank cùng lúc,
+ * một lần đọc GPIO_IN lấy mọi chân; không qua digitalWrite/digitalRead.
+ *
+ * Chỉ dùng sau khi đã pinMode() từng chân (một lần, lúc begin()).
+ ***/
+template <uint8_t... Pins>
+struct PinSet {
+    static constexpr uint8_t COUNT = sizeof...(Pins);
+    static constexpr uint8_t PINS[COUNT] = {Pins...};
+    static_assert(COUNT > 0, "PinSet rỗng");
+    static_assert(((Pins < 40) && ...), "ESP32 chỉ có GPIO 0-39");
+
+    static constexpr uint32_t bank0(uint8_t pin) { return pin < 32 ? 1u << pin : 0; }
+    static constexpr uint32_t bank1(uint8_t pin) { return pin >= 32 ? 1u << (pin - 32) : 0; }
+    static constexpr uint32_t MASK0 = (bank0(Pins) | ...);
+    static constexpr uint32_t MASK1 = (bank1(Pins) | ...);
+
+    // Mọi chân lên HIGH / xuống LOW, mỗi bank một lần ghi
+    static inline void setAll() { write(GPIO_OUT_W1TS_REG, GPIO_OUT1_W1TS_REG, MASK0, MASK1); }
+    static inline void clearAll() { write(GPIO_OUT_W1TC_REG, GPIO_OUT1_W1TC_REG, MASK0, MASK1); }
+
+    // Chân thứ i của tập
+    static inline void set(uint8_t i) { write(GPIO_OUT_W1TS_REG, GPIO_OUT1_W1TS_REG, bank0(PINS[i]), bank1(PINS[i])); }
+    static inline void clear(uint8_t i) { write(GPIO_OUT_W1TC_REG, GPIO_OUT1_W1TC_REG, bank0(PINS[i]), bank1(PINS[i])); }
+
+    // Bit i = mức của chân thứ i, đọc mỗi bank một lần
+    static inline uint32_t read() {
+        uint32_t in0 = 0, in1 = 0;
+        if constexpr (MASK0 != 0) in0 = REG_READ(GPIO_IN_REG);
+        if constexpr (MASK1 != 0) in1 = REG_READ(GPIO_IN1_REG);
+        uint32_t bits = 0;
+        for (uint8_t i = 0; i < COUNT; i++) {
+            if ((in0 & bank0(PINS[i])) || (in1 & bank1(PINS[i]))) bits |= 1u << i;
+        }
+        return bits;
+    }
+
+private:
+    static inline void write(uint32_t reg0, uint32_t reg1, uint32_t mask0, uint32_t mask1) {
+        if (MASK0 != 0 && mask0) REG_WRITE(reg0, mask0);
+        if (MASK1 != 0 && mask1) REG_WRITE(reg1, mask1);
+    }
+};
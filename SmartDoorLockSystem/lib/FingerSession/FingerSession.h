@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+
+/***
+ * Một lần đặt ngón tay = một phiên gồm nhiều lần chụp + khớp, thay vì chốt
+ * ngay ở ảnh đầu tiên. Ngón tay đặt lệch (không khớp, ảnh nhòe) được chụp lại
+ * trong cùng phiên, nên không mất một vòng báo sai -> đặt lại và không bị tính
+ * là nhập sai từng ảnh.
+ *
+ *   - Khớp với confidence >= confident: chấp nhận ngay
+ *   - Khớp yếu: chụp thêm; ảnh sau khớp cùng ID thì chấp nhận, khác ID thì từ
+ *     chối. Hết phiên mà chỉ có một lần khớp yếu thì vẫn chấp nhận, vì AS608
+ *     đã lọc theo security level, như trước khi có phiên
+ *   - Không khớp / ảnh hỏng: chụp lại
+ *
+ * Phiên kết thúc sau maxCaptures ảnh hoặc budgetMs kể từ ảnh đầu. submit()
+ * nhận từng kết quả, poll() chốt phiên hết hạn khi không có ảnh mới (ngón
+ * tay đã nhấc ra).
+ ***/
+class FingerSession {
+public:
+    enum Verdict : uint8_t {
+        PENDING, // chụp tiếp
+        ACCEPT,  // id() là ID khớp
+        REJECT,  // id(): 0 không khớp, -1 ảnh hỏng/lỗi ở mọi lần chụp
+    };
+
+    FingerSession(uint32_t budgetMs, uint16_t confident, uint8_t maxCaptures)
+        : _budgetMs(budgetMs), _confident(confident), _maxCaptures(maxCaptures) {}
+
+    // result: ID > 0, 0 không khớp, -1 lỗi; confidence chỉ có nghĩa khi result > 0
+    Verdict submit(int result, uint16_t confidence, uint32_t now) {
+        if (!_active) {
+            _active = true;
+            _since = now;
+            _captures = 0;
+            _weakId = 0;
+            _sawNoMatch = false;
+        }
+        _captures++;
+        if (result > 0 && confidence >= _confident) return finish(ACCEPT, result, confidence);
+        if (result > 0) {
+            if (_weakId == result) return finish(ACCEPT, result, confidence > _weakConf ? confidence : _weakConf);
+            if (_weakId != 0) return finish(REJECT, 0, 0); // hai ảnh khớp hai người khác nhau
+            _weakId = result;
+            _weakConf = confidence;
+        }
+        if (result == 0) _sawNoMatch = true;
+        if (_captures >= _maxCaptures || now - _since >= _budgetMs) return close();
+        return PENDING;
+    }
+
+    // Gọi khi không có ảnh mới; hết budget thì chốt phiên
+    Verdict poll(uint32_t now) {
+        if (!_active || now - _since < _budgetMs) return PENDING;
+        return close();
+    }
+
+    void reset() { _active = false; }
+
+    bool active() const { return _active; }
+    int id() const { return _id; }
+    uint16_t confidence() const { return _confidence; }
+    uint8_t captures() const { return _captures; }
+    uint32_t elapsed(uint32_t now) const { return now - _since; }
+
+private:
+    const uint32_t _budgetMs;
+    const uint16_t _confident;
+    const uint8_t _maxCaptures;
+
+    bool _active = false;
+    uint32_t _since = 0;
+    uint8_t _captures = 0;
+    int _weakId = 0;
+    uint16_t _weakConf = 0;
+    bool _sawNoMatch = false;
+    int _id = 0;
+    uint16_t _confidence = 0;
+
+    Verdict finish(Verdict v, int id, uint16_t confidence) {
+        _active = false;
+        _id = id;
+        _confidence = confidence;
+        return v;
+    }
+
+    Verdict close() {
+        if (_weakId) return finish(ACCEPT, _weakId, _weakConf);
+        return finish(REJECT, _sawNoMatch ? 0 : -1, 0);
+    }
+};
@@ -0,0 +1,89 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/***
+ * Thống kê confidence theo từng ID vân tay và kết quả các phiên khớp
+ * (FingerSession), chỉ trong RAM, mất khi khởi động lại.
+ *
+ * ID có confidence trung bình thấp hoặc hay phải chụp lại là vân tay enroll
+ * kém, nên enroll lại. Tỉ lệ phiên phải chụp lại / bị từ chối và thời gian tới
+ * lúc chốt cho biết FINGER_CONFIDENT và FINGER_SESSION_MS có hợp lý không.
+ ***/
+class FingerStats {
+public:
+    static constexpr uint8_t MAX_ID = 127;
+
+    struct Entry {
+        uint16_t matches;
+        uint16_t retried;  // lần khớp cần hơn một ảnh
+        uint16_t minConf;
+        uint16_t maxConf;
+        uint32_t sumConf;
+    };
+
+    void recordAccept(uint8_t id, uint16_t confidence, uint8_t captures, uint32_t ms) {
+        _accepted++;
+        _sumMs += ms;
+        if (captures > 1) _acceptedRetry++;
+        if (id < 1 || id > MAX_ID) return;
+        Entry &e = _ids[id - 1];
+        if (e.matches == 0 || confidence < e.minConf) e.minConf = confidence;
+        if (confidence > e.maxConf) e.maxConf = confidence;
+        e.sumConf += confidence;
+        e.matches++;
+        if (captures > 1) e.retried++;
+    }
+
+    void recordReject(uint8_t captures) {
+        _rejected++;
+        if (captures > 1) _rejectedRetry++;
+    }
+
+    // Slot bị enroll lại hoặc xóa: số liệu cũ không còn của vân tay đó
+    void forget(uint8_t id) {
+        if (id >= 1 && id <= MAX_ID) _ids[id - 1] = {};
+    }
+    void clear() { *this = FingerStats(); }
+
+    const Entry &entry(uint8_t id) const { return _ids[id - 1]; }
+
+    // Các ID đã khớp, từ next trở đi, nhiều nhất vừa buf:
+    // {"ids":[[id,n,retried,avg,min,max],...]}. next tiến tới ID chưa ghi (MAX_ID + 1 khi hết).
+    // Trả số ID đã ghi; 0 thì buf không dùng được
+    uint8_t idsJson(uint8_t &next, char *buf, size_t len) const {
+        size_t used = snprintf(buf, len, "{\"ids\":[");
+        uint8_t count = 0;
+        for (; next <= MAX_ID; next++) {
+            const Entry &e = _ids[next - 1];
+            if (e.matches == 0) continue;
+            char item[48];
+            int n = snprintf(item, sizeof(item), "%s[%u,%u,%u,%lu,%u,%u]", count ? "," : "", next, e.matches,
+                             e.retried, (unsigned long)(e.sumConf / e.matches), e.minConf, e.maxConf);
+            if (used + n + 3 > len) break; // chừa "]}" + '\0'
+            memcpy(buf + used, item, n);
+            used += n;
+            count++;
+        }
+        snprintf(buf + used, len - used, "]}");
+        return count;
+    }
+
+    int summaryJson(char *buf, size_t len) const {
+        return snprintf(buf, len,
+                        "{\"sessions\":%lu,\"accepted\":%lu,\"accepted_retry\":%lu,\"rejected\":%lu,"
+                        "\"rejected_retry\":%lu,\"avg_accept_ms\":%lu}",
+                        (unsigned long)(_accepted + _rejected), (unsigned long)_accepted,
+                        (unsigned long)_acceptedRetry, (unsigned long)_rejected, (unsigned long)_rejectedRetry,
+                        (unsigned long)(_accepted ? _sumMs / _accepted : 0));
+    }
+
+private:
+    Entry _ids[MAX_ID] = {};
+    uint32_t _accepted = 0;
+    uint32_t _acceptedRetry = 0; // phiên chấp nhận sau khi chụp lại: trước đây là một lần báo sai
+    uint32_t _rejected = 0;
+    uint32_t _rejectedRetry = 0;
+    uint32_t _sumMs = 0;
+};
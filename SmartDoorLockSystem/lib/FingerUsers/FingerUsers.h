@@ -0,0 +1,78 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+/***
+ * Bảng mã người dùng -> dải slot vân tay, cho chế độ xác minh 1:1.
+ *
+ * Người dùng gõ mã ngắn (1-999) rồi '#', vân tay kế tiếp chỉ được so với
+ * các slot [first, first + count) của người đó thay vì cả thư viện: thời gian
+ * khớp không tăng theo số người đã enroll, và một ngón tay lạ chỉ có vài
+ * template để khớp nhầm thay vì toàn bộ. Không gõ mã thì vẫn tìm 1:N như cũ.
+ *
+ * Bảng cố định MAX_USERS mục, main.cpp lưu nguyên mảng vào flash (raw()).
+ ***/
+class FingerUsers {
+public:
+    static constexpr uint8_t MAX_USERS = 32;
+    static constexpr uint16_t MAX_CODE = 999;
+    static constexpr uint8_t MAX_SLOT = 127;
+
+    struct User {
+        uint16_t code; // 0 = mục trống
+        uint8_t first;
+        uint8_t count;
+    };
+
+    static bool valid(uint16_t code, uint8_t first, uint8_t count) {
+        return code >= 1 && code <= MAX_CODE && first >= 1 && count >= 1 && first + count - 1 <= MAX_SLOT;
+    }
+
+    const User *find(uint16_t code) const {
+        int8_t i = code ? indexOf(code) : -1;
+        return i < 0 ? nullptr : &_users[i];
+    }
+
+    // Thêm hoặc thay dải của code; false nếu sai tham số hoặc bảng đầy
+    bool set(uint16_t code, uint8_t first, uint8_t count) {
+        if (!valid(code, first, count)) return false;
+        int8_t i = indexOf(code);
+        if (i < 0) i = indexOf(0);
+        if (i < 0) return false;
+        _users[i] = {code, first, count};
+        return true;
+    }
+
+    bool remove(uint16_t code) {
+        int8_t i = code ? indexOf(code) : -1;
+        if (i < 0) return false;
+        _users[i] = {};
+        return true;
+    }
+
+    uint8_t count() const {
+        uint8_t n = 0;
+        for (const User &u : _users) n += u.code != 0;
+        return n;
+    }
+
+    // Lưu/nạp cả bảng; mục sai (flash cũ hỏng) bị bỏ
+    void *raw() { return _users; }
+    static constexpr size_t RAW_SIZE = sizeof(User) * MAX_USERS;
+    void sanitize() {
+        for (User &u : _users) {
+            if (u.code && !valid(u.code, u.first, u.count)) u = {};
+        }
+    }
+
+private:
+    User _users[MAX_USERS] = {};
+
+    // code = 0: mục trống đầu tiên
+    int8_t indexOf(uint16_t code) const {
+        for (uint8_t i = 0; i < MAX_USERS; i++) {
+            if (_users[i].code == code) return i;
+        }
+        return -1;
+    }
+};
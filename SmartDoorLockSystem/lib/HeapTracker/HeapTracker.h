@@ -0,0 +1,50 @@
+#pragma once
+#include <Arduino.h>
+
+/***
+ * Theo dõi heap và phân mảnh theo thời gian.
+ *
+ * Phân mảnh = 100 - khối trống lớn nhất * 100 / tổng heap trống. Heap trống
+ * còn nhiều nhưng khối lớn nhất nhỏ dần là dấu hiệu String/new rải rác; TLS
+ * cần một khối ~16 KB liền nên phân mảnh cao sẽ làm MQTT không kết nối lại được.
+ * sample() rẻ, gọi từ loop(); chỉ đọc lại heap mỗi intervalMs.
+ ***/
+class HeapTracker {
+public:
+    explicit HeapTracker(uint32_t intervalMs = 10000) : _intervalMs(intervalMs) {}
+
+    void sample() {
+        uint32_t now = millis();
+        if (_samples && now - _last < _intervalMs) return;
+        _last = now;
+        _samples++;
+        _free = ESP.getFreeHeap();
+        _largest = ESP.getMaxAllocHeap();
+        if (!_minLargest || _largest < _minLargest) _minLargest = _largest;
+        uint8_t frag = fragmentation();
+        if (frag > _worstFrag) _worstFrag = frag;
+    }
+
+    uint32_t freeBytes() const { return _free; }
+    uint32_t largestBlock() const { return _largest; }
+    uint32_t minFree() const { return ESP.getMinFreeHeap(); } // mốc thấp nhất từ lúc khởi động
+    uint32_t minLargestBlock() const { return _minLargest; }
+    uint8_t fragmentation() const { return _free ? 100 - (uint8_t)((uint64_t)_largest * 100 / _free) : 0; }
+    uint8_t worstFragmentation() const { return _worstFrag; }
+
+    int toJson(char *buf, size_t len) const {
+        return snprintf(buf, len,
+                        "{\"free\":%lu,\"min_free\":%lu,\"largest\":%lu,\"min_largest\":%lu,\"frag\":%u,\"worst_frag\":%u}",
+                        (unsigned long)_free, (unsigned long)minFree(), (unsigned long)_largest,
+                        (unsigned long)_minLargest, fragmentation(), _worstFrag);
+    }
+
+private:
+    const uint32_t _intervalMs;
+    uint32_t _last = 0;
+    uint32_t _samples = 0;
+    uint32_t _free = 0;
+    uint32_t _largest = 0;
+    uint32_t _minLargest = 0;
+    uint8_t _worstFrag = 0;
+};
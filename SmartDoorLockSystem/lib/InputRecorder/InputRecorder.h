@@ -0,0 +1,312 @@
+/***
+ * Ghi và phát lại (record/replay) toàn bộ input của khóa.
+ *
+ * Bật bằng build flag `-D INPUT_RECORDER`. Mỗi input (phím, kết quả AS608,
+ * payload MQTT, trạng thái WiFi) được ghi thành một bản ghi nhỏ:
+ *
+ *   [type:1][dt: varint ms từ bản ghi trước][data]
+ *     KEY     data = 1 byte ký tự, 'x' cho chữ số của PIN / mã một lần / mật khẩu mới
+ *     FINGER  data = 2 byte int16 (ID tìm thấy, 0 = không khớp, -1 = lỗi)
+ *     MQTT    data = 1 byte CommandClass được phép + 1 byte độ dài + payload (cắt ở 255 byte)
+ *     WIFI    data = 1 byte wl_status_t
+ *     VERDICT data = 1 byte kết quả kiểm tra PIN / mã một lần
+ *
+ * Log không chứa bí mật: chữ số bí mật chỉ còn lại sự kiện bấm phím ('x', phát
+ * lại thành '0') và kết quả kiểm tra được ghi riêng để lúc phát lại vẫn đi đúng
+ * nhánh. Payload MQTT do firmware lọc bằng redactSecrets() trước khi ghi, kèm
+ * quyền của topic đã nhận nó: lệnh bị từ chối trên topic nhóm/broadcast thì lúc
+ * phát lại cũng bị từ chối.
+ *
+ * Log được xuất dạng hex (lệnh `rec dump` trên Serial hoặc `dump_inputs` qua
+ * MQTT), nạp lại trên một board khác bằng `rec load`, dán các dòng hex, rồi `rec play`.
+ * Khi phát lại, input được trả về đúng mốc thời gian đã ghi; sự kiện nào tới
+ * trễ (vì firmware đang kẹt ở một vòng lặp chặn) được in ra kèm số ms trễ, nên
+ * các lần "đơ" ngoài thực tế tái hiện được và so sánh được giữa các bản build.
+ ***/
+
+#pragma once
+#include <Arduino.h>
+#include "BinLog.h"
+
+class InputRecorder
+{
+public:
+    enum Type : uint8_t
+    {
+        KEY = 1,
+        FINGER = 2,
+        MQTT = 3,
+        WIFI = 4,
+        VERDICT = 5,
+    };
+
+    static constexpr size_t CAPACITY = 4096;
+    static constexpr char REDACTED = 'x';
+
+    // ---------- Ghi ----------
+    // secret: phím thuộc PIN / mã một lần / mật khẩu mới, chữ số không được ghi
+    void recordKey(char key, bool secret)
+    {
+        uint8_t b = secret && key >= '0' && key <= '9' ? REDACTED : (uint8_t)key;
+        append(KEY, &b, 1);
+    }
+
+    // Kết quả kiểm tra PIN / mã một lần: ghi lại khi đang ghi, khi phát lại trả kết quả
+    // đã ghi (chữ số bí mật không có trong log nên không tính lại được). Không chờ mốc
+    // thời gian: kết quả luôn đi ngay sau phím cuối
+    uint8_t verdict(uint8_t live)
+    {
+        if (!_playing)
+        {
+            append(VERDICT, &live, 1);
+            return live;
+        }
+        const uint8_t *d = take(VERDICT, false);
+        return d ? d[0] : live;
+    }
+
+    void recordFinger(int16_t result)
+    {
+        uint8_t b[2] = {(uint8_t)(result & 0xFF), (uint8_t)((result >> 8) & 0xFF)};
+        append(FINGER, b, 2);
+    }
+
+    // allow: mặt nạ CommandClass của topic đã nhận payload
+    void recordMqtt(uint8_t allow, const uint8_t *payload, unsigned int length)
+    {
+        uint8_t len = length > 255 ? 255 : length;
+        if (!reserve(2 + len)) return;
+        header(MQTT);
+        _buf[_len++] = allow;
+        _buf[_len++] = len;
+        memcpy(_buf + _len, payload, len);
+        _len += len;
+    }
+
+    void recordWifi(uint8_t status)
+    {
+        append(WIFI, &status, 1);
+    }
+
+    void clear()
+    {
+        _len = 0;
+        _full = false;
+        _lastMs = millis();
+        _playing = false;
+    }
+
+    size_t size() const { return _len; }
+    bool full() const { return _full; }
+    const uint8_t *data() const { return _buf; }
+
+    // In log dạng hex, 32 byte mỗi dòng
+    void dump(Print &out) const
+    {
+        for (size_t i = 0; i < _len; i++)
+        {
+            out.printf("%02X", _buf[i]);
+            if ((i & 31) == 31) out.println();
+        }
+        out.println();
+    }
+
+    // Nối thêm một đoạn hex vào log (gọi clear() trước khi nạp log mới).
+    // Trả về false nếu hex lỗi hoặc vượt dung lượng
+    bool appendHex(const char *hex)
+    {
+        int hi = -1;
+        for (; *hex; hex++)
+        {
+            int v = hexValue(*hex);
+            if (v < 0)
+            {
+                if (*hex == ' ' || *hex == '\r' || *hex == '\n') continue;
+                return false;
+            }
+            if (hi < 0) { hi = v; continue; }
+            if (_len >= CAPACITY) return false;
+            _buf[_len++] = (hi << 4) | v;
+            hi = -1;
+        }
+        return hi < 0;
+    }
+
+    // ---------- Phát lại ----------
+    // Mỗi loại input có con trỏ riêng, nên firmware đọc phím trong một vòng
+    // lặp chặn vẫn nhận đúng phím dù payload MQTT trước đó chưa được xử lý
+    void startReplay()
+    {
+        _replayStart = millis();
+        _playing = _len > 0;
+        for (uint8_t t = KEY; t < TYPE_COUNT; t++)
+        {
+            _cur[t] = Cursor();
+            seek((Type)t);
+        }
+    }
+
+    bool replaying() const { return _playing; }
+
+    // Lấy phím kế tiếp nếu đã tới hạn, '\0' nếu chưa
+    char nextKey()
+    {
+        const uint8_t *d = take(KEY);
+        if (!d) return '\0';
+        return d[0] == REDACTED ? '0' : (char)d[0];
+    }
+
+    // Lấy kết quả vân tay kế tiếp nếu đã tới hạn (vân tay được quét song song với bàn phím)
+    bool nextFinger(int16_t &result)
+    {
+        const uint8_t *d = take(FINGER);
+        if (d) result = (int16_t)(d[0] | (d[1] << 8));
+        return d != nullptr;
+    }
+
+    // Lấy payload MQTT kế tiếp và quyền đã ghi nếu đã tới hạn; trả về độ dài, -1 nếu chưa
+    int nextMqtt(uint8_t &allow, uint8_t *out, size_t cap)
+    {
+        const uint8_t *d = take(MQTT);
+        if (!d) return -1;
+        allow = d[0];
+        size_t n = d[1] < cap ? d[1] : cap;
+        memcpy(out, d + 2, n);
+        return n;
+    }
+
+    // Trạng thái WiFi đã ghi (chỉ để in timeline khi phát lại)
+    bool nextWifi(uint8_t &status)
+    {
+        const uint8_t *d = take(WIFI);
+        if (d) status = d[0];
+        return d != nullptr;
+    }
+
+private:
+    uint8_t _buf[CAPACITY];
+    size_t _len = 0;
+    bool _full = false;
+    unsigned long _lastMs = 0;
+
+    static constexpr uint8_t TYPE_COUNT = VERDICT + 1;
+
+    struct Cursor
+    {
+        size_t pos = 0;     // bản ghi kế tiếp của loại này (== _len nếu hết)
+        uint32_t atMs = 0;  // mốc thời gian của bản ghi đó
+        size_t scan = 0;    // vị trí đã quét tới
+        uint32_t scanMs = 0;
+    };
+
+    Cursor _cur[TYPE_COUNT];
+    bool _playing = false;
+    unsigned long _replayStart = 0;
+
+    bool reserve(size_t dataLen)
+    {
+        if (_full || _playing) return false;
+        if (_len + 1 + 5 + dataLen > CAPACITY)
+        {
+            _full = true;
+            return false;
+        }
+        return true;
+    }
+
+    void header(Type t)
+    {
+        unsigned long now = millis();
+        uint32_t dt = now - _lastMs;
+        _lastMs = now;
+        _buf[_len++] = t;
+        do
+        {
+            uint8_t b = dt & 0x7F;
+            dt >>= 7;
+            _buf[_len++] = b | (dt ? 0x80 : 0);
+        } while (dt);
+    }
+
+    void append(Type t, const uint8_t *data, size_t n)
+    {
+        if (!reserve(n)) return;
+        header(t);
+        memcpy(_buf + _len, data, n);
+        _len += n;
+    }
+
+    static size_t dataLen(const uint8_t *rec, Type t)
+    {
+        switch (t)
+        {
+        case FINGER: return 2;
+        case MQTT: return 2 + rec[1];
+        default: return 1;
+        }
+    }
+
+    // Quét tới bản ghi kế tiếp cùng loại t, bắt đầu từ cursor.scan
+    void seek(Type t)
+    {
+        Cursor &c = _cur[t];
+        while (c.scan < _len)
+        {
+            size_t at = c.scan;
+            Type type = (Type)_buf[at++];
+            uint32_t dt = 0;
+            uint8_t shift = 0;
+            while (at < _len)
+            {
+                uint8_t b = _buf[at++];
+                dt |= (uint32_t)(b & 0x7F) << shift;
+                shift += 7;
+                if (!(b & 0x80)) break;
+            }
+            c.scanMs += dt;
+            c.scan = at + dataLen(_buf + at, type);
+            if (type == t)
+            {
+                c.pos = at; // trỏ vào phần data
+                c.atMs = c.scanMs;
+                return;
+            }
+        }
+        c.pos = _len;
+    }
+
+    // Trả về data của bản ghi loại t nếu đã tới hạn (hoặc bản ghi kế tiếp bất kể mốc
+    // nếu due = false), rồi chuyển sang bản ghi kế
+    const uint8_t *take(Type t, bool due = true)
+    {
+        if (!_playing) return nullptr;
+        Cursor &c = _cur[t];
+        if (c.pos >= _len) return nullptr;
+        unsigned long elapsed = millis() - _replayStart;
+        if (due && elapsed < c.atMs) return nullptr;
+
+        unsigned long late = elapsed > c.atMs ? elapsed - c.atMs : 0;
+        if (late > 50) BLOG(REPLAY_LATE, t, c.atMs, late);
+
+        const uint8_t *d = _buf + c.pos;
+        seek(t);
+        checkDone();
+        return d;
+    }
+
+    void checkDone()
+    {
+        for (uint8_t t = KEY; t < TYPE_COUNT; t++)
+            if (_cur[t].pos < _len) return;
+        _playing = false;
+        BLOG(REPLAY_DONE, millis() - _replayStart);
+    }
+
+    static int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    }
+};
@@ -1,49 +1,54 @@
 #pragma once
 #include <Arduino.h>
+#include "FastGpio.h"
 
+/***
+ * Bàn phím ma trận 4x3, chân cố định lúc biên dịch:
+ *   Keypad3x4<PinSet<ROW0_PIN, ...>, PinSet<COL0_PIN, ...>> keypad;
+ *
+ * Mỗi row kéo xuống bằng một lần ghi W1TC, cả 3 col đọc bằng một lần đọc
+ * GPIO_IN (FastGpio.h), nên quét đủ ma trận chỉ vài chục lệnh. Row nằm ở hai
+ * bank (GPIO 25/26 và 32/33) vẫn đúng, mặt nạ từng bank được tính sẵn.
+ ***/
+template <typename Rows, typename Cols>
 class Keypad3x4 {
 public:
-    // Constructor: mảng các chân Rows và Cols
-    Keypad3x4(uint8_t rowPins[4], uint8_t colPins[3]) {
-        for (uint8_t i = 0; i < 4; i++) _rowPins[i] = rowPins[i];
-        for (uint8_t i = 0; i < 3; i++) _colPins[i] = colPins[i];
-
-        _keys[0][0] = '1'; _keys[0][1] = '2'; _keys[0][2] = '3';
-        _keys[1][0] = '4'; _keys[1][1] = '5'; _keys[1][2] = '6';
-        _keys[2][0] = '7'; _keys[2][1] = '8'; _keys[2][2] = '9';
-        _keys[3][0] = '*'; _keys[3][1] = '0'; _keys[3][2] = '#';
-    }
+    static_assert(Rows::COUNT == 4 && Cols::COUNT == 3, "Keypad3x4 cần 4 row và 3 col");
 
     void begin() {
         // Rows là output, Cols là input pullup
-        for (uint8_t i = 0; i < 4; i++) pinMode(_rowPins[i], OUTPUT);
-        for (uint8_t i = 0; i < 3; i++) pinMode(_colPins[i], INPUT_PULLUP);
+        for (uint8_t i = 0; i < 4; i++) pinMode(Rows::PINS[i], OUTPUT);
+        for (uint8_t i = 0; i < 3; i++) pinMode(Cols::PINS[i], INPUT_PULLUP);
 
         // Tất cả row HIGH
-        for (uint8_t i = 0; i < 4; i++) digitalWrite(_rowPins[i], HIGH);
+        Rows::setAll();
     }
 
     // Trả về ký tự phím bấm, '\0' nếu không có phím
     char getKey() {
         for (uint8_t r = 0; r < 4; r++) {
             // Kéo row hiện tại xuống LOW
-            digitalWrite(_rowPins[r], LOW);
-            for (uint8_t c = 0; c < 3; c++) {
-                if (digitalRead(_colPins[c]) == LOW) {
-                    // Đợi thả phím
-                    while (digitalRead(_colPins[c]) == LOW);
-                    digitalWrite(_rowPins[r], HIGH);
-                    return _keys[r][c];
-                }
+            Rows::clear(r);
+            Cols::read(); // chờ mức trên col ổn định qua bộ đồng bộ input
+            uint32_t pressed = ~Cols::read() & 0x7;
+            if (pressed) {
+                uint8_t c = __builtin_ctz(pressed);
+                // Đợi thả phím
+                while (!(Cols::read() & (1u << c)));
+                Rows::set(r);
+                return KEYS[r][c];
             }
-            digitalWrite(_rowPins[r], HIGH);
+            Rows::set(r);
         }
         delay(20);
         return '\0'; // Không có phím
     }
 
 private:
-    uint8_t _rowPins[4];
-    uint8_t _colPins[3];
-    char _keys[4][3];
+    static constexpr char KEYS[4][3] = {
+        {'1', '2', '3'},
+        {'4', '5', '6'},
+        {'7', '8', '9'},
+        {'*', '0', '#'},
+    };
 };
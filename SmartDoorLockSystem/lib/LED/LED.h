@@ -1,49 +1,124 @@
 #pragma once
 #include <Arduino.h>
+#include <driver/ledc.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+
+/***
+ * LED chạy trên LEDC low-speed, clock RTC8M.
+ *
+ * Sáng/tắt/fade do phần cứng LEDC giữ nên không cần gọi gì trong main loop;
+ * mẫu nhiều bước (blink, breathe, pattern) được chuyển bước bởi esp_timer.
+ * Với clock RTC8M, LEDC vẫn chạy trong light sleep: mức sáng và fade đang
+ * chạy giữ nguyên, bước kế tiếp của mẫu chạy ngay khi CPU thức.
+ *
+ * Mỗi LED dùng một kênh LEDC low-speed riêng (0–7), chung timer LEDC_TIMER_3
+ * để không đụng các timer high-speed mà servo/còi dùng qua ledcSetup().
+ *
+ * Như BuzzerSequencer: on/off/blink/play chỉ đổi mẫu (dưới _mux) rồi hẹn timer
+ * chạy ngay; mọi lần ghi LEDC, kể cả bước đầu, chạy trong task esp_timer. Một
+ * bước đang chạy dở vì thế không ghi đè được off() gọi sau nó.
+ ***/
+
+struct LEDStep
+{
+    uint8_t level;   // 0–255
+    uint16_t fadeMs; // thời gian fade tới level, 0 = đổi ngay
+    uint16_t holdMs; // giữ ở level trước khi sang bước sau
+};
 
 class LED
 {
 public:
-    LED(const byte pin, const bool active);
+    LED(const byte pin, const bool active, const uint8_t channel);
+    void begin();
     void on();
     void off();
     void flip();
     void blink(int duration);
-    void loop();
+    void breathe(uint16_t periodMs);
+    void play(const LEDStep *steps, uint8_t count, bool repeat = true);
 
 private:
+    static constexpr ledc_mode_t MODE = LEDC_LOW_SPEED_MODE;
+    static constexpr ledc_timer_t TIMER = LEDC_TIMER_3;
+
     const byte _pin;
     const bool _active; // LOW/HIGH
+    const ledc_channel_t _channel;
+    esp_timer_handle_t _timer = nullptr;
 
-    unsigned long _timer = 0;   // ms
-    unsigned int _duration = 0; // ms
+    portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+    LEDStep _ownSteps[2]; // bước của on/off/blink/breathe
+    const LEDStep *_steps = nullptr;
+    uint8_t _count = 0;
+    uint8_t _index = 0;
+    bool _repeat = false;
 
     enum States
     {
         OFF,
         ON,
-        BLINK,
+        PATTERN,
     } state = OFF;
+
+    uint32_t duty(uint8_t level) const { return _active ? level : 255 - level; }
+    void set(uint8_t level);
+    void start(const LEDStep *steps, uint8_t count, bool repeat, bool copy);
+    void runStep();
+    static void onTimer(void *arg);
 };
 
 /*** Implementation: ***/
 
-LED::LED(const byte pin, const bool active) : _pin(pin), _active(active)
+LED::LED(const byte pin, const bool active, const uint8_t channel)
+    : _pin(pin), _active(active), _channel((ledc_channel_t)channel)
 {
-    pinMode(_pin, OUTPUT);
-    off();
+}
+
+void LED::begin()
+{
+    static bool timerReady = false;
+    if (!timerReady)
+    {
+        ledc_timer_config_t t = {};
+        t.speed_mode = MODE;
+        t.duty_resolution = LEDC_TIMER_8_BIT;
+        t.timer_num = TIMER;
+        t.freq_hz = 1000;
+        t.clk_cfg = LEDC_USE_RTC8M_CLK;
+        ledc_timer_config(&t);
+        ledc_fade_func_install(0);
+        esp_sleep_pd_config(ESP_PD_DOMAIN_RTC8M, ESP_PD_OPTION_ON);
+        timerReady = true;
+    }
+
+    ledc_channel_config_t c = {};
+    c.gpio_num = _pin;
+    c.speed_mode = MODE;
+    c.channel = _channel;
+    c.intr_type = LEDC_INTR_DISABLE;
+    c.timer_sel = TIMER;
+    c.duty = duty(0);
+    ledc_channel_config(&c);
+
+    esp_timer_create_args_t args = {};
+    args.callback = &LED::onTimer;
+    args.arg = this;
+    args.name = "led";
+    esp_timer_create(&args, &_timer);
 }
 
 void LED::on()
 {
-    digitalWrite(_pin, _active);
-    state = ON;
+    const LEDStep step = {255, 0, 0};
+    start(&step, 1, false, true);
 }
 
 void LED::off()
 {
-    digitalWrite(_pin, !_active);
-    state = OFF;
+    const LEDStep step = {0, 0, 0};
+    start(&step, 1, false, true);
 }
 
 void LED::flip()
@@ -56,24 +131,101 @@ void LED::flip()
 
 void LED::blink(int duration)
 {
-    _duration = duration;
-    state = BLINK;
+    const LEDStep steps[2] = {{255, 0, (uint16_t)duration}, {0, 0, (uint16_t)duration}};
+    start(steps, 2, true, true);
+}
+
+void LED::breathe(uint16_t periodMs)
+{
+    const LEDStep steps[2] = {{255, (uint16_t)(periodMs / 2), 0}, {0, (uint16_t)(periodMs / 2), 0}};
+    start(steps, 2, true, true);
+}
+
+void LED::play(const LEDStep *steps, uint8_t count, bool repeat)
+{
+    start(steps, count, repeat, false);
+}
+
+void LED::set(uint8_t level)
+{
+    ledc_set_duty(MODE, _channel, duty(level));
+    ledc_update_duty(MODE, _channel);
 }
 
-void LED::loop()
+// Thay mẫu đang chạy; count = 0 chỉ dừng mẫu, giữ mức sáng hiện tại.
+// copy = true: chép bước (tối đa 2) vào _ownSteps vì steps của người gọi là biến tạm
+void LED::start(const LEDStep *steps, uint8_t count, bool repeat, bool copy)
 {
-    switch (state)
+    portENTER_CRITICAL(&_mux);
+    if (copy)
     {
-    case OFF:
-    case ON:
-        break;
+        memcpy(_ownSteps, steps, count * sizeof(LEDStep));
+        steps = _ownSteps;
+    }
+    _steps = count ? steps : nullptr;
+    _count = count;
+    _repeat = repeat;
+    _index = 0;
+    if (count == 1 && !repeat)
+        state = steps[0].level ? ON : OFF;
+    else if (count)
+        state = PATTERN;
+    portEXIT_CRITICAL(&_mux);
 
-    case BLINK:
-        if ((millis() - _timer) > _duration)
+    if (!_timer) // trước begin(): chưa có task esp_timer, chạy luôn
+    {
+        runStep();
+        return;
+    }
+    // Callback đang chạy có thể hẹn lại timer ngay sau stop đầu: khi đó stop và hẹn lại
+    esp_timer_stop(_timer);
+    if (esp_timer_start_once(_timer, 0) != ESP_OK)
+    {
+        esp_timer_stop(_timer);
+        esp_timer_start_once(_timer, 0);
+    }
+}
+
+void LED::runStep()
+{
+    portENTER_CRITICAL(&_mux);
+    if (!_steps)
+    {
+        portEXIT_CRITICAL(&_mux);
+        return;
+    }
+    const LEDStep s = _steps[_index];
+    bool again = true;
+    _index++;
+    if (_index >= _count)
+    {
+        if (_repeat)
         {
-            digitalWrite(_pin, !digitalRead(_pin));
-            _timer = millis();
+            _index = 0;
         }
-        break;
+        else
+        {
+            _steps = nullptr;
+            state = s.level ? ON : OFF;
+            again = false;
+        }
+    }
+    portEXIT_CRITICAL(&_mux);
+
+    if (s.fadeMs)
+    {
+        ledc_set_fade_with_time(MODE, _channel, duty(s.level), s.fadeMs);
+        ledc_fade_start(MODE, _channel, LEDC_FADE_NO_WAIT);
     }
+    else
+    {
+        set(s.level);
+    }
+    if (again)
+        esp_timer_start_once(_timer, (uint64_t)(s.fadeMs + s.holdMs) * 1000);
+}
+
+void LED::onTimer(void *arg)
+{
+    static_cast<LED *>(arg)->runStep();
 }
@@ -0,0 +1,238 @@
+/***
+ * HTTP/WebSocket tối thiểu cho server điều khiển trong LAN (LanServer.h).
+ *
+ * Chỉ phụ thuộc thư viện C chuẩn và mbedtls (SHA1, base64 cho bắt tay
+ * WebSocket) nên biên dịch được trên PC cùng client thử tools/lan_client.py.
+ * Không phải HTTP đầy đủ: mỗi kết nối một request, header tối đa HEAD_MAX
+ * byte, body và frame tối đa MSG_MAX byte, frame client không phân mảnh.
+ ***/
+
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <mbedtls/base64.h>
+#include <mbedtls/sha1.h>
+
+namespace LanProtocol
+{
+    constexpr size_t MSG_MAX = 512;  // như buffer MQTT
+    constexpr size_t HEAD_MAX = 512;
+    constexpr size_t TOKEN_MIN = 16;
+    constexpr size_t TOKEN_LEN = 65; // tối đa 64 ký tự + '\0'
+    constexpr size_t WS_KEY_LEN = 32;
+    constexpr size_t WS_ACCEPT_LEN = 29; // base64 của 20 byte SHA1 + '\0'
+
+    constexpr const char *PATH_COMMAND = "/command"; // POST, body = lệnh như trên topic command
+    constexpr const char *PATH_EVENTS = "/events";   // GET + Upgrade: websocket
+    constexpr const char *TOPIC_REPLY = "reply";     // frame WS trả lời lệnh: "reply\n<ok|fail|dup>\n<sự kiện>"
+
+    // Token: [A-Za-z0-9_-], TOKEN_MIN..64 ký tự, như request ID để đặt được qua lệnh văn bản
+    inline bool validToken(const char *token)
+    {
+        size_t n = strlen(token);
+        if (n < TOKEN_MIN || n >= TOKEN_LEN) return false;
+        for (size_t i = 0; i < n; i++)
+        {
+            char c = token[i];
+            if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-'))
+                return false;
+        }
+        return true;
+    }
+
+    // So hết chuỗi dù sai từ ký tự đầu, thời gian trả lời không lộ độ dài phần đúng
+    inline bool tokenEquals(const char *a, const char *b)
+    {
+        size_t na = strlen(a), nb = strlen(b);
+        uint8_t diff = na != nb || nb == 0;
+        for (size_t i = 0; i < na && i < nb; i++) diff |= a[i] ^ b[i];
+        return diff == 0;
+    }
+
+    // ---------- HTTP ----------
+    struct HttpHead
+    {
+        char method[8];
+        char path[24];
+        char token[TOKEN_LEN];  // "Authorization: Bearer <token>" hoặc ?token=<token>
+        char wsKey[WS_KEY_LEN]; // Sec-WebSocket-Key, rỗng nếu không phải upgrade
+        size_t contentLength;
+        size_t headLen;         // tính cả "\r\n\r\n"
+    };
+
+    enum ParseResult : uint8_t
+    {
+        PARSE_MORE, // chưa đủ header
+        PARSE_OK,
+        PARSE_BAD,
+    };
+
+    inline void copyField(char *dst, size_t len, const char *src, size_t n)
+    {
+        if (n >= len) n = len - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+
+    // Phân tích header trong buf[0..len), buf không cần kết thúc bằng '\0'
+    inline ParseResult parseHead(const char *buf, size_t len, HttpHead &h)
+    {
+        size_t end = 0;
+        while (end + 4 <= len && memcmp(buf + end, "\r\n\r\n", 4) != 0) end++;
+        if (end + 4 > len) return len >= HEAD_MAX ? PARSE_BAD : PARSE_MORE;
+        if (end + 4 > HEAD_MAX) return PARSE_BAD;
+
+        memset(&h, 0, sizeof(h));
+        h.headLen = end + 4;
+        char head[HEAD_MAX + 1];
+        memcpy(head, buf, end + 2); // giữ "\r\n" của dòng cuối
+        head[end + 2] = '\0';
+
+        // Dòng đầu: <method> <path>[?token=...] HTTP/1.x
+        char *line = head;
+        char *eol = strstr(line, "\r\n");
+        *eol = '\0';
+        char *sp1 = strchr(line, ' ');
+        char *sp2 = sp1 ? strchr(sp1 + 1, ' ') : nullptr;
+        if (!sp2 || strncmp(sp2 + 1, "HTTP/1.", 7) != 0) return PARSE_BAD;
+        copyField(h.method, sizeof(h.method), line, sp1 - line);
+        char *target = sp1 + 1;
+        *sp2 = '\0';
+        char *query = strchr(target, '?');
+        if (query) *query++ = '\0';
+        copyField(h.path, sizeof(h.path), target, strlen(target));
+        for (char *p = query; p && *p; p = strchr(p, '&') ? strchr(p, '&') + 1 : nullptr)
+        {
+            if (strncmp(p, "token=", 6) == 0) copyField(h.token, sizeof(h.token), p + 6, strcspn(p + 6, "&"));
+        }
+
+        // Header: chỉ đọc vài trường cần, tên không phân biệt hoa thường
+        for (line = eol + 2; *line; line = eol + 2)
+        {
+            eol = strstr(line, "\r\n");
+            *eol = '\0';
+            char *colon = strchr(line, ':');
+            if (!colon) return PARSE_BAD;
+            char *value = colon + 1;
+            while (*value == ' ') value++;
+            size_t name = colon - line;
+            if (name == 13 && strncasecmp(line, "Authorization", 13) == 0 && strncasecmp(value, "Bearer ", 7) == 0)
+                copyField(h.token, sizeof(h.token), value + 7, strcspn(value + 7, " "));
+            else if (name == 17 && strncasecmp(line, "Sec-WebSocket-Key", 17) == 0)
+                copyField(h.wsKey, sizeof(h.wsKey), value, strcspn(value, " "));
+            else if (name == 14 && strncasecmp(line, "Content-Length", 14) == 0)
+            {
+                char *endp;
+                unsigned long n = strtoul(value, &endp, 10);
+                if (endp == value) return PARSE_BAD;
+                h.contentLength = n;
+            }
+        }
+        return PARSE_OK;
+    }
+
+    inline const char *statusText(uint16_t code)
+    {
+        switch (code)
+        {
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 404: return "Not Found";
+        case 413: return "Payload Too Large";
+        case 429: return "Too Many Requests";
+        case 503: return "Service Unavailable";
+        default: return "Error";
+        }
+    }
+
+    // Response đóng kết nối, body text
+    inline int formatResponse(char *buf, size_t len, uint16_t code, const char *body)
+    {
+        return snprintf(buf, len,
+                        "HTTP/1.1 %u %s\r\nContent-Type: text/plain\r\nContent-Length: %u\r\nConnection: close\r\n\r\n%s",
+                        code, statusText(code), (unsigned)strlen(body), body);
+    }
+
+    // ---------- WebSocket (RFC 6455) ----------
+    // Sec-WebSocket-Accept = base64(SHA1(key + GUID))
+    inline bool wsAccept(const char *key, char *out, size_t len)
+    {
+        static const char GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+        char joined[WS_KEY_LEN + sizeof(GUID)];
+        if (!key[0] || snprintf(joined, sizeof(joined), "%s%s", key, GUID) >= (int)sizeof(joined)) return false;
+        uint8_t digest[20];
+        mbedtls_sha1((const uint8_t *)joined, strlen(joined), digest); // mbedtls 2.x trả void, 3.x trả int
+        size_t olen;
+        return mbedtls_base64_encode((uint8_t *)out, len, &olen, digest, sizeof(digest)) == 0;
+    }
+
+    inline int formatUpgrade(char *buf, size_t len, const char *accept)
+    {
+        return snprintf(buf, len,
+                        "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                        "Sec-WebSocket-Accept: %s\r\n\r\n",
+                        accept);
+    }
+
+    enum WsOpcode : uint8_t
+    {
+        WS_TEXT = 0x1,
+        WS_BINARY = 0x2,
+        WS_CLOSE = 0x8,
+        WS_PING = 0x9,
+        WS_PONG = 0xA,
+    };
+
+    struct WsFrame
+    {
+        uint8_t opcode;
+        uint8_t *payload; // trỏ vào buf, đã bỏ mask
+        size_t len;
+    };
+
+    // Giải một frame client (bắt buộc có mask) ở đầu buf, bỏ mask tại chỗ.
+    // Trả số byte của frame, 0 nếu chưa đủ, -1 nếu frame sai, phân mảnh hoặc quá MSG_MAX
+    inline int wsDecode(uint8_t *buf, size_t len, WsFrame &f)
+    {
+        if (len < 2) return 0;
+        bool fin = buf[0] & 0x80;
+        f.opcode = buf[0] & 0x0F;
+        if (!fin || f.opcode == 0 || !(buf[1] & 0x80)) return -1;
+        size_t n = buf[1] & 0x7F;
+        size_t off = 2;
+        if (n == 127) return -1;
+        if (n == 126)
+        {
+            if (len < 4) return 0;
+            n = (size_t)buf[2] << 8 | buf[3];
+            off = 4;
+        }
+        if (n > MSG_MAX) return -1;
+        if (len < off + 4 + n) return 0;
+        const uint8_t *mask = buf + off;
+        f.payload = buf + off + 4;
+        f.len = n;
+        for (size_t i = 0; i < n; i++) f.payload[i] ^= mask[i & 3];
+        return off + 4 + n;
+    }
+
+    // Header frame server (không mask), trả độ dài header: 2 hoặc 4 byte
+    inline size_t wsHeader(uint8_t *out, uint8_t opcode, size_t len)
+    {
+        out[0] = 0x80 | opcode;
+        if (len < 126)
+        {
+            out[1] = len;
+            return 2;
+        }
+        out[1] = 126;
+        out[2] = len >> 8;
+        out[3] = len & 0xFF;
+        return 4;
+    }
+}
@@ -0,0 +1,300 @@
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+#include <errno.h>
+#include <lwip/sockets.h>
+#include "LanProtocol.h"
+#include "TokenBucket.h"
+
+/***
+ * Server điều khiển trong LAN, chạy song song với MQTT: cùng bộ lệnh với topic
+ * command, cùng sự kiện, không vòng qua broker nên mở khóa chỉ tốn một lượt
+ * TCP trong mạng nội bộ, và vẫn dùng được khi mất kết nối broker.
+ *
+ *   POST /command   Authorization: Bearer <token>, body = lệnh (có thể có header
+ *                   "req" hoặc là lô lệnh) -> 200, body "<ok|fail|dup>\n<sự kiện>"
+ *   GET  /events    Upgrade: websocket, token trong header hoặc ?token=<token>.
+ *                   Khóa đẩy mọi sự kiện dạng "<topic>\n<payload>"; frame text gửi
+ *                   lên là lệnh, trả lời "reply\n<ok|fail|dup>\n<sự kiện>"
+ *
+ * poll() gọi mỗi vòng loop(): nhận kết nối, đọc phần dữ liệu đã đến rồi trả về,
+ * không chờ socket. Lệnh đủ thì nằm nguyên trong bộ đệm của client tới khi
+ * main.cpp chạy xong và gọi reply(), nên mỗi client có nhiều nhất một lệnh chờ
+ * và loop() nhận mỗi vòng một lệnh, lần lượt theo vòng tròn giữa các client.
+ *
+ * Sự kiện đẩy cho client WS không chờ socket: buffer gửi của client (không đọc
+ * kịp, WiFi yếu) không còn chỗ cho cả frame thì frame đó bị bỏ và đếm vào
+ * droppedFrames(), loop() không bao giờ bị một client chậm giữ lại.
+ *
+ * Chưa đặt token thì mọi request bị từ chối. Token sai bị giới hạn bởi
+ * authBucket (5 lần, rồi 1 lần / 10 s) cho cả server.
+ ***/
+class LanServer {
+public:
+    static constexpr uint8_t MAX_CLIENTS = 4;
+    static constexpr uint32_t HTTP_TIMEOUT_MS = 5000; // request phải đến đủ trong thời gian này
+    static constexpr uint32_t WS_IDLE_MS = 90000;     // client WS phải gửi gì đó (ping) trước hạn
+
+    struct Command {
+        uint8_t slot;
+        char *text; // kết thúc '\0', đã bỏ khoảng trắng cuối; hợp lệ tới reply()
+    };
+
+    explicit LanServer(uint16_t port) : _server(port) {}
+
+    void begin() {
+        _server.begin();
+        _server.setNoDelay(true);
+    }
+
+    // Token rỗng: tắt truy cập
+    void setToken(const char *token) { strlcpy(_token, token, sizeof(_token)); }
+
+    // Trả true khi có một lệnh cần chạy; kết quả phải trả bằng reply(cmd.slot, ...)
+    bool poll(Command &cmd, uint32_t now) {
+        accept(now);
+        for (uint8_t n = 0; n < MAX_CLIENTS; n++) {
+            uint8_t i = _next;
+            _next = (_next + 1) % MAX_CLIENTS;
+            Slot &s = _slots[i];
+            if (s.state == FREE || s.busy) continue;
+            if (!receive(s, now)) continue;
+            bool ready = s.state == HTTP ? handleHttp(s, now) : handleWs(s);
+            if (ready) {
+                cmd = {i, (char *)s.command};
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Kết quả lệnh của client slot: HTTP trả response rồi đóng, WS gửi frame reply
+    void reply(uint8_t slot, const char *status, const char *event) {
+        if (slot >= MAX_CLIENTS) return;
+        Slot &s = _slots[slot];
+        if (!s.busy) return;
+        s.busy = false;
+        char body[LanProtocol::MSG_MAX];
+        if (s.state == HTTP) {
+            snprintf(body, sizeof(body), "%s\n%s", status, event);
+            respond(s, 200, body);
+            return;
+        }
+        snprintf(body, sizeof(body), "%s\n%s\n%s", LanProtocol::TOPIC_REPLY, status, event);
+        sendFrame(s, LanProtocol::WS_TEXT, (const uint8_t *)body, strlen(body));
+        s.command[s.commandLen] = s.saved; // trả lại byte đầu frame sau, đã bị đè bằng '\0'
+        consume(s, s.frameLen);
+    }
+
+    // Sự kiện cho mọi client WS, một frame "<topic>\n<payload>"; client không còn chỗ thì bỏ frame
+    void broadcast(const char *topic, const char *payload) {
+        char text[LanProtocol::MSG_MAX];
+        int n = snprintf(text, sizeof(text), "%s\n%s", topic, payload);
+        if (n < 0) return;
+        size_t len = (size_t)n < sizeof(text) ? n : sizeof(text) - 1;
+        for (Slot &s : _slots) {
+            if (s.state == WS) offerFrame(s, LanProtocol::WS_TEXT, (const uint8_t *)text, len);
+        }
+    }
+
+    uint8_t eventClients() const {
+        uint8_t n = 0;
+        for (const Slot &s : _slots) n += s.state == WS;
+        return n;
+    }
+    uint32_t authFailures() const { return _authBucket.accepted() + _authBucket.shed(); }
+    uint32_t droppedFrames() const { return _dropped; }
+
+private:
+    enum State : uint8_t { FREE, HTTP, WS };
+
+    struct Slot {
+        WiFiClient client;
+        State state = FREE;
+        bool busy = false;     // lệnh đang chờ reply()
+        uint32_t since = 0;    // lúc kết nối (HTTP) hoặc lần nhận cuối (WS)
+        size_t len = 0;
+        uint8_t *command = nullptr;
+        size_t commandLen = 0;
+        size_t frameLen = 0;   // WS: độ dài frame chứa lệnh đang chờ
+        uint8_t saved = 0;
+        uint8_t buf[LanProtocol::HEAD_MAX + LanProtocol::MSG_MAX + 1];
+    };
+
+    WiFiServer _server;
+    Slot _slots[MAX_CLIENTS];
+    uint8_t _next = 0;
+    char _token[LanProtocol::TOKEN_LEN] = "";
+    TokenBucket _authBucket{5, 10000};
+    uint32_t _dropped = 0;
+
+    void accept(uint32_t now) {
+        WiFiClient client = _server.available();
+        if (!client) return;
+        for (Slot &s : _slots) {
+            if (s.state != FREE) continue;
+            s.client = client;
+            s.client.setNoDelay(true);
+            s.state = HTTP;
+            s.busy = false;
+            s.since = now;
+            s.len = 0;
+            return;
+        }
+        char out[160];
+        int n = LanProtocol::formatResponse(out, sizeof(out), 503, "busy");
+        client.write((const uint8_t *)out, n);
+        client.stop();
+    }
+
+    void close(Slot &s) {
+        s.client.stop();
+        s.state = FREE;
+        s.busy = false;
+        s.len = 0;
+    }
+
+    // Đọc phần đã đến; false nếu không có gì mới để xử lý (hoặc slot vừa bị đóng)
+    bool receive(Slot &s, uint32_t now) {
+        uint32_t limit = s.state == HTTP ? HTTP_TIMEOUT_MS : WS_IDLE_MS;
+        int avail = s.client.available();
+        if (avail <= 0) {
+            if (!s.client.connected() || now - s.since > limit) close(s);
+            return false;
+        }
+        size_t room = sizeof(s.buf) - 1 - s.len;
+        if (room == 0) {
+            close(s);
+            return false;
+        }
+        int n = s.client.read(s.buf + s.len, (size_t)avail < room ? avail : room);
+        if (n <= 0) return false;
+        s.len += n;
+        if (s.state == WS) s.since = now;
+        return true;
+    }
+
+    void consume(Slot &s, size_t n) {
+        memmove(s.buf, s.buf + n, s.len - n);
+        s.len -= n;
+    }
+
+    void respond(Slot &s, uint16_t code, const char *body) {
+        char out[LanProtocol::MSG_MAX + 128];
+        int n = LanProtocol::formatResponse(out, sizeof(out), code, body);
+        s.client.write((const uint8_t *)out, (size_t)n < sizeof(out) ? n : sizeof(out) - 1);
+        close(s);
+    }
+
+    // Cắt khoảng trắng cuối (curl, wscat thêm '\n') và giữ lệnh chờ reply()
+    void hold(Slot &s, uint8_t *text, size_t len) {
+        while (len > 0 && isspace(text[len - 1])) len--;
+        s.command = text;
+        s.commandLen = len;
+        s.saved = text[len];
+        text[len] = '\0';
+        s.busy = true;
+    }
+
+    bool authorized(const char *token, uint32_t now) {
+        if (_token[0] && LanProtocol::tokenEquals(token, _token)) return true;
+        _authBucket.take(now);
+        return false;
+    }
+
+    bool handleHttp(Slot &s, uint32_t now) {
+        LanProtocol::HttpHead head;
+        switch (LanProtocol::parseHead((const char *)s.buf, s.len, head)) {
+        case LanProtocol::PARSE_MORE: return false;
+        case LanProtocol::PARSE_BAD: respond(s, 400, "bad_request"); return false;
+        case LanProtocol::PARSE_OK: break;
+        }
+        if (_authBucket.available(now) == 0) {
+            respond(s, 429, "auth_limited");
+            return false;
+        }
+        if (!authorized(head.token, now)) {
+            respond(s, 401, "bad_token");
+            return false;
+        }
+
+        if (strcmp(head.path, LanProtocol::PATH_EVENTS) == 0 && strcmp(head.method, "GET") == 0) {
+            char accept[LanProtocol::WS_ACCEPT_LEN];
+            if (!LanProtocol::wsAccept(head.wsKey, accept, sizeof(accept))) {
+                respond(s, 400, "websocket_key");
+                return false;
+            }
+            char out[160];
+            int n = LanProtocol::formatUpgrade(out, sizeof(out), accept);
+            s.client.write((const uint8_t *)out, n);
+            consume(s, head.headLen);
+            s.state = WS;
+            s.since = now;
+            return s.len > 0 && handleWs(s);
+        }
+        if (strcmp(head.path, LanProtocol::PATH_COMMAND) == 0 && strcmp(head.method, "POST") == 0) {
+            if (head.contentLength == 0 || head.contentLength > LanProtocol::MSG_MAX - 1) {
+                respond(s, 413, "length");
+                return false;
+            }
+            if (s.len < head.headLen + head.contentLength) return false; // body chưa đến đủ
+            hold(s, s.buf + head.headLen, head.contentLength);
+            return true;
+        }
+        respond(s, 404, "not_found");
+        return false;
+    }
+
+    bool handleWs(Slot &s) {
+        while (s.len > 0) {
+            LanProtocol::WsFrame f;
+            int used = LanProtocol::wsDecode(s.buf, s.len, f);
+            if (used == 0) return false;
+            if (used < 0) {
+                sendFrame(s, LanProtocol::WS_CLOSE, nullptr, 0);
+                close(s);
+                return false;
+            }
+            switch (f.opcode) {
+            case LanProtocol::WS_TEXT:
+                s.frameLen = used;
+                hold(s, f.payload, f.len);
+                return true;
+            case LanProtocol::WS_PING:
+                sendFrame(s, LanProtocol::WS_PONG, f.payload, f.len);
+                break;
+            case LanProtocol::WS_CLOSE:
+                sendFrame(s, LanProtocol::WS_CLOSE, nullptr, 0);
+                close(s);
+                return false;
+            default: // pong, binary: bỏ qua
+                break;
+            }
+            consume(s, used);
+        }
+        return false;
+    }
+
+    static size_t buildFrame(uint8_t *frame, uint8_t opcode, const uint8_t *payload, size_t len) {
+        if (len > LanProtocol::MSG_MAX) len = LanProtocol::MSG_MAX;
+        size_t n = LanProtocol::wsHeader(frame, opcode, len);
+        if (len) memcpy(frame + n, payload, len);
+        return n + len;
+    }
+
+    void sendFrame(Slot &s, uint8_t opcode, const uint8_t *payload, size_t len) {
+        uint8_t frame[4 + LanProtocol::MSG_MAX];
+        s.client.write(frame, buildFrame(frame, opcode, payload, len)); // một segment TCP cho mỗi frame
+    }
+
+    // Như sendFrame() nhưng không chờ: hết chỗ thì bỏ frame. Gửi được một phần thì
+    // luồng đã lệch giữa frame, client không giải được nữa nên đóng luôn
+    void offerFrame(Slot &s, uint8_t opcode, const uint8_t *payload, size_t len) {
+        uint8_t frame[4 + LanProtocol::MSG_MAX];
+        size_t n = buildFrame(frame, opcode, payload, len);
+        int sent = send(s.client.fd(), frame, n, MSG_DONTWAIT);
+        if (sent == (int)n) return;
+        _dropped++;
+        if (sent > 0 || (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) close(s);
+    }
+};
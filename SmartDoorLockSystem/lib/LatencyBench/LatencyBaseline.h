@@ -0,0 +1,43 @@
+/***
+ * Baseline độ trễ (µs) cho từng kịch bản của LatencyBench.
+ *
+ * Số hiện tại lấy từ mô hình trên PC (test/test_bench): đồng hồ giả chạy qua
+ * cùng chuỗi thao tác với chi phí ước tính của I2C 100 kHz tới LCD, UART 57600
+ * tới AS608, publish MQTT qua TLS và ghi NVS. test_bench in lại bảng này và fail
+ * nếu bảng lệch mô hình. Khi đo được trên phần cứng thật (build với
+ * -D LATENCY_BENCH, chạy mỗi kịch bản vài chục lần, gửi `bench_report`) thì thay
+ * bằng số đo và chỉnh chi phí trong test_bench cho khớp. Chỉ cập nhật khi thay
+ * đổi hiệu năng là có chủ ý.
+ *
+ * 0 là chưa đo: kịch bản đó không bị kiểm regression.
+ ***/
+
+#pragma once
+#include <stdint.h>
+
+// p50/p99 vượt baseline quá ngưỡng này (%) thì coi là regression
+#ifndef LATENCY_REGRESSION_PCT
+#define LATENCY_REGRESSION_PCT 20
+#endif
+
+// ...và vượt thêm ít nhất chừng này µs: kịch bản chỉ vài µs CPU không fail vì một lần ngắt
+#ifndef LATENCY_REGRESSION_MIN_US
+#define LATENCY_REGRESSION_MIN_US 50
+#endif
+
+struct LatencyBaseline
+{
+    uint32_t p50Us;
+    uint32_t p99Us;
+};
+
+// Thứ tự theo BenchScenario
+constexpr LatencyBaseline LATENCY_BASELINE[] = {
+    {535813, 536442}, // keypad_pin: gồm delay(500) trước khi vào menu
+    {7156, 8791},     // remote_unlock
+    {107361, 110230}, // finger_match
+    {15124, 18036},   // change_password
+    {9, 12},          // access_rule
+    {138, 145},       // otp_verify
+    {110546, 113907}, // finger_verify
+};
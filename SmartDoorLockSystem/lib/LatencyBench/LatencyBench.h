@@ -0,0 +1,218 @@
+/***
+ * Đo độ trễ end-to-end của các đường mở khóa ngay trên thiết bị.
+ *
+ * Bật bằng build flag `-D LATENCY_BENCH`. Khi không bật, các macro BENCH_*
+ * rỗng và không tốn gì.
+ *
+ * Mỗi mẫu đo từ lúc input hoàn tất (phím PIN thứ 4, lệnh MQTT tới, ảnh vân
+ * tay chụp xong) tới lúc khóa được mở. Thời gian bên trong mẫu được chia theo
+ * bus: I2C (LCD), UART (AS608) và NET (publish MQTT qua TLS), nên thấy ngay
+ * phần nào làm chậm.
+ *
+ * Kịch bản access_rule và otp_verify đo riêng thời gian quyết định lịch truy
+ * cập và kiểm tra mã một lần (BENCH_SCOPE), không làm gián đoạn mẫu end-to-end
+ * đang chạy.
+ *
+ * finger_verify là finger_match ở chế độ xác minh 1:1 (mã người dùng + '#'
+ * trước khi đặt ngón tay), để so với tìm 1:N trên cùng thư viện.
+ ***/
+
+#pragma once
+#include <Arduino.h>
+#include "LatencyBaseline.h"
+
+enum BenchScenario : uint8_t
+{
+    BENCH_KEYPAD_PIN,
+    BENCH_REMOTE_UNLOCK,
+    BENCH_FINGER_MATCH,
+    BENCH_CHANGE_PASSWORD,
+    BENCH_ACCESS_RULE,
+    BENCH_OTP_VERIFY,
+    BENCH_FINGER_VERIFY,
+    BENCH_SCENARIO_COUNT
+};
+
+static_assert(sizeof(LATENCY_BASELINE) / sizeof(LATENCY_BASELINE[0]) == BENCH_SCENARIO_COUNT,
+              "LATENCY_BASELINE cần đúng một dòng cho mỗi BenchScenario");
+
+enum BenchCost : uint8_t
+{
+    BENCH_COST_I2C,
+    BENCH_COST_UART,
+    BENCH_COST_NET,
+    BENCH_COST_COUNT
+};
+
+class LatencyBench
+{
+public:
+    static constexpr uint8_t SAMPLES = 32; // mẫu gần nhất cho mỗi kịch bản
+
+    // Bắt đầu một mẫu; mẫu đang chạy (nếu có) bị bỏ
+    void begin(BenchScenario s)
+    {
+        _active = s;
+        _start = micros();
+        for (uint8_t c = 0; c < BENCH_COST_COUNT; c++) _cost[c] = 0;
+    }
+
+    // Kết thúc mẫu nếu đúng kịch bản đang đo
+    void end(BenchScenario s)
+    {
+        if (_active != s) return;
+        add(s, micros() - _start, _cost);
+        _active = BENCH_SCENARIO_COUNT;
+    }
+
+    // Thêm một mẫu đo sẵn, độc lập với mẫu đang chạy
+    void sample(BenchScenario s, uint32_t us)
+    {
+        static const uint32_t noCost[BENCH_COST_COUNT] = {};
+        add(s, us, noCost);
+    }
+
+    // Cộng thời gian bus vào mẫu đang chạy
+    void charge(BenchCost c, uint32_t us)
+    {
+        if (_active != BENCH_SCENARIO_COUNT) _cost[c] += us;
+    }
+
+    // Ghi JSON của một kịch bản vào buf. Trả về false nếu p50/p99 vượt ngưỡng baseline
+    bool report(BenchScenario s, char *buf, size_t len)
+    {
+        const Series &sr = _series[s];
+        uint8_t n = sr.count < SAMPLES ? sr.count : SAMPLES;
+        uint32_t sorted[SAMPLES];
+        for (uint8_t i = 0; i < n; i++) sorted[i] = sr.total[i];
+        sortSamples(sorted, n);
+
+        uint32_t p50 = percentile(sorted, n, 50);
+        uint32_t p99 = percentile(sorted, n, 99);
+        const LatencyBaseline &base = LATENCY_BASELINE[s];
+        bool pass = n == 0 || (!regressed(p50, base.p50Us) && !regressed(p99, base.p99Us));
+
+        uint32_t div = sr.count ? sr.count : 1;
+        snprintf(buf, len,
+                 "{\"scenario\":\"%s\",\"n\":%lu,\"p50_us\":%lu,\"p99_us\":%lu,"
+                 "\"base_p50_us\":%lu,\"base_p99_us\":%lu,\"threshold_pct\":%u,"
+                 "\"avg_i2c_us\":%lu,\"avg_uart_us\":%lu,\"avg_net_us\":%lu,\"pass\":%s}",
+                 scenarioName(s), (unsigned long)sr.count, (unsigned long)p50, (unsigned long)p99,
+                 (unsigned long)base.p50Us, (unsigned long)base.p99Us, (unsigned)LATENCY_REGRESSION_PCT,
+                 (unsigned long)(sr.costSum[BENCH_COST_I2C] / div),
+                 (unsigned long)(sr.costSum[BENCH_COST_UART] / div),
+                 (unsigned long)(sr.costSum[BENCH_COST_NET] / div),
+                 pass ? "true" : "false");
+        return pass;
+    }
+
+    void reset()
+    {
+        for (uint8_t s = 0; s < BENCH_SCENARIO_COUNT; s++) _series[s] = Series();
+        _active = BENCH_SCENARIO_COUNT;
+    }
+
+    static const char *scenarioName(BenchScenario s)
+    {
+        switch (s)
+        {
+        case BENCH_KEYPAD_PIN: return "keypad_pin";
+        case BENCH_REMOTE_UNLOCK: return "remote_unlock";
+        case BENCH_FINGER_MATCH: return "finger_match";
+        case BENCH_CHANGE_PASSWORD: return "change_password";
+        case BENCH_ACCESS_RULE: return "access_rule";
+        case BENCH_OTP_VERIFY: return "otp_verify";
+        case BENCH_FINGER_VERIFY: return "finger_verify";
+        default: return "unknown";
+        }
+    }
+
+private:
+    struct Series
+    {
+        uint32_t total[SAMPLES] = {};
+        uint64_t costSum[BENCH_COST_COUNT] = {};
+        uint32_t count = 0;
+    };
+
+    Series _series[BENCH_SCENARIO_COUNT];
+    BenchScenario _active = BENCH_SCENARIO_COUNT;
+    uint32_t _start = 0;
+    uint32_t _cost[BENCH_COST_COUNT] = {};
+
+    void add(BenchScenario s, uint32_t total, const uint32_t *cost)
+    {
+        Series &sr = _series[s];
+        uint8_t slot = sr.count % SAMPLES;
+        sr.total[slot] = total;
+        for (uint8_t c = 0; c < BENCH_COST_COUNT; c++) sr.costSum[c] += cost[c];
+        sr.count++;
+    }
+
+    static void sortSamples(uint32_t *v, uint8_t n)
+    {
+        for (uint8_t i = 1; i < n; i++)
+        {
+            uint32_t x = v[i];
+            int8_t j = i - 1;
+            while (j >= 0 && v[j] > x) { v[j + 1] = v[j]; j--; }
+            v[j + 1] = x;
+        }
+    }
+
+    // Nearest-rank percentile
+    static uint32_t percentile(const uint32_t *sorted, uint8_t n, uint8_t pct)
+    {
+        if (n == 0) return 0;
+        uint16_t rank = (pct * n + 99) / 100;
+        return sorted[rank ? rank - 1 : 0];
+    }
+
+    static bool regressed(uint32_t value, uint32_t baseline)
+    {
+        if (baseline == 0) return false;
+        return (uint64_t)value * 100 >
+               (uint64_t)baseline * (100 + LATENCY_REGRESSION_PCT) + (uint64_t)LATENCY_REGRESSION_MIN_US * 100;
+    }
+};
+
+// Đo thời gian một đoạn code và tính vào chi phí bus của mẫu đang chạy
+class BenchSpan
+{
+public:
+    BenchSpan(LatencyBench &bench, BenchCost cost) : _bench(bench), _cost(cost), _start(micros()) {}
+    ~BenchSpan() { _bench.charge(_cost, micros() - _start); }
+
+private:
+    LatencyBench &_bench;
+    BenchCost _cost;
+    uint32_t _start;
+};
+
+// Đo cả một khối code thành một mẫu của kịch bản riêng
+class BenchScope
+{
+public:
+    BenchScope(LatencyBench &bench, BenchScenario s) : _bench(bench), _s(s), _start(micros()) {}
+    ~BenchScope() { _bench.sample(_s, micros() - _start); }
+
+private:
+    LatencyBench &_bench;
+    BenchScenario _s;
+    uint32_t _start;
+};
+
+#ifdef LATENCY_BENCH
+extern LatencyBench latencyBench;
+#define BENCH_BEGIN(s) latencyBench.begin(s)
+#define BENCH_END(s) latencyBench.end(s)
+#define BENCH_SPAN_CAT2(a, b) a##b
+#define BENCH_SPAN_CAT(a, b) BENCH_SPAN_CAT2(a, b)
+#define BENCH_SPAN(c) BenchSpan BENCH_SPAN_CAT(_benchSpan, __LINE__)(latencyBench, c)
+#define BENCH_SCOPE(s) BenchScope BENCH_SPAN_CAT(_benchScope, __LINE__)(latencyBench, s)
+#else
+#define BENCH_BEGIN(s) ((void)0)
+#define BENCH_END(s) ((void)0)
+#define BENCH_SPAN(c) ((void)0)
+#define BENCH_SCOPE(s) ((void)0)
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+#include <stdarg.h>
+#include <stdio.h>
+
+/***
+ * Một dòng LCD 20 ký tự định dạng trên stack thay cho String:
+ * lcdMsg(LcdLine("Fails: %u", n).text). Dài hơn thì bị cắt, không cấp phát heap.
+ ***/
+struct LcdLine {
+    static constexpr size_t COLS = 20;
+
+    char text[COLS + 1];
+
+    LcdLine(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(text, sizeof(text), fmt, args);
+        va_end(args);
+    }
+};
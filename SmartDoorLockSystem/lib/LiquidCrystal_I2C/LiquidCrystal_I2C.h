@@ -72,8 +72,9 @@ public:
 
 	/**
 	 * Set the LCD display in the correct begin state, must be called before anything else is done.
+	 * warm = true: the LCD stayed powered across an MCU reset, skip the ~1 s power-up waits.
 	 */
-	void begin();
+	void begin(bool warm = false);
 
 	 /**
 	  * Remove all the characters currently shown. Next print/write operation will start
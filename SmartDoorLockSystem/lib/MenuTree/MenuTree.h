@@ -0,0 +1,143 @@
+/***
+ * Cây menu dựng hoàn toàn lúc biên dịch cho LCD 20x4.
+ *
+ * Mỗi menu là một mảng constexpr MenuTree::Item. render() tính sẵn mọi trang
+ * (dòng tiêu đề + 3 mục, đã pad đủ 20 cột) và bảng tra phím -> mục, nên lúc
+ * chạy chỉ còn: tra bảng theo phím, gọi hàm, in 4 dòng có sẵn từ flash. Phần
+ * RAM duy nhất là con trỏ (menu, trang) của người gọi.
+ ***/
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+namespace MenuTree
+{
+    constexpr uint8_t COLS = 20;
+    constexpr uint8_t ROWS = 4;
+    constexpr uint8_t ITEMS_PER_PAGE = ROWS - 1;
+    constexpr uint8_t KEY_COUNT = 12; // bàn phím 3x4
+    constexpr uint8_t NO_SUBMENU = 0xFF;
+
+    using Action = void (*)();
+
+    struct Item
+    {
+        char key;
+        const char *label;
+        Action action;   // nullptr nếu mục chỉ mở submenu
+        uint8_t submenu; // chỉ số menu đích hoặc NO_SUBMENU
+    };
+
+    struct Line
+    {
+        char text[COLS + 1];
+    };
+
+    // '1'..'9' -> 0..8, '*' -> 9, '0' -> 10, '#' -> 11, còn lại -1
+    constexpr int8_t keyIndex(char key)
+    {
+        return (key >= '1' && key <= '9') ? key - '1'
+               : key == '*'               ? 9
+               : key == '0'               ? 10
+               : key == '#'               ? 11
+                                          : -1;
+    }
+
+    template <size_t N>
+    struct Rendered
+    {
+        static constexpr uint8_t PAGES = (N + ITEMS_PER_PAGE - 1) / ITEMS_PER_PAGE;
+        Line pages[PAGES][ROWS];
+        int8_t keyTable[KEY_COUNT];
+    };
+
+    // Mô tả chung cho mọi menu, trỏ vào dữ liệu đã render
+    struct Menu
+    {
+        const Item *items;
+        const Line (*pages)[ROWS];
+        const int8_t *keyTable;
+        uint8_t pageCount;
+    };
+
+    constexpr size_t length(const char *s)
+    {
+        size_t n = 0;
+        while (s[n]) n++;
+        return n;
+    }
+
+    // "========MENU========"
+    constexpr Line titleLine(const char *title)
+    {
+        Line line{};
+        size_t n = length(title);
+        if (n > COLS) n = COLS;
+        size_t left = (COLS - n) / 2;
+        for (size_t i = 0; i < COLS; i++)
+            line.text[i] = (i >= left && i < left + n) ? title[i - left] : '=';
+        return line;
+    }
+
+    // "1:OpenDoor" hoặc "2:Users >" với submenu, pad khoảng trắng tới 20 cột
+    constexpr Line itemLine(const Item &item)
+    {
+        Line line{};
+        size_t pos = 0;
+        line.text[pos++] = item.key;
+        line.text[pos++] = ':';
+        for (size_t i = 0; item.label[i] && pos < COLS; i++) line.text[pos++] = item.label[i];
+        if (item.submenu != NO_SUBMENU && item.key != '*' && pos + 2 <= COLS) // '*' = quay lại
+        {
+            line.text[pos++] = ' ';
+            line.text[pos++] = '>';
+        }
+        while (pos < COLS) line.text[pos++] = ' ';
+        return line;
+    }
+
+    constexpr Line blankLine()
+    {
+        Line line{};
+        for (size_t i = 0; i < COLS; i++) line.text[i] = ' ';
+        return line;
+    }
+
+    template <size_t N>
+    constexpr Rendered<N> render(const char *title, const Item (&items)[N])
+    {
+        Rendered<N> r{};
+        for (size_t p = 0; p < Rendered<N>::PAGES; p++)
+        {
+            r.pages[p][0] = titleLine(title);
+            for (size_t row = 0; row < ITEMS_PER_PAGE; row++)
+            {
+                size_t idx = p * ITEMS_PER_PAGE + row;
+                r.pages[p][row + 1] = idx < N ? itemLine(items[idx]) : blankLine();
+            }
+        }
+        for (size_t k = 0; k < KEY_COUNT; k++) r.keyTable[k] = -1;
+        for (size_t i = 0; i < N; i++) r.keyTable[keyIndex(items[i].key)] = i;
+        return r;
+    }
+
+    template <size_t N>
+    constexpr Menu describe(const Item (&items)[N], const Rendered<N> &r)
+    {
+        return {items, r.pages, r.keyTable, Rendered<N>::PAGES};
+    }
+
+    // Dùng với static_assert: mỗi phím hợp lệ và chỉ gán cho một mục
+    template <size_t N>
+    constexpr bool validKeys(const Item (&items)[N])
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            if (keyIndex(items[i].key) < 0) return false;
+            for (size_t j = i + 1; j < N; j++)
+                if (items[i].key == items[j].key) return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,243 @@
+#pragma once
+#include <Arduino.h>
+#include <Update.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <mbedtls/md.h>
+#include <rom/miniz.h>
+#include "DeltaPatch.h"
+
+/***
+ * Cập nhật firmware A/B qua MQTT bằng bản vá delta nén zlib.
+ *
+ * Bản vá (tools/ota_delta.py) đến từng mẩu kèm offset, gửi kiểu dừng-chờ: khóa
+ * trả offset kế tiếp, mẩu lặp/lệch offset chỉ làm khóa báo lại offset đúng. Mỗi
+ * mẩu được giải nén bằng tinfl trong ROM rồi đi thẳng qua DeltaPatch vào phân
+ * vùng OTA còn lại (Update), ảnh gốc đọc từ phân vùng đang chạy. RAM chỉ cần
+ * cửa sổ inflate 32KB + bộ giải nén (~43KB), cấp lúc begin() và trả khi xong.
+ *
+ * Xác thực: ota_begin mang HMAC-SHA256 của cả bản vá (đã nén) theo khóa OTA
+ * riêng của từng khóa cửa (nạp một lần qua USB Serial, lưu NVS, không bao giờ đi
+ * qua MQTT). HMAC được tính dần theo từng mẩu và so trước Update.end(): sai thì
+ * phân vùng mới bị hủy, boot partition không đổi. Chưa nạp khóa thì không nhận OTA.
+ *
+ * Rollback: ảnh mới boot ở trạng thái PENDING_VERIFY (main.cpp ghi đè
+ * verifyRollbackLater()). checkBoot() đánh dấu hợp lệ sau khi MQTT chạy ổn
+ * HEALTHY_MS; quá BOOT_DEADLINE_MS vẫn chưa được thì đánh dấu hỏng và reboot về
+ * ảnh cũ. MQTT là đường cập nhật duy nhất nên ảnh không lên được broker coi như hỏng.
+ ***/
+class OtaUpdater {
+public:
+    static constexpr uint32_t HEALTHY_MS = 60000;
+    static constexpr uint32_t BOOT_DEADLINE_MS = 300000;
+    static constexpr uint32_t IDLE_TIMEOUT_MS = 60000; // quá lâu không có mẩu mới thì hủy phiên
+    static constexpr size_t KEY_LEN = 32;
+    static constexpr size_t MAC_LEN = 32; // HMAC-SHA256
+
+    enum Result : uint8_t {
+        CONTINUE, // nhận xong mẩu, chờ mẩu ở next()
+        RESEND,   // offset lệch, báo lại next()
+        DONE,     // ảnh mới đã ghi và đặt làm phân vùng boot
+        FAILED,   // phiên bị hủy, lý do ở error()
+    };
+
+    void setKey(const uint8_t *key) {
+        memcpy(_key, key, KEY_LEN);
+        _hasKey = true;
+    }
+
+    bool hasKey() const { return _hasKey; }
+
+    // Bắt đầu phiên mới (hủy phiên cũ nếu còn); mac = HMAC-SHA256(khóa OTA, bản vá)
+    bool begin(uint32_t patchBytes, uint32_t patchCrc, const uint8_t *mac) {
+        abort(nullptr);
+        if (!_hasKey) return fail("no_key");
+        if (patchBytes == 0) return fail("size");
+        mbedtls_md_init(&_hmac);
+        if (mbedtls_md_setup(&_hmac, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1) != 0 ||
+            mbedtls_md_hmac_starts(&_hmac, _key, KEY_LEN) != 0)
+            return fail("no_memory");
+        memcpy(_expectedMac, mac, MAC_LEN);
+        _inflator = (tinfl_decompressor *)malloc(sizeof(tinfl_decompressor));
+        _dict = (uint8_t *)malloc(TINFL_LZ_DICT_SIZE);
+        if (!_inflator || !_dict) return fail("no_memory");
+        tinfl_init(_inflator);
+        _dictPos = 0;
+        _running = esp_ota_get_running_partition();
+        _patch.begin(&OtaUpdater::readOld, &OtaUpdater::writeNew, this);
+        _total = patchBytes;
+        _expectedCrc = patchCrc;
+        _received = 0;
+        _crc = 0;
+        _lastChunkMs = millis();
+        _error = nullptr;
+        _active = true;
+        return true;
+    }
+
+    Result write(uint32_t offset, const uint8_t *data, size_t len) {
+        if (!_active) {
+            _error = "no_session";
+            return FAILED;
+        }
+        if (offset != _received) return RESEND;
+        if (len > _total - _received) {
+            fail("size");
+            return FAILED;
+        }
+        _lastChunkMs = millis();
+        _crc = DeltaPatch::crc32(_crc, data, len);
+        mbedtls_md_hmac_update(&_hmac, data, len);
+        _received += len;
+        bool last = _received == _total;
+        if (!inflate(data, len, last)) return FAILED;
+        if (!last) return CONTINUE;
+
+        if (_crc != _expectedCrc) {
+            fail("crc");
+            return FAILED;
+        }
+        if (_patch.status() != DeltaPatch::DONE) {
+            fail("truncated");
+            return FAILED;
+        }
+        if (!macMatches()) {
+            fail("auth");
+            return FAILED;
+        }
+        if (!Update.end()) {
+            fail("flash");
+            return FAILED;
+        }
+        release();
+        return DONE;
+    }
+
+    // reason = nullptr: hủy im lặng, giữ error() cũ
+    void abort(const char *reason) {
+        if (reason) _error = reason;
+        if (Update.isRunning()) Update.abort();
+        release();
+    }
+
+    bool active() const { return _active; }
+    uint32_t next() const { return _received; }
+    uint32_t total() const { return _total; }
+    const char *error() const { return _error ? _error : "none"; }
+    bool idle(uint32_t now) const { return _active && now - _lastChunkMs > IDLE_TIMEOUT_MS; }
+
+    // Gọi trong setup(): ảnh này vừa được OTA và đang chờ xác nhận?
+    bool beginBoot() {
+        esp_ota_img_states_t state;
+        _verifyPending = esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK &&
+                         state == ESP_OTA_IMG_PENDING_VERIFY;
+        return _verifyPending;
+    }
+
+    // Gọi mỗi vòng loop(); trả true đúng một lần khi ảnh vừa được xác nhận
+    bool checkBoot(bool healthy, uint32_t now) {
+        if (!_verifyPending) return false;
+        if (!healthy) {
+            _healthy = false;
+        } else if (!_healthy) {
+            _healthy = true;
+            _healthySince = now;
+        } else if (now - _healthySince >= HEALTHY_MS) {
+            esp_ota_mark_app_valid_cancel_rollback();
+            _verifyPending = false;
+            return true;
+        }
+        if (now >= BOOT_DEADLINE_MS) esp_ota_mark_app_invalid_rollback_and_reboot();
+        return false;
+    }
+
+private:
+    DeltaPatch _patch;
+    tinfl_decompressor *_inflator = nullptr;
+    uint8_t *_dict = nullptr;
+    size_t _dictPos = 0;
+    const esp_partition_t *_running = nullptr;
+
+    bool _active = false;
+    uint32_t _total = 0;
+    uint32_t _received = 0;
+    uint32_t _expectedCrc = 0;
+    uint32_t _crc = 0;
+    uint32_t _lastChunkMs = 0;
+    const char *_error = nullptr;
+    uint8_t _key[KEY_LEN];
+    bool _hasKey = false;
+    mbedtls_md_context_t _hmac = {}; // rỗng: mbedtls_md_free không làm gì
+    uint8_t _expectedMac[MAC_LEN];
+
+    bool _verifyPending = false;
+    bool _healthy = false;
+    uint32_t _healthySince = 0;
+
+    bool fail(const char *reason) {
+        abort(reason);
+        return false;
+    }
+
+    // So hằng thời gian để không lộ số byte đúng qua thời gian trả lời
+    bool macMatches() {
+        uint8_t mac[MAC_LEN];
+        if (mbedtls_md_hmac_finish(&_hmac, mac) != 0) return false;
+        uint8_t diff = 0;
+        for (size_t i = 0; i < MAC_LEN; i++) diff |= mac[i] ^ _expectedMac[i];
+        return diff == 0;
+    }
+
+    void release() {
+        mbedtls_md_free(&_hmac);
+        free(_inflator);
+        free(_dict);
+        _inflator = nullptr;
+        _dict = nullptr;
+        _active = false;
+    }
+
+    static const char *patchError(DeltaPatch::Status s) {
+        switch (s) {
+        case DeltaPatch::ERR_MAGIC: return "magic";
+        case DeltaPatch::ERR_BASE: return "base"; // ảnh đang chạy khác ảnh gốc, gửi bản đầy đủ
+        case DeltaPatch::ERR_READ: return "read";
+        case DeltaPatch::ERR_WRITE: return "flash";
+        case DeltaPatch::ERR_SIZE: return "size";
+        case DeltaPatch::ERR_CRC: return "image_crc";
+        default: return "patch";
+        }
+    }
+
+    // Giải nén hết data; cửa sổ tinfl vòng 32KB chính là bộ đệm ra cho DeltaPatch
+    bool inflate(const uint8_t *data, size_t len, bool last) {
+        const uint32_t flags = TINFL_FLAG_PARSE_ZLIB_HEADER | (last ? 0 : TINFL_FLAG_HAS_MORE_INPUT);
+        for (;;) {
+            size_t inBytes = len;
+            size_t outBytes = TINFL_LZ_DICT_SIZE - _dictPos;
+            tinfl_status st = tinfl_decompress(_inflator, data, &inBytes, _dict, _dict + _dictPos, &outBytes, flags);
+            data += inBytes;
+            len -= inBytes;
+            if (outBytes) {
+                DeltaPatch::Status ps = _patch.feed(_dict + _dictPos, outBytes);
+                _dictPos = (_dictPos + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+                if (ps < 0) return fail(patchError(ps));
+            }
+            if (st < 0) return fail("inflate");
+            if (st == TINFL_STATUS_DONE) return len == 0 || fail("inflate");
+            if (st == TINFL_STATUS_NEEDS_MORE_INPUT) return !last || fail("truncated");
+            // HAS_MORE_OUTPUT: cửa sổ đầy, giải nén tiếp
+        }
+    }
+
+    static bool readOld(void *ctx, uint32_t offset, uint8_t *buf, size_t len) {
+        return esp_partition_read(static_cast<OtaUpdater *>(ctx)->_running, offset, buf, len) == ESP_OK;
+    }
+
+    // Update.begin() chờ tới byte đầu tiên vì kích thước ảnh mới nằm trong header bản vá
+    static bool writeNew(void *ctx, const uint8_t *buf, size_t len) {
+        OtaUpdater *self = static_cast<OtaUpdater *>(ctx);
+        if (!Update.isRunning() && !Update.begin(self->_patch.newSize())) return false;
+        return Update.write(const_cast<uint8_t *>(buf), len) == len;
+    }
+};
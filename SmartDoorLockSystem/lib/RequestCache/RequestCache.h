@@ -0,0 +1,87 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+/***
+ * LRU cố định cho request ID của lệnh MQTT.
+ *
+ * Lưu hash FNV-1a 32 bit của ID cùng kết quả đã trả lời, nên lệnh bị gửi lại
+ * (broker redeliver QoS 1, dashboard bấm lại) không chạy lần hai mà chỉ nhận
+ * lại ack cũ. N mục, mỗi mục ~40 byte, không cấp phát động; đầy thì đè mục
+ * lâu nhất chưa dùng.
+ ***/
+template <uint8_t N>
+class RequestCache {
+public:
+    static constexpr uint8_t EVENT_LEN = 32; // sự kiện dài hơn bị cắt (batch_result)
+
+    struct Entry {
+        uint32_t hash;
+        uint32_t lastUse; // 0 = trống
+        bool done;
+        bool ok;
+        char event[EVENT_LEN];
+    };
+
+    static uint32_t hashId(const char *id) {
+        uint32_t h = 2166136261u;
+        while (*id) {
+            h ^= (uint8_t)*id++;
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    // Mục của ID nếu đã thấy, nullptr nếu chưa
+    const Entry *find(const char *id) {
+        Entry *e = lookup(hashId(id));
+        if (e) e->lastUse = ++_tick;
+        if (e) _hits++;
+        return e;
+    }
+
+    // Ghi ID mới (chưa có kết quả), đè mục lâu nhất chưa dùng
+    void insert(const char *id) {
+        Entry *victim = &_entries[0];
+        for (uint8_t i = 1; i < N; i++)
+            if (_entries[i].lastUse < victim->lastUse) victim = &_entries[i];
+        victim->hash = hashId(id);
+        victim->lastUse = ++_tick;
+        victim->done = false;
+        victim->ok = false;
+        victim->event[0] = '\0';
+    }
+
+    void complete(const char *id, bool ok, const char *event) {
+        Entry *e = lookup(hashId(id));
+        if (!e) return;
+        e->done = true;
+        e->ok = ok;
+        strncpy(e->event, event, EVENT_LEN - 1);
+        e->event[EVENT_LEN - 1] = '\0';
+    }
+
+    // Xóa ID để lần gửi sau được chạy (lệnh bị từ chối tạm thời)
+    void forget(const char *id) {
+        Entry *e = lookup(hashId(id));
+        if (e) e->lastUse = 0;
+    }
+
+    void clear() {
+        memset(_entries, 0, sizeof(_entries));
+        _tick = 0;
+    }
+
+    uint32_t hits() const { return _hits; }
+
+private:
+    Entry _entries[N] = {};
+    uint32_t _tick = 0;
+    uint32_t _hits = 0;
+
+    Entry *lookup(uint32_t hash) {
+        for (uint8_t i = 0; i < N; i++)
+            if (_entries[i].lastUse && _entries[i].hash == hash) return &_entries[i];
+        return nullptr;
+    }
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <rom/crc.h>
+
+/***
+ * Ảnh chụp trạng thái trong RTC slow memory, sống qua reset mềm/watchdog/panic.
+ *
+ * Khai báo biến toàn cục với RTC_NOINIT_ATTR để startup không xóa:
+ *   RTC_NOINIT_ATTR RtcSnapshot<MyState, 1> snap;
+ * Sau power-on (hoặc brownout làm mất RTC) nội dung là rác nên mỗi record có
+ * magic + version + kích thước + CRC32 (ROM); đổi layout của T thì tăng version,
+ * record cũ (kể cả sau OTA) bị bỏ qua như cold boot.
+ *
+ * save() chỉ ghi và tính lại CRC khi dữ liệu khác bản đang lưu (memcmp vài
+ * chục byte), nên gọi mỗi vòng loop được. T phải không có padding để memcmp/CRC
+ * không phụ thuộc byte rác.
+ ***/
+template <typename T, uint16_t VERSION>
+struct RtcSnapshot {
+    static_assert(std::is_trivially_copyable<T>::value, "T phải copy được bằng memcpy");
+    static_assert(std::has_unique_object_representations<T>::value, "T không được có padding");
+    static constexpr uint32_t MAGIC = 0x5A4D5254;
+
+    // Không có initializer: đối tượng RTC_NOINIT không được constructor ghi đè
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    uint32_t seq; // số lần đã ghi từ lần cold boot cuối
+    uint32_t crc;
+    T data;
+
+    bool valid() const {
+        return magic == MAGIC && version == VERSION && size == sizeof(T) && crc == checksum();
+    }
+
+    // Chép record vào out nếu hợp lệ; không hợp lệ thì xóa record, out giữ nguyên
+    bool restore(T &out) {
+        if (!valid()) {
+            invalidate();
+            return false;
+        }
+        memcpy(&out, &data, sizeof(T));
+        return true;
+    }
+
+    // Trả true nếu có ghi
+    bool save(const T &value) {
+        if (magic == MAGIC && memcmp(&data, &value, sizeof(T)) == 0) return false;
+        if (magic != MAGIC) seq = 0;
+        memcpy(&data, &value, sizeof(T));
+        version = VERSION;
+        size = sizeof(T);
+        seq++;
+        crc = checksum();
+        magic = MAGIC;
+        return true;
+    }
+
+    void invalidate() { magic = 0; }
+
+private:
+    uint32_t checksum() const {
+        return crc32_le(seq ^ ((uint32_t)VERSION << 16 | sizeof(T)), (const uint8_t *)&data, sizeof(T));
+    }
+};
@@ -1,13 +1,124 @@
 #pragma once
 #include <Arduino.h>
+#include <esp_timer.h>
 
+/***
+ * Servo 180° trên LEDC 16 bit với bộ sinh chuyển động hình thang.
+ *
+ * 16 bit ở 50Hz cho ~3.3 bước/µs, tức ~6200 bước trên dải 500–2400µs
+ * (8 bit chỉ có ~24). Vị trí được cập nhật mỗi UPDATE_MS bởi esp_timer nên
+ * servo tăng/giảm tốc êm mà không cần main loop, và openFor() mở cửa rồi tự
+ * khóa lại không chặn. Kết quả báo qua pollEvent().
+ ***/
 class ServoPWM180 {
+public:
+    enum Event : uint8_t {
+        NONE,
+        OPENED,    // tới góc mở
+        RELOCKED,  // openFor() đã đóng lại xong
+        ARRIVED,   // moveTo() tới đích
+    };
+
+    static constexpr uint8_t RESOLUTION = 16;
+    static constexpr uint32_t PERIOD_US = 20000; // 50Hz
+    static constexpr uint32_t UPDATE_MS = 10;
+
 private:
     int _pin = -1;
     int _channel = -1;
     int _minUs = 500;
     int _maxUs = 2400;
     bool _attached = false;
+    esp_timer_handle_t _timer = nullptr;
+
+    // Trạng thái chuyển động (chỉ timer ghi, trừ khi đang đặt lệnh mới)
+    volatile float _pos = 0;       // độ
+    volatile float _vel = 0;       // độ/s
+    volatile float _target = 0;
+    float _maxSpeed = 180;         // độ/s
+    float _accel = 720;            // độ/s²
+
+    enum Phase : uint8_t { IDLE, MOVING, OPENING, HOLDING, CLOSING };
+    volatile Phase _phase = IDLE;
+    volatile Event _event = NONE;
+    int _closeAngle = 0;
+    uint32_t _holdMs = 0;
+    unsigned long _holdStart = 0;
+
+    portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+
+    void output(float angle) {
+        float pulseUs = _minUs + (_maxUs - _minUs) * angle / 180.0f;
+        uint32_t duty = (uint32_t)(pulseUs * ((1UL << RESOLUTION) - 1) / PERIOD_US);
+        ledcWrite(_channel, duty);
+    }
+
+    static void onTimer(void *arg) {
+        static_cast<ServoPWM180 *>(arg)->tick();
+    }
+
+    // Bước profile hình thang: tăng tốc tới _maxSpeed, giảm tốc để dừng đúng đích
+    bool step() {
+        const float dt = UPDATE_MS / 1000.0f;
+        float dist = _target - _pos;
+        float dir = dist >= 0 ? 1.0f : -1.0f;
+        float remaining = dist * dir;
+        float speed = _vel * dir;
+
+        if (remaining < 0.05f && speed < _accel * dt) {
+            _pos = _target;
+            _vel = 0;
+            return true;
+        }
+
+        float stopping = speed * speed / (2 * _accel);
+        if (speed < 0 || stopping < remaining) speed += _accel * dt;
+        else speed -= _accel * dt;
+        if (speed > _maxSpeed) speed = _maxSpeed;
+        if (speed >= 0 && speed < _accel * dt) speed = _accel * dt; // không kẹt ở vận tốc 0 trước đích
+
+        float delta = speed * dt;
+        if (delta >= remaining) {
+            _pos = _target;
+            _vel = 0;
+            return true;
+        }
+        _pos = _pos + delta * dir;
+        _vel = speed * dir;
+        return false;
+    }
+
+    // ledcWrite nằm ngoài critical section
+    void tick() {
+        portENTER_CRITICAL(&_mux);
+        bool moving = _phase == MOVING || _phase == OPENING || _phase == CLOSING;
+        switch (_phase) {
+        case IDLE:
+            break;
+        case MOVING:
+            if (step()) { _phase = IDLE; _event = ARRIVED; }
+            break;
+        case OPENING:
+            if (step()) { _phase = HOLDING; _holdStart = millis(); _event = OPENED; }
+            break;
+        case HOLDING:
+            if (millis() - _holdStart >= _holdMs) { _target = _closeAngle; _phase = CLOSING; }
+            break;
+        case CLOSING:
+            if (step()) { _phase = IDLE; _event = RELOCKED; }
+            break;
+        }
+        float pos = _pos;
+        portEXIT_CRITICAL(&_mux);
+        if (moving) output(pos);
+    }
+
+    void startMotion(Phase phase, int angle) {
+        portENTER_CRITICAL(&_mux);
+        _target = constrain(angle, 0, 180);
+        _phase = phase;
+        portEXIT_CRITICAL(&_mux);
+    }
 
 public:
     void attach(int pin, int channel = 0, int minUs = 500, int maxUs = 2400) {
@@ -16,23 +127,67 @@ public:
         _minUs = minUs;
         _maxUs = maxUs;
 
-        // 50Hz + 8bit
-        ledcSetup(_channel, 50, 8);
+        // 50Hz + 16bit
+        ledcSetup(_channel, 50, RESOLUTION);
         ledcAttachPin(_pin, _channel);
 
+        if (!_timer) {
+            esp_timer_create_args_t args = {};
+            args.callback = &ServoPWM180::onTimer;
+            args.arg = this;
+            args.name = "servo";
+            esp_timer_create(&args, &_timer);
+            esp_timer_start_periodic(_timer, UPDATE_MS * 1000);
+        }
+
         _attached = true;
     }
 
+    // Nhảy thẳng tới góc (hủy chuyển động đang chạy)
     void write(int angle) {
         if (!_attached) return;
 
-        angle = constrain(angle, 0, 180);
+        portENTER_CRITICAL(&_mux);
+        _phase = IDLE;
+        _pos = _target = constrain(angle, 0, 180);
+        _vel = 0;
+        portEXIT_CRITICAL(&_mux);
+        output(constrain(angle, 0, 180));
+    }
 
-        int pulseUs = map(angle, 0, 180, _minUs, _maxUs);
+    // Giới hạn tốc độ (độ/s) và gia tốc (độ/s²) của profile
+    void setProfile(float maxSpeed, float accel) {
+        _maxSpeed = maxSpeed;
+        _accel = accel;
+    }
 
-        // 20,000µs chu kỳ tại 50Hz
-        uint32_t duty = (pulseUs * 255) / 20000;
+    // Chạy êm tới góc, báo ARRIVED khi xong
+    void moveTo(int angle) {
+        if (!_attached) return;
+        startMotion(MOVING, angle);
+    }
 
-        ledcWrite(_channel, duty);
+    // Mở tới openAngle, giữ holdMs rồi tự về closeAngle; báo OPENED rồi RELOCKED
+    void openFor(int openAngle, uint32_t holdMs, int closeAngle = 0) {
+        if (!_attached) return;
+        portENTER_CRITICAL(&_mux);
+        _holdMs = holdMs;
+        _closeAngle = constrain(closeAngle, 0, 180);
+        _target = constrain(openAngle, 0, 180);
+        _phase = OPENING;
+        portEXIT_CRITICAL(&_mux);
+    }
+
+    bool busy() const { return _phase != IDLE; }
+
+    int angle() const { return (int)(_pos + 0.5f); }
+
+    // Lấy sự kiện mới nhất (một lần), NONE nếu không có
+    Event pollEvent() {
+        portENTER_CRITICAL(&_mux);
+        Event e = _event;
+        _event = NONE;
+        portEXIT_CRITICAL(&_mux);
+        return e;
     }
 };
@@ -0,0 +1,4 @@
+#include "StallWatchdog.h"
+
+RTC_NOINIT_ATTR StallRecord stallRtcRecord;
+RTC_NOINIT_ATTR StallMarker stallRtcMarker;
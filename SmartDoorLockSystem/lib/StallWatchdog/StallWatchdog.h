@@ -0,0 +1,212 @@
+#pragma once
+#include <Arduino.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_task_wdt.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/***
+ * Phát hiện main loop bị treo và ghi lại chỗ treo.
+ *
+ * Các vòng lặp chặn (search()/enroll() chờ ngón tay, phím chờ thả, menu, kết
+ * nối TLS) đặt marker "đang ở đâu" bằng STALL_SCOPE(site). Marker nằm trong
+ * RTC_NOINIT nên còn nguyên sau reset.
+ *
+ * Task giám sát trên core 0 kiểm tra heartbeat của từng kênh:
+ *  - HB_LOOP: quá ngưỡng thì ghi StallRecord (site, PC nơi đặt marker, PC đã
+ *    lưu của loop task nếu nó không đang chạy) vào RTC rồi esp_restart().
+ *  - HB_NET: MQTT không được phục vụ quá ngưỡng; chỉ ghi record để báo, không
+ *    reset.
+ * Task watchdog của IDF theo dõi loop task với timeout dài hơn, làm chốt chặn
+ * cuối nếu task giám sát không chạy được; khi đó marker RTC vẫn cho biết chỗ treo.
+ *
+ * Sau khi khởi động lại, pendingReport() trả record để main gửi qua MQTT.
+ ***/
+
+#define STALL_SITES(X)                     \
+    X(SITE_LOOP, "loop")                   \
+    X(SITE_KEYPAD, "keypad_release")       \
+    X(SITE_FINGER_SEARCH, "finger_search") \
+    X(SITE_FINGER_ENROLL, "finger_enroll") \
+    X(SITE_FINGER_ADMIN, "finger_admin")   \
+    X(SITE_MENU, "menu")                   \
+    X(SITE_MQTT_CONNECT, "mqtt_connect")   \
+    X(SITE_MQTT_LOOP, "mqtt_loop")         \
+    X(SITE_WIFI_CONNECT, "wifi_connect")   \
+    X(SITE_OTA, "ota")
+
+enum StallSite : uint8_t {
+#define STALL_SITE_ENUM(id, name) id,
+    STALL_SITES(STALL_SITE_ENUM)
+#undef STALL_SITE_ENUM
+    STALL_SITE_COUNT
+};
+
+enum StallChannel : uint8_t {
+    HB_LOOP,
+    HB_NET,
+    HB_COUNT,
+    HB_CRASH = 0xFF, // reset do TWDT/panic, chỉ có marker
+};
+
+struct StallRecord {
+    uint32_t magic;
+    uint8_t channel;
+    uint8_t site;
+    uint8_t resetReason;
+    uint32_t sitePc;    // địa chỉ trả về tại chỗ đặt marker (addr2line)
+    uint32_t taskPc;    // PC đã lưu của loop task, 0 nếu task đang chạy trên CPU
+    uint32_t stalledMs;
+    uint32_t uptimeMs;
+};
+
+struct StallMarker {
+    uint32_t magic;
+    uint8_t site;
+    uint32_t pc;
+};
+
+// Sống qua reset mềm/watchdog, không bị startup xóa. Định nghĩa trong StallWatchdog.cpp
+// để header include được từ nhiều file
+extern StallRecord stallRtcRecord;
+extern StallMarker stallRtcMarker;
+
+class StallWatchdog {
+public:
+    static constexpr uint32_t MAGIC = 0x57A11ED0;
+    static constexpr uint32_t CHECK_MS = 500;
+
+    static const char *siteName(uint8_t site) {
+        static const char *const NAMES[] = {
+#define STALL_SITE_NAME(id, name) name,
+            STALL_SITES(STALL_SITE_NAME)
+#undef STALL_SITE_NAME
+        };
+        return site < STALL_SITE_COUNT ? NAMES[site] : "unknown";
+    }
+
+    static const char *channelName(uint8_t channel) {
+        return channel == HB_LOOP ? "loop" : channel == HB_NET ? "net" : "crash";
+    }
+
+    // Gọi từ loop task (setup()); twdtSeconds phải lớn hơn loopStallMs
+    void begin(uint32_t loopStallMs, uint32_t netStallMs, uint32_t twdtSeconds) {
+        _loopTask = xTaskGetCurrentTaskHandle();
+        _thresholdMs[HB_LOOP] = loopStallMs;
+        _thresholdMs[HB_NET] = netStallMs;
+        loadReport();
+
+        stallRtcMarker = {MAGIC, SITE_LOOP, 0};
+        uint32_t now = millis();
+        for (uint8_t c = 0; c < HB_COUNT; c++) _lastBeat[c] = now;
+        _armed[HB_LOOP] = true;
+
+        esp_task_wdt_init(twdtSeconds, true); // đã init sẵn thì chỉ đổi timeout
+        esp_task_wdt_add(_loopTask);
+        xTaskCreatePinnedToCore(&StallWatchdog::supervise, "stallwd", 3072, this, 2, nullptr, 0);
+    }
+
+    void beat(StallChannel channel) {
+        _lastBeat[channel] = millis();
+        _armed[channel] = true;
+        if (channel == HB_LOOP) esp_task_wdt_reset();
+    }
+
+    // Ngừng theo dõi kênh (vd. HB_NET khi mất WiFi)
+    void park(StallChannel channel) { _armed[channel] = false; }
+
+    void enter(StallSite site, uint32_t pc) {
+        stallRtcMarker.site = site;
+        stallRtcMarker.pc = pc;
+    }
+
+    uint8_t site() const { return stallRtcMarker.site; }
+
+    // Record chờ báo (sau reboot hoặc stall mềm của HB_NET), nullptr nếu không có
+    const StallRecord *pendingReport() const { return _hasReport ? &_report : nullptr; }
+    void ackReport() { _hasReport = false; }
+
+private:
+    TaskHandle_t _loopTask = nullptr;
+    volatile uint32_t _lastBeat[HB_COUNT] = {};
+    volatile bool _armed[HB_COUNT] = {};
+    uint32_t _thresholdMs[HB_COUNT] = {};
+    StallRecord _report = {};
+    volatile bool _hasReport = false;
+
+    // Record do task giám sát ghi, hoặc marker còn lại sau reset do TWDT/panic
+    void loadReport() {
+        esp_reset_reason_t reason = esp_reset_reason();
+        if (stallRtcRecord.magic == MAGIC) {
+            _report = stallRtcRecord;
+            _report.resetReason = reason;
+            _hasReport = true;
+        } else if ((reason == ESP_RST_TASK_WDT || reason == ESP_RST_INT_WDT || reason == ESP_RST_PANIC) &&
+                   stallRtcMarker.magic == MAGIC) {
+            _report = {MAGIC, HB_CRASH, stallRtcMarker.site, (uint8_t)reason, stallRtcMarker.pc, 0, 0, 0};
+            _hasReport = true;
+        }
+        stallRtcRecord.magic = 0;
+    }
+
+    // pxTopOfStack là thành viên đầu của TCB; frame đã lưu (XtExcFrame/XtSolFrame) có PC ở word thứ 2
+    uint32_t savedPc(TaskHandle_t task) const {
+        if (!task || xTaskGetCurrentTaskHandleForCPU(0) == task || xTaskGetCurrentTaskHandleForCPU(1) == task)
+            return 0;
+        uint32_t *sp = *(uint32_t **)task;
+        return sp ? sp[1] : 0;
+    }
+
+    void check() {
+        uint32_t now = millis();
+        for (uint8_t c = 0; c < HB_COUNT; c++) {
+            uint32_t stalled = now - _lastBeat[c];
+            if (!_armed[c] || stalled < _thresholdMs[c]) continue;
+
+            StallRecord r = {MAGIC, c, stallRtcMarker.site, 0, stallRtcMarker.pc,
+                             c == HB_LOOP ? savedPc(_loopTask) : 0, stalled, now};
+            if (c == HB_NET) {
+                if (!_hasReport) {
+                    _report = r;
+                    _hasReport = true;
+                }
+                _lastBeat[c] = now; // báo một lần mỗi ngưỡng
+                continue;
+            }
+
+            stallRtcRecord = r;
+            Serial.printf("\n!!! Loop stalled %lu ms in %s (pc 0x%08lx, task pc 0x%08lx), restarting\n",
+                          (unsigned long)stalled, siteName(r.site), (unsigned long)r.sitePc,
+                          (unsigned long)r.taskPc);
+            Serial.flush();
+            esp_restart();
+        }
+    }
+
+    static void supervise(void *arg) {
+        StallWatchdog *self = static_cast<StallWatchdog *>(arg);
+        while (true) {
+            self->check();
+            vTaskDelay(pdMS_TO_TICKS(CHECK_MS));
+        }
+    }
+};
+
+// Đặt marker trong phạm vi hiện tại, trả lại marker cũ khi ra khỏi phạm vi
+class StallScope {
+public:
+    __attribute__((noinline)) StallScope(StallWatchdog &wd, StallSite site) : _wd(wd), _prev(wd.site()), _prevPc(stallRtcMarker.pc) {
+        // Địa chỉ trả về trong hàm gọi; bỏ 2 bit cửa sổ call của Xtensa
+        uint32_t ra = (uint32_t)(uintptr_t)__builtin_return_address(0);
+        _wd.enter(site, (ra & 0x3FFFFFFF) | 0x40000000);
+    }
+    ~StallScope() { _wd.enter((StallSite)_prev, _prevPc); }
+
+private:
+    StallWatchdog &_wd;
+    uint8_t _prev;
+    uint32_t _prevPc;
+};
+
+#define STALL_SCOPE(site) StallScope _stallScope(stallWatchdog, site)
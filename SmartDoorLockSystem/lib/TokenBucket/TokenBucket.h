@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+
+/***
+ * Token bucket số nguyên cho giới hạn tốc độ.
+ *
+ * Giữ tối đa `capacity` token, cứ `refillMs` nạp thêm một token. Chỉ dùng
+ * millis() truyền vào nên không cần timer, gọi từ main loop hay MQTT callback
+ * đều được. Đếm số lần được nhận/bị bỏ để báo metrics.
+ ***/
+class TokenBucket {
+public:
+    TokenBucket(uint8_t capacity, uint32_t refillMs)
+        : _capacity(capacity), _refillMs(refillMs), _tokens(capacity) {}
+
+    uint8_t available(uint32_t now) {
+        refill(now);
+        return _tokens;
+    }
+
+    // Lấy n token nếu đủ, không thì không lấy gì và tính là bị bỏ
+    bool take(uint32_t now, uint8_t n = 1) {
+        refill(now);
+        if (_tokens < n) {
+            _shed++;
+            return false;
+        }
+        _tokens -= n;
+        _accepted++;
+        return true;
+    }
+
+    uint32_t accepted() const { return _accepted; }
+    uint32_t shed() const { return _shed; }
+
+private:
+    const uint8_t _capacity;
+    const uint32_t _refillMs;
+    uint8_t _tokens;
+    uint32_t _last = 0;
+    uint32_t _accepted = 0;
+    uint32_t _shed = 0;
+
+    void refill(uint32_t now) {
+        uint32_t n = (now - _last) / _refillMs;
+        if (n == 0) return;
+        if (_tokens + n >= _capacity) {
+            _tokens = _capacity;
+            _last = now;
+        } else {
+            _tokens += n;
+            _last += n * _refillMs; // giữ phần lẻ cho lần sau
+        }
+    }
+};
@@ -0,0 +1,79 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <mbedtls/md.h>
+
+/***
+ * Mã mở khóa dùng một lần theo thời gian (TOTP, RFC 6238): HMAC-SHA1, bước
+ * 30 s, 6 chữ số. Dashboard (tools/totp.py) và khóa giữ chung một secret
+ * 20 byte cho mỗi khóa, nên khách nhận mã qua tin nhắn rồi nhập ở bàn phím
+ * (* + 6 số) mà khóa không cần mạng: chỉ cần đồng hồ đã đồng bộ SNTP.
+ *
+ * verify() thử bước hiện tại và ±DRIFT_STEPS bước bên cạnh để bù lệch giờ
+ * và thời gian khách gõ, tối đa 3 lần HMAC. Chống dùng lại: bước đã dùng lưu
+ * ở lastStep(), mã của bước đó hoặc cũ hơn bị từ chối; main.cpp lưu lastStep
+ * vào flash sau mỗi lần mở nên reset cũng không dùng lại được mã cũ.
+ ***/
+class Totp {
+public:
+    static constexpr uint8_t DIGITS = 6;
+    static constexpr uint32_t STEP_S = 30;
+    static constexpr uint8_t DRIFT_STEPS = 1;
+    static constexpr uint8_t SECRET_LEN = 20;
+
+    enum Result : uint8_t {
+        OK,
+        WRONG,
+        REPLAYED,  // đúng mã nhưng bước đã dùng
+        NO_SECRET, // chưa cấp secret: tính năng tắt
+    };
+
+    // HOTP (RFC 4226) của bộ đếm counter, 0..999999
+    static uint32_t hotp(const uint8_t *secret, uint64_t counter) {
+        uint8_t msg[8];
+        for (int8_t i = 7; i >= 0; i--, counter >>= 8) msg[i] = counter & 0xFF;
+        uint8_t mac[20];
+        mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA1), secret, SECRET_LEN, msg, sizeof(msg), mac);
+        uint8_t off = mac[19] & 0x0F;
+        uint32_t bin = (uint32_t)(mac[off] & 0x7F) << 24 | (uint32_t)mac[off + 1] << 16 |
+                       (uint32_t)mac[off + 2] << 8 | mac[off + 3];
+        return bin % 1000000;
+    }
+
+    void setSecret(const uint8_t *secret) {
+        memcpy(_secret, secret, SECRET_LEN);
+        _enabled = true;
+    }
+    void clearSecret() {
+        memset(_secret, 0, SECRET_LEN);
+        _enabled = false;
+    }
+    bool enabled() const { return _enabled; }
+
+    void setLastStep(uint32_t step) { _lastStep = step; }
+    uint32_t lastStep() const { return _lastStep; }
+
+    // digits: đúng DIGITS chữ số. now: giờ Unix, phải đã đồng bộ
+    Result verify(const char *digits, time_t now) {
+        if (!_enabled) return NO_SECRET;
+        uint32_t code = 0;
+        for (uint8_t i = 0; i < DIGITS; i++) {
+            if (digits[i] < '0' || digits[i] > '9') return WRONG;
+            code = code * 10 + (digits[i] - '0');
+        }
+        uint32_t step = now / STEP_S;
+        for (int8_t d = -DRIFT_STEPS; d <= DRIFT_STEPS; d++) {
+            if (hotp(_secret, step + d) != code) continue;
+            if (step + d <= _lastStep) return REPLAYED;
+            _lastStep = step + d;
+            return OK;
+        }
+        return WRONG;
+    }
+
+private:
+    uint8_t _secret[SECRET_LEN] = {};
+    bool _enabled = false;
+    uint32_t _lastStep = 0;
+};
@@ -7,6 +7,29 @@
 #include "AS608FingerSensorWithAdafruitFingerprintSensorLibrary.h"
 #include "ServoPWM180.h"
 #include "LED.h"
+#include "MenuTree.h"
+#include "BuzzerSequencer.h"
+#include "DoorProtocol.h"
+#include "LatencyBench.h"
+#include "InputRecorder.h"
+#include "AS608Emulator.h"
+#include "RequestCache.h"
+#include "TokenBucket.h"
+#include "StallWatchdog.h"
+#include "HeapTracker.h"
+#include "OtaUpdater.h"
+#include "RtcSnapshot.h"
+#include "BinLog.h"
+#include "AuthPipeline.h"
+#include "EnrollJob.h"
+#include "AccessSchedule.h"
+#include "LanServer.h"
+#include "Totp.h"
+#include "FingerUsers.h"
+#include "FingerSession.h"
+#include "FingerStats.h"
+#include "LcdLine.h"
+#include "ca_cert.h"
 
 #include <WiFi.h>
 #include <WiFiClientSecure.h> 
@@ -16,6 +39,22 @@
 #define DEFAULT_PASSWORD "1234"
 #define MAX_FAIL_COUNT 3
 #define LOCKOUT_TIME 30000
+#define DOOR_OPEN_MS 3000
+#define FINGER_POLL_MS 150    // chụp thử AS608 khi không nối chân touch, mỗi lần ~60 ms UART
+#define FINGER_SESSION_MS 1500 // một lần đặt ngón: chụp lại trong thời gian này...
+#define FINGER_CAPTURES 4     // ...tối đa số ảnh này
+#define FINGER_CONFIDENT 80   // điểm khớp từ mức này chấp nhận ngay, thấp hơn thì chụp thêm để xác nhận
+#define TZ_INFO "ICT-7"       // giờ địa phương cho lịch truy cập (POSIX TZ, UTC+7)
+#define NTP_SERVER "pool.ntp.org"
+#define LAN_PORT 8080         // server điều khiển trong LAN (-D LAN_SERVER)
+#ifndef FINGER_TOUCH_ACT
+#define FINGER_TOUCH_ACT HIGH // mức của chân touch AS608 khi có ngón tay
+#endif
+#define LOOP_STALL_MS 45000   // > timeout kết nối TLS (30 s)
+#define NET_STALL_MS 50000    // < keepalive MQTT 60 s
+#define TWDT_TIMEOUT_S 60     // chốt chặn cuối, phải lớn hơn LOOP_STALL_MS
+#define INPUT_TIMEOUT_MS 10000  // đổi mật khẩu trong menu: quá lâu không bấm phím thì hủy
+#define ENROLL_TIMEOUT_MS 30000 // thêm vân tay trong menu: < LOOP_STALL_MS nên chờ ngón tay không bị coi là treo
 
 // WiFi & MQTT
 const char* WIFI_SSID = "RN12T"; // test bằng 4g cho khỏe :))))))))
@@ -30,52 +69,168 @@ const char* MQTT_PASS = "123456789";
 WiFiClientSecure espClient;
 PubSubClient mqttClient(espClient);
 
-// MQTT Topics
-#define TOPIC_STATUS "door/status"
-#define TOPIC_CMD    "door/command"
-#define TOPIC_FINGER "door/fingerprint"
+// MQTT Topics và định dạng bản tin: xem DoorProtocol.h
+using namespace DoorProtocol;
+DoorTopics topics; // site/<door-id>/..., dựng trong setup()
+
+// Topic lệnh được đăng ký và nhóm lệnh mỗi topic được phép chạy.
+// Lệnh nhóm chỉ mở cửa/chẩn đoán, broadcast chỉ chẩn đoán; quản trị phải gửi đích danh.
+Route commandRoutes[] = {
+    {topics.command, CMDC_ALL},
+    {topics.groupCommand, CMDC_UNLOCK | CMDC_DIAG},
+    {TOPIC_BROADCAST_CMD, CMDC_DIAG},
+};
+
+#ifdef LAN_SERVER
+// Lệnh qua LAN cần token nên chạy được mọi nhóm lệnh, trừ OTA vì bản vá chỉ đến qua topic ota
+// và dump_inputs chỉ nhận trên topic riêng của khóa
+LanServer lanServer(LAN_PORT);
+constexpr uint8_t LAN_ALLOW = CMDC_ALL & ~(CMDC_OTA | CMDC_DUMP);
+int8_t lanReplySlot = -1; // client LAN đang chờ kết quả lệnh, -1 = lệnh từ MQTT
+#endif
 
 // ===================== HARDWARE OBJECTS =====================
-LED ledRed(LED_RED_PIN, HIGH);
-LED ledGreen(LED_GREEN_PIN, HIGH);
+LED ledRed(LED_RED_PIN, HIGH, 0);
+LED ledGreen(LED_GREEN_PIN, HIGH, 1);
 LiquidCrystal_I2C lcd(0x3F, 20, 4);
 ServoPWM180 doorServo;
+BuzzerSequencer buzzer;
+#ifdef AS608_EMULATOR
+AS608Emulator fingerEmulator;
+AS608FingerSensor finger(&fingerEmulator);
+#else
 AS608FingerSensor finger(&Serial2, RX_PIN, TX_PIN);
+#endif
 
-Keypad3x4 keypad(
-    (uint8_t[]){ROW0_PIN, ROW1_PIN, ROW2_PIN, ROW3_PIN},
-    (uint8_t[]){COL0_PIN, COL1_PIN, COL2_PIN}
-);
+Keypad3x4<PinSet<ROW0_PIN, ROW1_PIN, ROW2_PIN, ROW3_PIN>, PinSet<COL0_PIN, COL1_PIN, COL2_PIN>> keypad;
 
 // ===================== STATE =====================
 Preferences prefs;
-String password, inputPassword;
+// Không dùng String ở đường chạy thường xuyên: bộ đệm cố định, không phân mảnh heap
+char password[PASS_LEN + 1];
+char inputPassword[Totp::DIGITS + 1]; // PIN, hoặc mã một lần sau '*'
+uint8_t inputLen = 0;
+HeapTracker heapTracker;
 uint8_t failCount = 0;
 unsigned long lockoutTimer = 0;
 unsigned long lastMqttAttempt = 0;
 const unsigned long mqttRetryInterval = 5000;
 bool firsttimeEnteringMenu = false;
+bool menuExitRequested = false;
+RequestCache<16> requestCache;  // request ID đã xử lý gần đây
+RequestHeader activeRequest;    // lệnh có request ID đang chạy
+bool requestPending = false;
+StallWatchdog stallWatchdog;
+OtaUpdater ota;
+BinLog binLog; // log ra Serial, dịch bằng tools/logdecode.py
+AuthPipeline auth;              // PIN và vân tay nhận song song, chính sách any/both lưu flash
+unsigned long lastFingerPoll = 0;
+bool fingerLatched = false;     // ngón tay đang đặt đã được xử lý, chờ nhấc ra
+EnrollJob enrollJob(finger);    // enroll từ xa qua MQTT, chạy nền trong loop()
+AccessSchedule schedules;       // lịch truy cập theo tuần của PIN và từng vân tay
+Preferences schedulePrefs;      // namespace riêng, mỗi lịch một key "s<chủ thể>"
+const time_t TIME_VALID_AFTER = 1704067200; // 2024-01-01: trước mốc này là chưa đồng bộ SNTP
+bool timeSynced = false;
+Totp totp;                      // mã mở khóa một lần cho khách, secret cấp qua MQTT
+bool otpEntry = false;          // đang gõ mã một lần (sau '*')
+FingerUsers fingerUsers;        // mã người dùng -> dải slot vân tay, cho xác minh 1:1
+FingerUsers::User verifyUser{}; // người vừa gõ mã + '#': vân tay kế tiếp chỉ so với slot của họ
+unsigned long verifySince = 0;
+FingerSession fingerSession(FINGER_SESSION_MS, FINGER_CONFIDENT, FINGER_CAPTURES);
+FingerStats fingerStats;        // confidence theo ID và kết quả phiên, lệnh finger_stats
+
+// Trạng thái giữ qua reset mềm/watchdog/panic, chụp lại từ loop() mỗi khi đổi.
+// Đổi layout thì tăng version của warmSnapshot.
+struct WarmState {
+    uint32_t lockoutElapsedMs;   // 0 = không bị khóa
+    uint32_t wrongPassCoalesced;
+    uint8_t failCount;
+    uint8_t wrongPassPending;
+    uint8_t doorUnlocked;        // đang ở menu (đã mở khóa) lúc chụp
+    uint8_t servoAngle;
+};
+RTC_NOINIT_ATTR RtcSnapshot<WarmState, 1> warmSnapshot;
+bool warmBoot = false;
+bool doorUnlocked = false;
+bool warmReportPending = false;  // warm_restart (+ door_locked nếu cửa đang mở) chờ MQTT
+bool relockedOnBoot = false;
+uint32_t resumeMs = 0;
+
+// Token bucket cho lệnh MQTT, thứ tự theo bit CommandClass: {sức chứa, ms nạp 1 token}.
+// Lệnh vượt mức bị bỏ ngay, trước mọi xử lý nặng (flash, LCD, delay).
+TokenBucket commandBuckets[] = {
+    {2, 5000},  // unlock
+    {3, 10000}, // config: đổi mật khẩu ghi flash + chặn LCD 2 s
+    {3, 20000}, // quản trị vân tay: enroll, hủy rồi thử lại ngay được
+    {4, 1000},  // chẩn đoán
+    {2, 30000}, // OTA: mỗi ota_begin cấp ~43KB và xóa phân vùng dự phòng
+    {2, 30000}, // dump_inputs: tới 128 bản tin mỗi lần
+};
+const char* const BUCKET_NAMES[] = {"unlock", "config", "finger", "diag", "ota", "dump"};
+constexpr uint8_t BUCKET_COUNT = sizeof(commandBuckets) / sizeof(commandBuckets[0]);
+
+// wrong_pass ra ngoài: tối đa 3 bản tin liền, sau đó 1 bản tin / 10 s.
+// Bản tin bị giữ được gộp lại và gửi bù từ loop() với failCount mới nhất.
+TokenBucket wrongPassBucket(3, 10000);
+bool wrongPassPending = false;
+uint32_t wrongPassCoalesced = 0;
+#ifdef LATENCY_BENCH
+LatencyBench latencyBench;
+#endif
+#ifdef INPUT_RECORDER
+InputRecorder inputRecorder;
+uint8_t lastWifiStatus = 0xFF;
+#endif
 
 // ===================== FORWARD DECLARATIONS =====================
 void handleMenu();
-void lcdMsg(const String &l1 = "", const String &l2 = "", const String &l3 = "", const String &l4 = "");
-void beep(int ms = 50);
+void lcdMsg(const char* l1 = "", const char* l2 = "", const char* l3 = "", const char* l4 = "");
 void openDoor();
 void closeDoor();
+void pollDoorEvents();
 int getNextFingerID();
 void openDoorMenu();
 void changePassword();
 void addFinger();
 void clearAllFingers();
+bool eraseAllFingers(bool showLcd);
 void resetPassword();
 void exitMenu();
-void FingerSearchMode();
+void showNetworkStatus();
+void reconnectNetwork();
+void showDiagnostics();
+void authFactor(AuthPipeline::Factor factor, bool ok, int fingerId);
+bool scheduleAllows(uint8_t subject);
+bool saveSchedule(uint8_t subject, const uint8_t* bits);
+void forgetFingerSlot(uint8_t id);
 void lockMenu();
 void mqttReconnect();
 void mqttCallback(char* topic, byte* payload, unsigned int length);
+void subscribeCommandTopics();
+bool setGroup(const char* group);
+bool publishEvent(const char* topic, const char* payload, bool retained = false);
+void finishRequest(bool ok, const char* event);
+void replyLan(const char* status, const char* event);
+void reportWrongPass();
+void reportStall();
+void flushWrongPass();
+char readKey(bool secret = false);
+int pollFinger();
+bool cancelEnroll();
 
 // ===================== HELPERS =====================
-void lcdMsg(const String &l1, const String &l2, const String &l3, const String &l4) {
+void clearInput() {
+    inputLen = 0;
+    inputPassword[0] = '\0';
+    otpEntry = false;
+}
+
+void setPassword(const char* newPass) {
+    strlcpy(password, newPass, sizeof(password));
+}
+
+void lcdMsg(const char* l1, const char* l2, const char* l3, const char* l4) {
+    BENCH_SPAN(BENCH_COST_I2C);
     lcd.clear();
     lcd.setCursor(0,0); lcd.print(l1);
     lcd.setCursor(0,1); lcd.print(l2);
@@ -83,13 +238,170 @@ void lcdMsg(const String &l1, const String &l2, const String &l3, const String &
     lcd.setCursor(0,3); lcd.print(l4);
 }
 
-void beep(int ms) {
-    digitalWrite(BUZZER_PIN, HIGH);
-    delay(ms);
-    digitalWrite(BUZZER_PIN, LOW);
+// Dòng cuối LCD báo tiến độ (enroll nền, chụp lại vân tay), không xóa PIN đang gõ ở dòng 2
+void lcdStatusLine(const char* text) {
+    BENCH_SPAN(BENCH_COST_I2C);
+    lcd.setCursor(0, 3);
+    lcd.print(LcdLine("%-20s", text).text);
+}
+
+// Publish nếu đang kết nối MQTT; thời gian publish (TLS) được tính vào LatencyBench.
+// Client WebSocket trong LAN nhận mọi sự kiện, kể cả khi mất broker
+bool publishEvent(const char* topic, const char* payload, bool retained) {
+#ifdef LAN_SERVER
+    lanServer.broadcast(topic, payload);
+#endif
+    if(!mqttClient.connected()) return false;
+    BENCH_SPAN(BENCH_COST_NET);
+    return mqttClient.publish(topic, payload, retained);
+}
+
+// Báo nhập sai, giới hạn bởi wrongPassBucket
+void reportWrongPass() {
+    if(wrongPassPending) wrongPassCoalesced++;
+    wrongPassPending = true;
+    flushWrongPass();
+}
+
+void flushWrongPass() {
+    if(!wrongPassPending) return;
+    if(!mqttClient.connected()) {
+        wrongPassPending = false; // offline thì bỏ như trước đây
+        return;
+    }
+    if(wrongPassBucket.available(millis()) == 0) return;
+    wrongPassBucket.take(millis());
+    wrongPassPending = false;
+    char payload[24];
+    formatWrongPass(payload, sizeof(payload), failCount);
+    publishEvent(topics.status, payload);
+}
+
+// Báo chỗ treo lần trước (sau reboot) hoặc MQTT bị bỏ đói quá NET_STALL_MS
+void reportStall() {
+    const StallRecord* r = stallWatchdog.pendingReport();
+    if(!r) return;
+    char payload[160];
+    snprintf(payload, sizeof(payload), "%s: %s %s site_pc=0x%08lx task_pc=0x%08lx stalled_ms=%lu uptime_s=%lu reset=%u",
+             EVT_STALL, StallWatchdog::channelName(r->channel), StallWatchdog::siteName(r->site),
+             (unsigned long)r->sitePc, (unsigned long)r->taskPc, (unsigned long)r->stalledMs,
+             (unsigned long)(r->uptimeMs / 1000), r->resetReason);
+    BLOG(STALL, StallWatchdog::channelName(r->channel), StallWatchdog::siteName(r->site), r->sitePc, r->taskPc,
+         r->stalledMs, r->resetReason);
+    if(publishEvent(topics.status, payload)) stallWatchdog.ackReport();
+}
+
+// ===================== WARM RESTART =====================
+void saveWarmState() {
+    WarmState s;
+    s.lockoutElapsedMs = lockoutTimer ? millis() - lockoutTimer : 0;
+    s.wrongPassCoalesced = wrongPassCoalesced;
+    s.failCount = failCount;
+    s.wrongPassPending = wrongPassPending;
+    s.doorUnlocked = doorUnlocked;
+    s.servoAngle = doorServo.angle();
+    warmSnapshot.save(s);
+}
+
+// Reset không do mất nguồn và snapshot còn nguyên: nạp lại bộ đếm sai, lockout,
+// wrong_pass chưa gửi. Cửa đang mở thì khóa lại (fail-secure) và báo door_locked.
+bool restoreWarmState(WarmState& s) {
+    if(esp_reset_reason() == ESP_RST_POWERON || !warmSnapshot.restore(s)) {
+        warmSnapshot.invalidate();
+        return false;
+    }
+    failCount = s.failCount;
+    wrongPassPending = s.wrongPassPending;
+    wrongPassCoalesced = s.wrongPassCoalesced;
+    if(s.lockoutElapsedMs) lockoutTimer = millis() - s.lockoutElapsedMs;
+    relockedOnBoot = s.doorUnlocked;
+    warmReportPending = true;
+    return true;
+}
+
+void reportWarmRestart() {
+    if(!warmReportPending) return;
+    char payload[64];
+    formatWarmRestart(payload, sizeof(payload), esp_reset_reason(), warmSnapshot.seq, resumeMs);
+    if(!publishEvent(topics.status, payload)) return;
+    if(relockedOnBoot) publishEvent(topics.status, EVT_DOOR_LOCKED);
+    warmReportPending = false;
+}
+
+// Mọi input phím/vân tay đi qua đây để InputRecorder ghi hoặc phát lại.
+// secret: phím có thể là chữ số của PIN / mã một lần / mật khẩu mới, recorder không ghi chữ số
+char readKey(bool secret) {
+    char key;
+    {
+        STALL_SCOPE(SITE_KEYPAD); // getKey() chờ thả phím
+        key = keypad.getKey();
+    }
+#ifdef INPUT_RECORDER
+    if(inputRecorder.replaying()) return inputRecorder.nextKey();
+    if(key != '\0') inputRecorder.recordKey(key, secret);
+#endif
+    return key;
+}
+
+// Chụp + khớp một ảnh nếu tới lượt: ID, 0 không khớp, -1 lỗi, NO_FINGER nếu không chụp
+int captureFinger() {
+#ifdef FINGER_TOUCH_PIN
+    // Chân touch báo có ngón tay, không tốn round trip UART khi cảm biến trống
+    if(digitalRead(FINGER_TOUCH_PIN) != FINGER_TOUCH_ACT) {
+        fingerLatched = false;
+        return AS608FingerSensor::NO_FINGER;
+    }
+    if(fingerLatched) return AS608FingerSensor::NO_FINGER;
+#else
+    if(millis() - lastFingerPoll < FINGER_POLL_MS) return AS608FingerSensor::NO_FINGER;
+    lastFingerPoll = millis();
+#endif
+    STALL_SCOPE(SITE_FINGER_SEARCH);
+    if(fingerLatched) {
+        fingerLatched = finger.present();
+        return AS608FingerSensor::NO_FINGER;
+    }
+    return verifyUser.code ? finger.tryVerify(verifyUser.first, verifyUser.count) : finger.trySearch();
+}
+
+// Quét vân tay không chặn, gọi mỗi vòng loop() cạnh bàn phím.
+// Mỗi lần đặt ngón là một phiên (FingerSession): ảnh xấu, không khớp hoặc khớp yếu thì chụp
+// lại ngay trong phiên. Trả NO_FINGER khi phiên chưa chốt; mỗi phiên chỉ cho một kết quả.
+int pollFinger() {
+#ifdef INPUT_RECORDER
+    if(inputRecorder.replaying()) {
+        int16_t replayed;
+        return inputRecorder.nextFinger(replayed) ? replayed : AS608FingerSensor::NO_FINGER;
+    }
+#endif
+    int capture = captureFinger();
+    uint32_t now = millis();
+    FingerSession::Verdict verdict = capture == AS608FingerSensor::NO_FINGER
+                                       ? fingerSession.poll(now)
+                                       : fingerSession.submit(capture, finger.confidence(), now);
+    if(verdict == FingerSession::PENDING) {
+        if(capture != AS608FingerSensor::NO_FINGER) lcdStatusLine(capture > 0 ? "Hold still..." : "Adjust finger...");
+        return AS608FingerSensor::NO_FINGER;
+    }
+    fingerLatched = true; // chờ nhấc ngón tay trước phiên sau
+    int id = fingerSession.id();
+    uint8_t captures = fingerSession.captures();
+    uint32_t ms = fingerSession.elapsed(now);
+    if(verdict == FingerSession::ACCEPT) fingerStats.recordAccept(id, fingerSession.confidence(), captures, ms);
+    else fingerStats.recordReject(captures);
+    BLOG(FINGER_SESSION, id, fingerSession.confidence(), captures, ms);
+    if(verifyUser.code) {
+        BLOG(FINGER_VERIFY, verifyUser.code, id);
+        verifyUser = {}; // mỗi lần gõ mã chỉ cho một lần đặt ngón tay
+    }
+#ifdef INPUT_RECORDER
+    inputRecorder.recordFinger(id);
+#endif
+    return id;
 }
 
 int getNextFingerID() {
+    STALL_SCOPE(SITE_FINGER_ADMIN);
     for(int id = 1; id <= 127; id++) {
         if(!finger.exists(id)) return id;
     }
@@ -97,41 +409,67 @@ int getNextFingerID() {
 }
 
 // ===================== MENU FUNCTIONS =====================
+// Servo tự đóng lại sau DOOR_OPEN_MS, menu vẫn nhận phím trong lúc cửa mở
 void openDoor() {
     lcdMsg("Door Opening...");
-    doorServo.write(90);
-    delay(3000);
-    closeDoor();
-    handleMenu();
+    doorServo.openFor(90, DOOR_OPEN_MS);
 }
 
 void closeDoor() {
-    doorServo.write(0);
+    doorServo.moveTo(0);
+}
+
+// Báo trạng thái servo lên MQTT; gọi từ mọi vòng lặp chờ
+void pollDoorEvents() {
+    switch(doorServo.pollEvent()) {
+        case ServoPWM180::OPENED:   publishEvent(topics.status, EVT_DOOR_OPENED); break;
+        case ServoPWM180::RELOCKED: publishEvent(topics.status, EVT_DOOR_CLOSED); break;
+        default: break;
+    }
 }
 
 void changePassword() {
     lcdMsg("New Pass:");
-    String newPass = "";
-    while(newPass.length() < 4) {
-        char k = keypad.getKey();
+    char newPass[PASS_LEN + 1];
+    uint8_t len = 0;
+    unsigned long lastKey = millis();
+    while(len < PASS_LEN) {
+        pollDoorEvents();
+        char k = readKey(true);
         if(k >= '0' && k <= '9') {
-            newPass += k;
-            lcd.setCursor(newPass.length(), 1);
+            newPass[len++] = k;
+            lcd.setCursor(len, 1);
             lcd.print("*");
-            beep(30);
+            buzzer.play(Beep::KEYPRESS);
+            lastKey = millis();
+            stallWatchdog.beat(HB_LOOP); // gõ chậm 4 phím vẫn không chạm LOOP_STALL_MS
+        }
+        // Bỏ đi giữa chừng: giữ mật khẩu cũ, không chờ tới khi watchdog coi loop là treo
+        if(millis() - lastKey >= INPUT_TIMEOUT_MS) {
+            lcdMsg("Timeout", "Pass unchanged");
+            buzzer.play(Beep::FAILURE, true);
+            delay(500);
+            return;
         }
     }
-    password = newPass;
+    newPass[len] = '\0';
+    setPassword(newPass);
     prefs.putString("password", newPass);
-    if(mqttClient.connected()) {
-        mqttClient.publish(TOPIC_STATUS, "password_changed");
-    }
+    publishEvent(topics.status, EVT_PASSWORD_CHANGED);
     lcdMsg("Pass Changed!");
     delay(500);
-    handleMenu();
+}
+
+void resetPassword() {
+    setPassword(DEFAULT_PASSWORD);
+    prefs.putString("password", password);
+    publishEvent(topics.status, EVT_PASSWORD_CHANGED);
+    lcdMsg("Pass Reset!", "Default: " DEFAULT_PASSWORD);
+    delay(1000);
 }
 
 void addFinger() {
+    cancelEnroll(); // menu dùng cảm biến chặn, job nền không chạy tiếp được
     lcdMsg("Add Finger...");
     int id = getNextFingerID();
     if(id == -1) {
@@ -139,39 +477,56 @@ void addFinger() {
         delay(500);
         return;
     }
-    bool success = finger.enroll(id);
+    bool success;
+    {
+        STALL_SCOPE(SITE_FINGER_ENROLL);
+        success = finger.enroll(id, ENROLL_TIMEOUT_MS);
+    }
     lcdMsg(success ? "Add Success" : "Add Fail");
-    if(mqttClient.connected()) {
-        String payload;
-        if (success) {
-            payload = "add_success\nnew_id: " + String(id);
-        } else {
-            payload = "add_fail";
-        }
-        mqttClient.publish(TOPIC_FINGER, payload.c_str());
+    if (success) {
+        forgetFingerSlot(id);
+        char payload[40];
+        formatAddSuccess(payload, sizeof(payload), id);
+        publishEvent(topics.finger, payload);
+    } else {
+        publishEvent(topics.finger, EVT_ADD_FAIL);
     }
     delay(500);
-    handleMenu();
+}
+
+// Xóa toàn bộ template; showLcd = false khi chạy trong lô lệnh
+bool eraseAllFingers(bool showLcd) {
+    if(showLcd) lcdMsg("Clear all fingers...");
+    bool success;
+    {
+        STALL_SCOPE(SITE_FINGER_ADMIN);
+        success = (finger.emptyDatabase() == 0);
+    }
+    BLOG(CLEAR_FINGERS, success ? "OK" : "FAIL");
+    if(success) {
+        fingerStats.clear();
+        for(uint8_t id = 1; id < AccessSchedule::SUBJECTS; id++) {
+            if(schedules.restricted(id)) saveSchedule(id, nullptr);
+        }
+    }
+    if(showLcd) {
+        delay(200);
+        lcdMsg(success ? "OK" : "Fail");
+        delay(200);
+    }
+    return success;
 }
 
 void clearAllFingers() {
-    Serial.printf("Clear all fingers...");
-    lcdMsg("Clear all fingers...");
-    bool success = (finger.emptyDatabase() == 0);
-    if(mqttClient.connected()) {
-        mqttClient.publish(TOPIC_FINGER, success ? "clear_all_fingers_success" : "clear_all_fingers_fail");
-    }
-    delay(200);
-    Serial.printf("Clear all fingers: %s\n", success ? "OK" : "FAIL");
-    lcdMsg(success ? "OK" : "Fail");
-    delay(200);
+    bool success = eraseAllFingers(true);
+    publishEvent(topics.finger, success ? EVT_CLEAR_SUCCESS : EVT_CLEAR_FAIL);
     lockMenu();
 }
 
 void exitMenu() {
-    if(mqttClient.connected()) {
-        mqttClient.publish(TOPIC_STATUS, "door_locked");
-    }
+    menuExitRequested = true;
+    doorUnlocked = false;
+    publishEvent(topics.status, EVT_DOOR_LOCKED);
     lcdMsg("Exit Menu");
     delay(500);
     ledGreen.off();
@@ -180,83 +535,178 @@ void exitMenu() {
 }
 
 void lockMenu() {
+    verifyUser = {};
+    fingerSession.reset();
     lcd.clear();
-    lcdMsg("Enter Password:","","" ,"Press # for finger");
+    lcdMsg("Enter Password:", "", "", auth.policy() == AuthPipeline::BOTH ? "+ finger (2FA)" : "or scan finger");
+}
+
+// Chờ phím bất kỳ hoặc hết thời gian, dùng cho các màn hình thông tin
+void waitKeyOrTimeout(unsigned long ms) {
+    unsigned long start = millis();
+    while(millis() - start < ms) {
+        pollDoorEvents();
+        if(readKey() != '\0') return;
+    }
+}
+
+void showNetworkStatus() {
+    bool wifi = WiFi.status() == WL_CONNECTED;
+    IPAddress ip = WiFi.localIP();
+    lcdMsg(wifi ? "WiFi: OK" : "WiFi: --",
+           wifi ? LcdLine("%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]).text : "",
+           wifi ? LcdLine("RSSI: %d dBm", (int)WiFi.RSSI()).text : "",
+           mqttClient.connected() ? "MQTT: OK" : "MQTT: --");
+    waitKeyOrTimeout(5000);
+}
+
+void reconnectNetwork() {
+    lcdMsg("Reconnecting MQTT...");
+    mqttClient.disconnect();
+    lastMqttAttempt = millis() - mqttRetryInterval;
+    if(WiFi.status() == WL_CONNECTED) mqttReconnect();
+    lcdMsg(mqttClient.connected() ? "MQTT: OK" : "MQTT: failed");
+    delay(1000);
+}
+
+void showDiagnostics() {
+    heapTracker.sample();
+    lcdMsg(LcdLine("Uptime: %lus", millis() / 1000).text,
+           LcdLine("Heap: %lu/%lu", (unsigned long)heapTracker.freeBytes(), (unsigned long)heapTracker.largestBlock()).text,
+           LcdLine("Frag: %u%% max %u%%", heapTracker.fragmentation(), heapTracker.worstFragmentation()).text,
+           LcdLine("Fails:%u Door:%d", failCount, doorServo.angle()).text);
+    waitKeyOrTimeout(5000);
 }
 
 // ===================== MENU HANDLER =====================
-struct MenuItem { 
-    String title; 
-    void (*callback)(); 
+// Toàn bộ cây menu nằm trong flash; trang LCD và bảng phím tính lúc biên dịch
+using MenuTree::NO_SUBMENU;
+
+enum MenuId : uint8_t { MENU_ROOT, MENU_USERS, MENU_FINGERS, MENU_NETWORK, MENU_DIAG };
+
+constexpr MenuTree::Item ROOT_ITEMS[] = {
+    {'1', "OpenDoor", openDoor, NO_SUBMENU},
+    {'2', "Users", nullptr, MENU_USERS},
+    {'3', "Fingerprints", nullptr, MENU_FINGERS},
+    {'4', "Exit", exitMenu, NO_SUBMENU},
+    {'5', "Network", nullptr, MENU_NETWORK},
+    {'6', "Diagnostics", nullptr, MENU_DIAG},
+};
+constexpr MenuTree::Item USERS_ITEMS[] = {
+    {'1', "ChangePass", changePassword, NO_SUBMENU},
+    {'2', "ResetPass", resetPassword, NO_SUBMENU},
+    {'*', "Back", nullptr, MENU_ROOT},
+};
+constexpr MenuTree::Item FINGERS_ITEMS[] = {
+    {'1', "AddFinger", addFinger, NO_SUBMENU},
+    {'2', "ClearAll", clearAllFingers, NO_SUBMENU},
+    {'*', "Back", nullptr, MENU_ROOT},
+};
+constexpr MenuTree::Item NETWORK_ITEMS[] = {
+    {'1', "Status", showNetworkStatus, NO_SUBMENU},
+    {'2', "Reconnect", reconnectNetwork, NO_SUBMENU},
+    {'*', "Back", nullptr, MENU_ROOT},
 };
+constexpr MenuTree::Item DIAG_ITEMS[] = {
+    {'1', "System", showDiagnostics, NO_SUBMENU},
+    {'*', "Back", nullptr, MENU_ROOT},
+};
+
+static_assert(MenuTree::validKeys(ROOT_ITEMS) && MenuTree::validKeys(USERS_ITEMS) &&
+              MenuTree::validKeys(FINGERS_ITEMS) && MenuTree::validKeys(NETWORK_ITEMS) &&
+              MenuTree::validKeys(DIAG_ITEMS), "menu key missing or bound twice");
+
+constexpr auto ROOT_PAGES = MenuTree::render("MENU", ROOT_ITEMS);
+constexpr auto USERS_PAGES = MenuTree::render("USERS", USERS_ITEMS);
+constexpr auto FINGERS_PAGES = MenuTree::render("FINGERS", FINGERS_ITEMS);
+constexpr auto NETWORK_PAGES = MenuTree::render("NETWORK", NETWORK_ITEMS);
+constexpr auto DIAG_PAGES = MenuTree::render("DIAGNOSTICS", DIAG_ITEMS);
 
-MenuItem menuItems[] = {
-    {"1:OpenDoor", openDoor},
-    {"2:ChangePass", changePassword},
-    {"3:AddFinger", addFinger},
-    {"4:Exit", exitMenu}
+// Thứ tự theo MenuId
+constexpr MenuTree::Menu MENUS[] = {
+    MenuTree::describe(ROOT_ITEMS, ROOT_PAGES),
+    MenuTree::describe(USERS_ITEMS, USERS_PAGES),
+    MenuTree::describe(FINGERS_ITEMS, FINGERS_PAGES),
+    MenuTree::describe(NETWORK_ITEMS, NETWORK_PAGES),
+    MenuTree::describe(DIAG_ITEMS, DIAG_PAGES),
 };
 
+struct MenuCursor {
+    uint8_t menu;
+    uint8_t page;
+};
+
+// Ghi đè 4 dòng đã pad sẵn, không cần lcd.clear()
+void drawMenuPage(const MenuCursor &cursor) {
+    BENCH_SPAN(BENCH_COST_I2C);
+    const MenuTree::Line *rows = MENUS[cursor.menu].pages[cursor.page];
+    for(uint8_t row = 0; row < MenuTree::ROWS; row++) {
+        lcd.setCursor(0, row);
+        lcd.print(rows[row].text);
+    }
+}
+
 void handleMenu() {
+    finishRequest(true, EVT_DOOR_UNLOCKED); // unlock từ MQTT: done = lúc mở khóa, không phải lúc thoát menu
+    auth.reset(); // bỏ yếu tố 2FA đang giữ nếu cửa được mở bằng đường khác
+
+    doorUnlocked = true;
     ledGreen.on();
     ledRed.off();
-    beep(100);
+    buzzer.play(Beep::MENU);
 
-    const uint8_t itemsPerPage = 3;  
-    const uint8_t totalItems = sizeof(menuItems)/sizeof(MenuItem);
-    const uint8_t totalPages = (totalItems + itemsPerPage - 1) / itemsPerPage;
-
-    uint8_t page = 0;
-    unsigned long lastScroll = 0;
     const unsigned long scrollInterval = 3000;
-    unsigned long lastActivity = millis();
     const unsigned long menuTimeout = 10000;
 
-    if(mqttClient.connected() && firsttimeEnteringMenu == true) {
-        mqttClient.publish(TOPIC_STATUS, "door_unlocked");
+    if(firsttimeEnteringMenu == true) {
+        publishEvent(topics.status, EVT_DOOR_UNLOCKED);
         firsttimeEnteringMenu = false;
     }
 
-    // Hiển thị menu page hiện tại
-    auto showPage = [&]() {
-        lcd.clear();
-        lcd.setCursor(0,0);
-        lcd.print("========MENU========");
+    // Mở khóa xong và đã báo door_unlocked: kết thúc mẫu đo của đường xác thực đang chạy
+    BENCH_END(BENCH_KEYPAD_PIN);
+    BENCH_END(BENCH_REMOTE_UNLOCK);
+    BENCH_END(BENCH_FINGER_MATCH);
+    BENCH_END(BENCH_FINGER_VERIFY);
 
-        uint8_t start = page * itemsPerPage;
-        for(uint8_t i = 0; i < itemsPerPage; i++) {
-            uint8_t idx = start + i;
-            if(idx < totalItems) {
-                lcd.setCursor(0, i+1);
-                lcd.print(menuItems[idx].title);
-            }
-        }
-    };
-
-    showPage();
+    MenuCursor cursor = {MENU_ROOT, 0};
+    menuExitRequested = false;
+    unsigned long lastScroll = millis();
+    unsigned long lastActivity = millis();
+    drawMenuPage(cursor);
 
+    STALL_SCOPE(SITE_MENU);
     while(true) {
-        // 1. Đọc phím liên tục
-        char key = keypad.getKey();
-        if(key != '\0') {
-            for(uint8_t i = 0; i < totalItems; i++) {
-                if(key == menuItems[i].title[0]) {
-                    menuItems[i].callback();
-                    return;
-                }
+        stallWatchdog.beat(HB_LOOP); // menu vẫn chạy, chỉ treo khi một action chặn
+        saveWarmState();
+        pollDoorEvents();
+
+        // 1. Đọc phím, tra bảng phím của menu hiện tại
+        int8_t k = MenuTree::keyIndex(readKey());
+        int8_t idx = k >= 0 ? MENUS[cursor.menu].keyTable[k] : -1;
+        if(idx >= 0) {
+            const MenuTree::Item &item = MENUS[cursor.menu].items[idx];
+            if(item.submenu != NO_SUBMENU) {
+                cursor = {item.submenu, 0};
+            } else {
+                item.action();
+                if(menuExitRequested) return;
             }
+            drawMenuPage(cursor);
+            lastScroll = lastActivity = millis();
         }
 
-        // 2. Scroll menu mỗi scrollInterval
-        if(millis() - lastScroll >= scrollInterval) {
-            page = (page + 1) % totalPages;
-            showPage();
+        // 2. Scroll menu mỗi scrollInterval, chỉ vẽ lại khi có nhiều trang
+        const uint8_t pageCount = MENUS[cursor.menu].pageCount;
+        if(pageCount > 1 && millis() - lastScroll >= scrollInterval) {
+            cursor.page = (cursor.page + 1) % pageCount;
+            drawMenuPage(cursor);
             lastScroll = millis();
         }
 
         // 3. Kiểm tra timeout
         if(millis() - lastActivity >= menuTimeout) {
-            Serial.println("Menu timeout - auto exiting");
+            BLOG(MENU_TIMEOUT);
             lcdMsg("Timeout", "Auto exiting...");
             delay(1000);
             exitMenu();
@@ -267,131 +717,996 @@ void handleMenu() {
     }
 }
 
-// ===================== FINGER MODE =====================
-void FingerSearchMode() {
-    int id=finger.search();
-    if(id>0){
-        lcdMsg("Finger OK!");
-        beep(100);
-        failCount=0;
-        if(mqttClient.connected()) {
-            mqttClient.publish(TOPIC_FINGER,("check_success\nID_found: " + String(id)).c_str());
+// ===================== AUTH =====================
+// Kết quả của một yếu tố xác thực (PIN đủ 4 số, mã một lần hoặc một lần đặt ngón tay)
+void authFactor(AuthPipeline::Factor factor, bool ok, int fingerId) {
+    bool isFinger = factor == AuthPipeline::FINGER;
+    bool isOtp = factor == AuthPipeline::OTP;
+    if(isFinger) {
+        char payload[40];
+        if(ok) formatCheckSuccess(payload, sizeof(payload), fingerId);
+        publishEvent(topics.finger, ok ? payload : EVT_CHECK_FAIL);
+    }
+    if(isFinger) BLOG(FINGER_RESULT, fingerId);
+    else if(isOtp) {} // checkOtp() đã log
+    else if(ok) BLOG(PIN_OK);
+    else BLOG(PIN_WRONG, failCount + 1);
+
+    // Đúng nhưng ngoài lịch: từ chối, không tính là nhập sai. Mã một lần đã tự giới hạn thời gian
+    uint8_t subject = isFinger ? fingerId : AccessSchedule::SUBJECT_PIN;
+    if(ok && !isOtp && !scheduleAllows(subject)) {
+        char event[32];
+        formatSchedule(event, sizeof(event), EVT_SCHEDULE_DENIED, subject);
+        BLOG(SCHEDULE_DENIED, subject, timeSynced);
+        publishEvent(topics.status, event);
+        auth.reset();
+        lcdMsg("Not Allowed Now", timeSynced ? "Outside schedule" : "Clock not synced");
+        ledGreen.off();
+        buzzer.play(Beep::FAILURE, true);
+        clearInput();
+        delay(500);
+        lockMenu();
+        return;
+    }
+
+    switch(auth.submit(factor, ok, millis())) {
+        case AuthPipeline::GRANTED:
+            lcdMsg(isFinger ? "Finger OK!" : isOtp ? "Code OK!" : "Correct Pass!");
+            buzzer.play(Beep::SUCCESS, true);
+            ledGreen.on();
+            ledRed.off();
+            clearInput();
+            failCount = 0;
+            if(!isFinger) delay(500);
+            firsttimeEnteringMenu = true;
+            handleMenu();
+            break;
+        case AuthPipeline::PENDING:
+            // 2FA: giữ yếu tố đầu, chờ yếu tố còn lại trong WINDOW_MS
+            BLOG(AUTH_PENDING, isFinger ? "finger" : "pin");
+            if(isFinger) lcdMsg("Enter Password:", "", "Finger OK");
+            else lcdMsg("Scan Finger...", "", "Password OK");
+            buzzer.play(Beep::SCAN);
+            ledGreen.breathe(1200);
+            break;
+        case AuthPipeline::DENIED:
+            lcdMsg(isFinger ? "Finger Not Found" : isOtp ? "Wrong Code!" : "Wrong Pass!");
+            ledGreen.off();
+            failCount++;
+            buzzer.play(failCount >= MAX_FAIL_COUNT ? Beep::LOCKOUT : Beep::FAILURE, true);
+            reportWrongPass();
+            clearInput();
+            if(!isFinger) delay(500);
+            lockMenu();
+            break;
+    }
+}
+
+// ===================== ONE-TIME CODE =====================
+// '*' + 6 số: kiểm tra TOTP tại chỗ theo đồng hồ SNTP, không cần mạng.
+// Mã đúng ghi bước đã dùng vào flash trước khi mở để mã không dùng lại được kể cả sau reset
+void checkOtp() {
+    time_t now = time(nullptr);
+    if(now < TIME_VALID_AFTER) {
+        // Chưa có giờ: không phải lỗi của người nhập, không tính là sai
+        BLOG(OTP_RESULT, "no_clock", 0);
+        clearInput();
+        lcdMsg("Code Unavailable", "Clock not synced");
+        buzzer.play(Beep::FAILURE, true);
+        delay(500);
+        lockMenu();
+        return;
+    }
+    Totp::Result result;
+    {
+        BENCH_SCOPE(BENCH_OTP_VERIFY);
+        result = totp.verify(inputPassword, now);
+    }
+#ifdef INPUT_RECORDER
+    result = (Totp::Result)inputRecorder.verdict(result);
+#endif
+    clearInput();
+    if(result != Totp::OK) {
+        BLOG(OTP_RESULT, result == Totp::REPLAYED ? "replayed" : "wrong", totp.lastStep());
+        authFactor(AuthPipeline::OTP, false, 0);
+        return;
+    }
+    prefs.putUInt("totp_last", totp.lastStep());
+    BLOG(OTP_RESULT, "ok", totp.lastStep());
+    char event[32];
+    formatOtpUsed(event, sizeof(event), totp.lastStep());
+    publishEvent(topics.status, event);
+    authFactor(AuthPipeline::OTP, true, 0);
+}
+
+// ===================== FINGER USERS =====================
+// Mã người dùng + '#': vân tay kế tiếp chỉ được so với slot của người đó (1:1).
+// Mã không có trong bảng không tính là nhập sai: mã không phải bí mật
+void selectFingerUser(uint16_t code) {
+    clearInput();
+    const FingerUsers::User* user = fingerUsers.find(code);
+    if(!user) {
+        BLOG(FINGER_USER_UNKNOWN, code);
+        lcdMsg("Unknown User");
+        buzzer.play(Beep::FAILURE, true);
+        delay(500);
+        lockMenu();
+        return;
+    }
+    verifyUser = *user;
+    verifySince = millis();
+    lcdMsg("Scan Finger...", LcdLine("User %u", code).text);
+    buzzer.play(Beep::SCAN);
+}
+
+void loadFingerUsers() {
+    if(prefs.getBytes("finger_users", fingerUsers.raw(), FingerUsers::RAW_SIZE) == FingerUsers::RAW_SIZE)
+        fingerUsers.sanitize();
+    else
+        fingerUsers = FingerUsers();
+}
+
+// ===================== ACCESS SCHEDULE =====================
+// Lịch của chủ thể (0 = PIN, 1-127 = ID vân tay) cho phép lúc này không.
+// Quyết định tại chỗ, không hỏi broker; chưa đồng bộ giờ thì chủ thể có lịch bị từ chối.
+bool scheduleAllows(uint8_t subject) {
+    BENCH_SCOPE(BENCH_ACCESS_RULE);
+    if(!schedules.restricted(subject)) return true;
+    time_t now = time(nullptr);
+    tm local;
+    if(now < TIME_VALID_AFTER || !localtime_r(&now, &local)) return false;
+    return schedules.allowed(subject, AccessSchedule::slotOf(local));
+}
+
+void loadSchedules() {
+    uint8_t bits[AccessSchedule::BYTES];
+    char key[6];
+    for(uint8_t subject = 0; subject < AccessSchedule::SUBJECTS; subject++) {
+        snprintf(key, sizeof(key), "s%u", subject);
+        if(schedulePrefs.getBytes(key, bits, sizeof(bits)) == sizeof(bits)) schedules.set(subject, bits);
+    }
+    BLOG(SCHEDULES_LOADED, schedules.count());
+}
+
+// bits = nullptr: bỏ lịch của chủ thể
+bool saveSchedule(uint8_t subject, const uint8_t* bits) {
+    char key[6];
+    snprintf(key, sizeof(key), "s%u", subject);
+    if(!bits) {
+        schedules.clear(subject);
+        return !schedulePrefs.isKey(key) || schedulePrefs.remove(key);
+    }
+    schedules.set(subject, bits);
+    return schedulePrefs.putBytes(key, bits, AccessSchedule::BYTES) == AccessSchedule::BYTES;
+}
+
+// Slot vừa enroll lại: lịch và thống kê của người cũ không được chuyển sang người mới
+void forgetFingerSlot(uint8_t id) {
+    fingerStats.forget(id);
+    if(schedules.restricted(id)) saveSchedule(id, nullptr);
+}
+
+void pollTimeSync() {
+    if(timeSynced || time(nullptr) < TIME_VALID_AFTER) return;
+    timeSynced = true;
+    BLOG(TIME_SYNCED, (uint32_t)time(nullptr));
+}
+
+// "any" | "both" -> chính sách, false nếu sai
+bool parseAuthPolicy(const char* arg, AuthPipeline::Policy& policy) {
+    if(strcmp(arg, AUTH_POLICY_ANY) == 0) policy = AuthPipeline::ANY;
+    else if(strcmp(arg, AUTH_POLICY_BOTH) == 0) policy = AuthPipeline::BOTH;
+    else return false;
+    return true;
+}
+
+void setAuthPolicy(AuthPipeline::Policy policy) {
+    auth.setPolicy(policy);
+    prefs.putUChar("auth_policy", policy);
+    BLOG(AUTH_POLICY, policy == AuthPipeline::BOTH ? AUTH_POLICY_BOTH : AUTH_POLICY_ANY);
+}
+
+// ===================== RATE LIMIT =====================
+TokenBucket* bucketFor(uint8_t cls) {
+    return cls ? &commandBuckets[__builtin_ctz(cls)] : nullptr;
+}
+
+bool admitCommand(const char* cmd) {
+    TokenBucket* bucket = bucketFor(commandClass(cmd));
+    return !bucket || bucket->take(millis());
+}
+
+// Một lô là một bản tin: lấy một token của mỗi nhóm lệnh có trong lô, đủ hết mới nhận
+bool admitBatch(char* const* ops, uint8_t count) {
+    uint8_t classes = 0;
+    for(uint8_t i = 0; i < count; i++) classes |= commandClass(ops[i]);
+    uint32_t now = millis();
+    for(uint8_t b = 0; b < BUCKET_COUNT; b++) {
+        if((classes & (1 << b)) && commandBuckets[b].available(now) == 0) {
+            commandBuckets[b].take(now); // tính là bị bỏ
+            return false;
+        }
+    }
+    for(uint8_t b = 0; b < BUCKET_COUNT; b++)
+        if(classes & (1 << b)) commandBuckets[b].take(now);
+    return true;
+}
+
+void publishMetrics() {
+    char json[544]; // mọi bộ đếm 10 chữ số vẫn vừa (~520 byte); thực tế ~400 byte, vừa buffer MQTT
+    int n = snprintf(json, sizeof(json), "{");
+    for(uint8_t b = 0; b < BUCKET_COUNT; b++) {
+        n += snprintf(json + n, sizeof(json) - n, "\"%s\":{\"ok\":%lu,\"shed\":%lu},", BUCKET_NAMES[b],
+                      (unsigned long)commandBuckets[b].accepted(), (unsigned long)commandBuckets[b].shed());
+    }
+    n += snprintf(json + n, sizeof(json) - n, "\"wrong_pass\":{\"sent\":%lu,\"coalesced\":%lu},\"dup\":%lu,",
+                  (unsigned long)wrongPassBucket.accepted(), (unsigned long)wrongPassCoalesced,
+                  (unsigned long)requestCache.hits());
+#ifdef LAN_SERVER
+    n += snprintf(json + n, sizeof(json) - n, "\"lan\":{\"ws\":%u,\"bad_token\":%lu,\"dropped\":%lu},",
+                  lanServer.eventClients(), (unsigned long)lanServer.authFailures(),
+                  (unsigned long)lanServer.droppedFrames());
+#endif
+    heapTracker.sample();
+    n += snprintf(json + n, sizeof(json) - n, "\"heap\":");
+    n += heapTracker.toJson(json + n, sizeof(json) - n);
+    snprintf(json + n, sizeof(json) - n, "}");
+    publishEvent(topics.metrics, json);
+}
+
+// Tổng hợp phiên rồi các ID gộp vào ít bản tin nhất vừa buffer MQTT (~20 ID mỗi bản tin, tối đa 7 bản tin)
+void publishFingerStats() {
+    char json[480];
+    fingerStats.summaryJson(json, sizeof(json));
+    publishEvent(topics.metrics, json);
+    for(uint8_t next = 1; next <= FingerStats::MAX_ID;) {
+        if(fingerStats.idsJson(next, json, sizeof(json)) > 0) publishEvent(topics.metrics, json);
+    }
+}
+
+// ===================== MQTT COMMANDS =====================
+// Mọi lệnh MQTT đi qua runCommand(); lệnh đơn và lô lệnh chỉ khác cách báo kết quả
+enum RunMode : uint8_t {
+    RUN_SINGLE,   // lệnh đơn: LCD/còi đầy đủ, publish kết quả riêng
+    RUN_BATCH,    // trong lô: chỉ đổi trạng thái, kết quả gộp vào batch_result
+    RUN_VALIDATE, // chỉ kiểm tra cú pháp, không chạy
+};
+
+struct CommandResult {
+    bool ok;
+    const char* topic; // nullptr: không có gì để publish
+    const char* event;
+};
+
+// ===================== REMOTE ENROLL =====================
+
+// Bắt đầu job enroll nền; slot = 0 chọn ô trống đầu tiên. Trả sự kiện cho runCommand
+CommandResult startEnroll(uint16_t slot) {
+    static char event[40];
+    const char* error = nullptr;
+    int id = slot;
+    if(enrollJob.active()) error = "busy";
+    else if(id == 0 && (id = getNextFingerID()) < 0) error = "full";
+    else if(slot != 0 && finger.exists(slot)) error = "slot_used"; // không ghi đè vân tay đang dùng
+    if(error) {
+        formatEnrollFailed(event, sizeof(event), error);
+        return {false, topics.finger, event};
+    }
+    enrollJob.begin(id, millis());
+    fingerSession.reset(); // cảm biến thuộc về job
+    BLOG(ENROLL_START, id);
+    lcdStatusLine(LcdLine("Enroll #%d: place", id).text);
+    buzzer.play(Beep::SCAN);
+    formatEnrollId(event, sizeof(event), EVT_ENROLL_PLACE, id);
+    return {true, topics.finger, event};
+}
+
+// Hủy job đang chạy và báo enroll_failed: cancelled; false nếu không có job
+bool cancelEnroll() {
+    if(!enrollJob.active()) return false;
+    enrollJob.cancel(millis());
+    char event[40];
+    formatEnrollFailed(event, sizeof(event), enrollJob.error());
+    BLOG(ENROLL_PHASE, event);
+    publishEvent(topics.finger, event);
+    lcdStatusLine("Enroll cancelled");
+    return true;
+}
+
+// Một bước của job enroll, báo pha mới lên topic fingerprint
+void pollEnroll() {
+    bool changed;
+    {
+        STALL_SCOPE(SITE_FINGER_ENROLL);
+        changed = enrollJob.poll(millis());
+    }
+    if(!changed) return;
+    char event[40];
+    switch(enrollJob.phase()) {
+        case EnrollJob::REMOVE:
+            strlcpy(event, EVT_ENROLL_REMOVE, sizeof(event));
+            lcdStatusLine("Enroll: lift finger");
+            buzzer.play(Beep::SCAN);
+            break;
+        case EnrollJob::PLACE_AGAIN:
+            strlcpy(event, EVT_ENROLL_PLACE_AGAIN, sizeof(event));
+            lcdStatusLine("Enroll: place again");
+            buzzer.play(Beep::SCAN);
+            break;
+        case EnrollJob::STORED:
+            formatEnrollId(event, sizeof(event), EVT_ENROLL_STORED, enrollJob.id());
+            lcdStatusLine(LcdLine("Enroll #%u stored", enrollJob.id()).text);
+            forgetFingerSlot(enrollJob.id());
+            buzzer.play(Beep::SUCCESS);
+            fingerLatched = true; // ngón tay vừa enroll còn trên cảm biến, không được mở khóa
+            break;
+        case EnrollJob::FAILED:
+            formatEnrollFailed(event, sizeof(event), enrollJob.error());
+            lcdStatusLine("Enroll failed");
+            buzzer.play(Beep::FAILURE);
+            fingerLatched = true;
+            break;
+        default:
+            return;
+    }
+    BLOG(ENROLL_PHASE, event);
+    publishEvent(topics.finger, event);
+}
+
+CommandResult runChangePassword(const char* arg, RunMode mode) {
+    char newPass[PASS_LEN + 1];
+    PasswordCheck check = parseNewPassword(arg, newPass);
+    if(check.error) {
+        if(mode != RUN_VALIDATE) {
+            if(check.badIndex < 0) BLOG(PASS_BAD_LENGTH, (unsigned)check.len);
+            else BLOG(PASS_BAD_CHAR, check.badIndex, (uint8_t)check.badChar);
         }
-        firsttimeEnteringMenu = true;
-        handleMenu();
-    } else {
-        lcdMsg("Finger Not Found");
-        beep(200);
-        failCount++;
-        if(mqttClient.connected()) {
-            mqttClient.publish(TOPIC_FINGER,"check_fail\nID_not_found");
-            mqttClient.publish(TOPIC_STATUS, ("wrong_pass: " + String(failCount)).c_str());
+        return {false, topics.status, check.error};
+    }
+    if(mode == RUN_VALIDATE) return {true, topics.status, EVT_PASSWORD_CHANGED};
+
+    bool saved = prefs.putString("password", newPass) == strlen(newPass);
+    BLOG(PASS_CHANGED, saved);
+    // Ghi flash lỗi: giữ mật khẩu cũ, nếu không reset sẽ âm thầm quay về mật khẩu cũ
+    if(!saved) {
+        if(mode == RUN_SINGLE) {
+            // Báo kết quả và ack trước, phần LCD/còi bên dưới chặn ~1 s
+            publishEvent(topics.status, EVT_PASSWORD_ERROR_SAVE);
+            finishRequest(false, EVT_PASSWORD_ERROR_SAVE);
+            lcdMsg("Password Not Saved", "Flash error");
+            buzzer.play(Beep::FAILURE, true);
+            delay(1000);
+            lockMenu();
+            return {false, nullptr, EVT_PASSWORD_ERROR_SAVE};
         }
+        return {false, topics.status, EVT_PASSWORD_ERROR_SAVE};
+    }
+    setPassword(newPass);
+
+    if(mode == RUN_SINGLE) {
+        // Như trên: dashboard nhận password_changed và ack ngay, không chờ 2 s hiển thị
+        publishEvent(topics.status, EVT_PASSWORD_CHANGED);
+        finishRequest(true, EVT_PASSWORD_CHANGED);
+    }
+    BENCH_END(BENCH_CHANGE_PASSWORD); // mẫu dừng sau ghi flash và publish, không gồm phần hiển thị
+    if(mode == RUN_SINGLE) {
+        lcdMsg("Password Changed", LcdLine("New: %s", password).text);
+        buzzer.play(Beep::SUCCESS, true);
+        delay(2000);
+        // Quay về màn hình khóa
+        clearInput();
+        failCount = 0;
         lockMenu();
+        return {true, nullptr, EVT_PASSWORD_CHANGED};
     }
+    return {true, topics.status, EVT_PASSWORD_CHANGED};
 }
 
-// ===================== MQTT CALLBACK =====================
-void mqttCallback(char* topic, byte* payload, unsigned int length){
-    String msg;
-    for(unsigned int i=0;i<length;i++) msg += (char)payload[i];
-    Serial.printf("📨 MQTT IN [%s] => %s\n", topic, msg.c_str());
-    // Xử lý mở cửa
-    if(msg == "unlock") {
+CommandResult runCommand(const char* cmd, RunMode mode) {
+    static char eventBuf[GROUP_LEN + 16];
+
+    // Xử lý mở cửa (menu chặn tới khi thoát nên không chạy trong lô)
+    if(strcmp(cmd, CMD_UNLOCK) == 0) {
+        if(mode != RUN_SINGLE) return {false, topics.status, EVT_NOT_BATCHABLE};
+        BENCH_BEGIN(BENCH_REMOTE_UNLOCK);
         handleMenu();
         firsttimeEnteringMenu = true;
+        return {true, nullptr, nullptr};
     }
     // Xử lý xóa vân tay
-    if(msg == "clear_all_fingers") {
-        Serial.println("→ Processing CLEAR ALL FINGERS command from MQTT");
-        clearAllFingers();
+    if(strcmp(cmd, CMD_CLEAR_FINGERS) == 0) {
+        if(mode == RUN_VALIDATE) return {true, topics.finger, EVT_CLEAR_SUCCESS};
+        BLOG(CMD_CLEAR_FINGERS);
+        bool success = eraseAllFingers(mode == RUN_SINGLE);
+        if(mode == RUN_SINGLE) lockMenu();
+        return {success, topics.finger, success ? EVT_CLEAR_SUCCESS : EVT_CLEAR_FAIL};
     }
     // Xử lý đổi mật khẩu
-    if(msg.startsWith("change_password")) {
-        Serial.println("→ Processing PASSWORD CHANGE");
-        
-        // Loại bỏ khoảng trắng và ký tự xuống dòng
-        msg = msg.substring(strlen("change_password"));
-        msg.trim();
-        
-        Serial.printf("   Raw message length: %d\n", msg.length());
-        Serial.printf("   Raw message (hex): ");
-        for(int i = 0; i < msg.length(); i++){
-            Serial.printf("%02X ", msg[i]);
+    if(startsWith(cmd, CMD_CHANGE_PASSWORD)) {
+        if(mode == RUN_VALIDATE) return runChangePassword(cmd + strlen(CMD_CHANGE_PASSWORD), mode);
+        BENCH_BEGIN(BENCH_CHANGE_PASSWORD); // kết thúc trong runChangePassword
+        BLOG(CMD_CHANGE_PASSWORD);
+        return runChangePassword(cmd + strlen(CMD_CHANGE_PASSWORD), mode);
+    }
+    // Chuyển khóa sang nhóm khác: "set_group <tên>"
+    if(startsWith(cmd, CMD_SET_GROUP)) {
+        const char* group = cmd + strlen(CMD_SET_GROUP);
+        if(!validGroupName(group)) return {false, topics.status, EVT_GROUP_ERROR};
+        if(mode != RUN_VALIDATE) setGroup(group);
+        formatGroupChanged(eventBuf, sizeof(eventBuf), group);
+        return {true, topics.status, eventBuf};
+    }
+    // Enroll vân tay từ xa: job chạy nền, từng pha báo trên topic fingerprint
+    if(strcmp(cmd, CMD_ENROLL_CANCEL) == 0) {
+        if(mode != RUN_SINGLE) return {false, topics.status, EVT_NOT_BATCHABLE};
+        if(!cancelEnroll()) return {false, topics.finger, EVT_ENROLL_IDLE};
+        return {true, nullptr, EVT_ENROLL_FAILED};
+    }
+    if(startsWith(cmd, CMD_ENROLL)) {
+        uint16_t slot;
+        if(!parseEnroll(cmd, slot)) {
+            static char event[32];
+            formatEnrollFailed(event, sizeof(event), "slot");
+            return {false, topics.finger, event};
         }
-        Serial.println();
-        Serial.printf("   Message content: [%s]\n", msg.c_str());
-        
-        // Kiểm tra độ dài
-        if(msg.length() < 4 || msg.length() > 4){
-            Serial.printf("✗ Password must be exactly 4 digits! (got %d)\n", msg.length());
-            mqttClient.publish(TOPIC_STATUS, "password_error_length");
-            return;
+        if(mode != RUN_SINGLE) return {false, topics.status, EVT_NOT_BATCHABLE};
+        return startEnroll(slot);
+    }
+    // Lịch truy cập: "schedule <pin|id> <168 hex>" (tools/schedule.py) hoặc "schedule <pin|id> always"
+    if(startsWith(cmd, CMD_SCHEDULE)) {
+        uint8_t subject;
+        uint8_t bits[AccessSchedule::BYTES];
+        bool always;
+        if(!parseSchedule(cmd, subject, bits, sizeof(bits), always)) return {false, topics.status, EVT_SCHEDULE_ERROR};
+        bool saved = mode == RUN_VALIDATE || saveSchedule(subject, always ? nullptr : bits);
+        formatSchedule(eventBuf, sizeof(eventBuf), always ? EVT_SCHEDULE_CLEARED : EVT_SCHEDULE_SET, subject);
+        return {saved, topics.status, eventBuf};
+    }
+    // Chính sách xác thực tại chỗ: "auth_policy any|both"
+    if(startsWith(cmd, CMD_AUTH_POLICY)) {
+        const char* arg = cmd + strlen(CMD_AUTH_POLICY);
+        AuthPipeline::Policy policy;
+        if(!parseAuthPolicy(arg, policy)) return {false, topics.status, EVT_AUTH_POLICY_ERROR};
+        if(mode != RUN_VALIDATE) {
+            setAuthPolicy(policy);
+            clearInput();
+            if(mode == RUN_SINGLE) lockMenu();
         }
-        
-        // Kiểm tra chỉ có số
-        bool allDigits = true;
-        for(int i = 0; i < 4; i++){
-            if(msg[i] < '0' || msg[i] > '9'){
-                Serial.printf("✗ Character at position %d is not a digit: '%c' (0x%02X)\n", 
-                              i, msg[i], msg[i]);
-                allDigits = false;
-                break;
+        formatAuthPolicy(eventBuf, sizeof(eventBuf), arg);
+        return {true, topics.status, eventBuf};
+    }
+#ifdef LAN_SERVER
+    // Token của server LAN: "lan_token <16-64 ký tự [A-Za-z0-9_-]>" hoặc "lan_token off"
+    if(startsWith(cmd, CMD_LAN_TOKEN)) {
+        const char* token = cmd + strlen(CMD_LAN_TOKEN);
+        bool off = strcmp(token, LAN_TOKEN_OFF) == 0;
+        if(!off && !LanProtocol::validToken(token)) return {false, topics.status, EVT_LAN_TOKEN_ERROR};
+        if(mode != RUN_VALIDATE) {
+            prefs.putString("lan_token", off ? "" : token);
+            lanServer.setToken(off ? "" : token);
+            BLOG(LAN_TOKEN, off ? "off" : "set");
+        }
+        return {true, topics.status, EVT_LAN_TOKEN_SET};
+    }
+#endif
+    // Dải slot vân tay của một người dùng: "finger_user <mã> <slot đầu> <số slot>" hoặc "finger_user <mã> off"
+    if(startsWith(cmd, CMD_FINGER_USER)) {
+        uint16_t code;
+        uint8_t first = 1, count = 1;
+        bool off;
+        if(!parseFingerUser(cmd, code, first, count, off)) return {false, topics.status, EVT_FINGER_USER_ERROR};
+        FingerUsers next = fingerUsers;
+        bool ok = off ? next.remove(code) : next.set(code, first, count);
+        if(!ok) return {false, topics.status, EVT_FINGER_USER_ERROR};
+        bool saved = true;
+        if(mode != RUN_VALIDATE) {
+            saved = prefs.putBytes("finger_users", next.raw(), FingerUsers::RAW_SIZE) == FingerUsers::RAW_SIZE;
+            if(saved) fingerUsers = next;
+            BLOG(FINGER_USER, code, off ? 0 : first, off ? 0 : count);
+        }
+        formatFingerUser(eventBuf, sizeof(eventBuf), off ? EVT_FINGER_USER_CLEARED : EVT_FINGER_USER_SET, code);
+        return {saved, topics.status, eventBuf};
+    }
+    // Secret TOTP của khóa: "totp_secret <40 hex>" (tools/totp.py) hoặc "totp_secret off"
+    if(startsWith(cmd, CMD_TOTP_SECRET)) {
+        uint8_t secret[Totp::SECRET_LEN];
+        bool off;
+        if(!parseTotpSecret(cmd, secret, sizeof(secret), off)) return {false, topics.status, EVT_TOTP_SECRET_ERROR};
+        bool saved = true;
+        if(mode != RUN_VALIDATE) {
+            if(off) {
+                totp.clearSecret();
+                saved = !prefs.isKey("totp_secret") || prefs.remove("totp_secret");
+            } else {
+                totp.setSecret(secret);
+                saved = prefs.putBytes("totp_secret", secret, sizeof(secret)) == sizeof(secret);
             }
+            // Secret mới: bước đã dùng của secret cũ không còn ý nghĩa
+            totp.setLastStep(0);
+            prefs.putUInt("totp_last", 0);
+            BLOG(TOTP_SECRET, off ? "off" : "set");
         }
-        
-        if(!allDigits){
-            Serial.println("✗ Password must contain only digits (0-9)!");
-            mqttClient.publish(TOPIC_STATUS, "password_error_format");
+        return {saved, topics.status, off ? EVT_TOTP_SECRET_CLEARED : EVT_TOTP_SECRET_SET};
+    }
+    // Cập nhật firmware: mở phiên, bản vá đến trên topic ota (phiên kéo dài nên không chạy trong lô)
+    if(startsWith(cmd, CMD_OTA_BEGIN)) {
+        if(mode != RUN_SINGLE) return {false, topics.status, EVT_NOT_BATCHABLE};
+        uint32_t bytes, crc;
+        uint8_t mac[OTA_MAC_LEN];
+        const char* error = !parseOtaBegin(cmd, bytes, crc, mac) ? "args"
+                          : !ota.begin(bytes, crc, mac)           ? ota.error()
+                                                                  : nullptr;
+        if(error) {
+            formatOtaError(eventBuf, sizeof(eventBuf), error);
+            return {false, topics.otaStatus, eventBuf};
+        }
+        BLOG(OTA_SESSION, bytes, crc);
+        lcdMsg("Updating...", LcdLine("%lu bytes", (unsigned long)bytes).text);
+        formatOtaNext(eventBuf, sizeof(eventBuf), 0);
+        return {true, topics.otaStatus, eventBuf};
+    }
+    if(strcmp(cmd, CMD_OTA_ABORT) == 0) {
+        if(mode != RUN_SINGLE) return {false, topics.status, EVT_NOT_BATCHABLE};
+        if(ota.active()) lockMenu();
+        ota.abort(EVT_OTA_ABORTED);
+        return {true, topics.otaStatus, EVT_OTA_ABORTED};
+    }
+    // Confidence theo từng ID vân tay và kết quả phiên khớp, mỗi ID một bản tin trên topic metrics
+    if(strcmp(cmd, CMD_FINGER_STATS) == 0) {
+        if(mode != RUN_VALIDATE) publishFingerStats();
+        return {true, topics.status, EVT_FINGER_STATS_SENT};
+    }
+    // Bộ đếm token bucket + duplicate dạng JSON trên topic metrics
+    if(strcmp(cmd, CMD_METRICS) == 0) {
+        if(mode != RUN_VALIDATE) publishMetrics();
+        return {true, topics.status, EVT_METRICS_SENT};
+    }
+#ifdef INPUT_RECORDER
+    // Xuất log input dạng hex, mỗi bản tin một dòng 32 byte
+    if(strcmp(cmd, CMD_DUMP_INPUTS) == 0) {
+        const char* end = inputRecorder.full() ? EVT_DUMP_END_FULL : EVT_DUMP_END;
+        if(mode == RUN_VALIDATE) return {true, topics.inputs, end};
+        const uint8_t* data = inputRecorder.data();
+        size_t len = inputRecorder.size();
+        char line[65];
+        for(size_t off = 0; off < len; off += 32) {
+            size_t n = len - off < 32 ? len - off : 32;
+            for(size_t i = 0; i < n; i++) sprintf(line + i * 2, "%02X", data[off + i]);
+            publishEvent(topics.inputs, line);
+        }
+        return {true, topics.inputs, end};
+    }
+#endif
+#ifdef LATENCY_BENCH
+    // Báo cáo benchmark: mỗi kịch bản một bản tin JSON trên topics.bench
+    if(strcmp(cmd, CMD_BENCH_REPORT) == 0) {
+        if(mode == RUN_VALIDATE) return {true, topics.bench, EVT_BENCH_PASS};
+        char json[320];
+        bool allPass = true;
+        for(uint8_t s = 0; s < BENCH_SCENARIO_COUNT; s++) {
+            allPass &= latencyBench.report((BenchScenario)s, json, sizeof(json));
+            publishEvent(topics.bench, json);
+        }
+        if(!allPass) BLOG(BENCH_REGRESSION);
+        return {true, topics.bench, allPass ? EVT_BENCH_PASS : EVT_BENCH_REGRESSION};
+    }
+    if(strcmp(cmd, CMD_BENCH_RESET) == 0) {
+        if(mode != RUN_VALIDATE) latencyBench.reset();
+        return {true, topics.bench, EVT_BENCH_RESET_OK};
+    }
+#endif
+    return {false, mode == RUN_SINGLE ? nullptr : topics.status, EVT_UNKNOWN_COMMAND};
+}
+
+// Lô lệnh: kiểm tra quyền + cú pháp từng dòng, chạy theo mode, gộp kết quả thành một batch_result
+CommandResult runBatch(char* body, uint8_t allow) {
+    static char result[420];
+    char* ops[BATCH_MAX_OPS];
+    uint8_t count = 0;
+    char* mode = strtok(body, "\r\n");
+    bool atomic = mode && strcmp(mode, BATCH_ATOMIC) == 0;
+    bool valid = atomic || (mode && strcmp(mode, BATCH_STOP_ON_ERROR) == 0);
+    for(char* op = strtok(nullptr, "\r\n"); op && valid; op = strtok(nullptr, "\r\n")) {
+        if(count == BATCH_MAX_OPS) valid = false;
+        else ops[count++] = op;
+    }
+
+    if(!valid || count == 0) {
+        formatBatchResult(result, sizeof(result), BATCH_REJECTED, 0, count);
+        return {false, topics.status, result};
+    }
+    if(!admitBatch(ops, count)) return {false, nullptr, EVT_RATE_LIMITED};
+
+    // atomic: từ chối cả lô nếu một lệnh sai quyền hoặc sai cú pháp
+    if(atomic) {
+        for(uint8_t i = 0; i < count; i++) {
+            const char* error = nullptr;
+            if(!(commandClass(ops[i]) & allow)) error = EVT_NOT_ALLOWED;
+            else {
+                CommandResult check = runCommand(ops[i], RUN_VALIDATE);
+                if(!check.ok) error = check.event;
+            }
+            if(error) {
+                formatBatchResult(result, sizeof(result), BATCH_REJECTED, 0, count);
+                appendBatchLine(result, sizeof(result), i + 1, error);
+                return {false, topics.status, result};
+            }
+        }
+    }
+
+    // Trạng thái khôi phục được nếu lô atomic hỏng giữa chừng (xóa vân tay thì không)
+    char savedPassword[PASS_LEN + 1];
+    strlcpy(savedPassword, password, sizeof(savedPassword));
+    char savedGroup[GROUP_LEN];
+    strlcpy(savedGroup, topics.group, sizeof(savedGroup));
+    AuthPipeline::Policy savedPolicy = auth.policy();
+
+    lcdMsg("Batch...", LcdLine("%u ops", count).text);
+    char lines[BATCH_MAX_OPS * 32] = "";
+    uint8_t done = 0;
+    bool ok = true;
+    for(uint8_t i = 0; i < count && ok; i++) {
+        CommandResult r = (commandClass(ops[i]) & allow)
+            ? runCommand(ops[i], RUN_BATCH)
+            : CommandResult{false, topics.status, EVT_NOT_ALLOWED};
+        appendBatchLine(lines, sizeof(lines), i + 1, r.event ? r.event : BATCH_OK);
+        ok = r.ok;
+        if(ok) done++;
+    }
+
+    if(!ok && atomic) {
+        if(strcmp(password, savedPassword) != 0) {
+            setPassword(savedPassword);
+            prefs.putString("password", password);
+        }
+        if(strcmp(savedGroup, topics.group) != 0) setGroup(savedGroup);
+        if(savedPolicy != auth.policy()) setAuthPolicy(savedPolicy);
+        BLOG(BATCH_ROLLBACK);
+    }
+
+    formatBatchResult(result, sizeof(result), ok ? BATCH_OK : BATCH_FAILED, done, count);
+    strlcat(result, lines, sizeof(result));
+    lcdMsg(ok ? "Batch OK" : "Batch Failed", LcdLine("%u/%u", done, count).text);
+    delay(1000);
+    clearInput();
+    lockMenu();
+    return {ok, topics.status, result};
+}
+
+// Trả kết quả cho client LAN đang chờ (một lần)
+void replyLan(const char* status, const char* event) {
+#ifdef LAN_SERVER
+    if(lanReplySlot < 0) return;
+    lanServer.reply(lanReplySlot, status, event);
+    lanReplySlot = -1;
+#endif
+}
+
+// Trả ack cho lệnh có request ID đang xử lý (một lần) và ghi kết quả vào cache
+void finishRequest(bool ok, const char* event) {
+    replyLan(ok ? ACK_OK : ACK_FAIL, event);
+    if(!requestPending) return;
+    requestPending = false;
+    char ack[480]; // đủ cho batch_result, dưới buffer MQTT 512
+    formatAck(ack, sizeof(ack), activeRequest, millis(), ok ? ACK_OK : ACK_FAIL, event);
+    publishEvent(topics.ack, ack);
+    requestCache.complete(activeRequest.id, ok, event);
+}
+
+// ===================== OTA =====================
+// Ảnh mới chỉ được xác nhận sau khi chạy ổn (OtaUpdater::checkBoot), không phải ngay lúc boot
+extern "C" bool verifyRollbackLater() {
+    return true;
+}
+
+// Một mẩu bản vá: u32 offset + dữ liệu, trả offset kế tiếp trên ota_status
+void handleOtaChunk(const byte* payload, unsigned int length) {
+    char reply[40];
+    if(length <= OTA_HEADER_LEN) return;
+    uint32_t offset = payload[0] | (uint32_t)payload[1] << 8 | (uint32_t)payload[2] << 16 | (uint32_t)payload[3] << 24;
+    OtaUpdater::Result result;
+    {
+        STALL_SCOPE(SITE_OTA); // mẩu đầu đọc cả ảnh gốc để so CRC, mỗi 4KB mới phải xóa flash
+        result = ota.write(offset, payload + OTA_HEADER_LEN, length - OTA_HEADER_LEN);
+    }
+    switch(result) {
+    case OtaUpdater::CONTINUE:
+    case OtaUpdater::RESEND:
+        formatOtaNext(reply, sizeof(reply), ota.next());
+        publishEvent(topics.otaStatus, reply);
+        break;
+    case OtaUpdater::DONE:
+        BLOG(OTA_WRITTEN);
+        publishEvent(topics.otaStatus, EVT_OTA_DONE);
+        lcdMsg("Update OK", "Rebooting...");
+        delay(500); // cho bản tin ota_done kịp đi
+        ESP.restart();
+        break;
+    case OtaUpdater::FAILED:
+        BLOG(OTA_FAILED, ota.error());
+        formatOtaError(reply, sizeof(reply), ota.error());
+        publishEvent(topics.otaStatus, reply);
+        lockMenu();
+        break;
+    }
+}
+
+// Hủy phiên bị bỏ dở và xác nhận ảnh mới sau khi chạy ổn
+void pollOta() {
+    uint32_t now = millis();
+    if(ota.idle(now)) {
+        ota.abort("timeout");
+        char reply[40];
+        formatOtaError(reply, sizeof(reply), ota.error());
+        publishEvent(topics.otaStatus, reply);
+        lockMenu();
+    }
+    if(ota.checkBoot(mqttClient.connected(), now)) {
+        BLOG(OTA_CONFIRMED);
+        publishEvent(topics.otaStatus, EVT_OTA_VALID);
+    }
+}
+
+// ===================== COMMAND DISPATCH =====================
+// Một bản tin lệnh từ MQTT hoặc LAN: header request ID, quyền của nguồn, rate limit rồi runCommand.
+// source là topic MQTT hoặc "lan", chỉ để log
+void dispatchCommand(char* msg, uint8_t allow, const char* source, uint32_t rxMs) {
+    // Header request ID: lệnh trùng ID chỉ nhận lại ack cũ, không chạy lại.
+    // Cache dùng chung nên gửi cùng ID qua cả MQTT và LAN thì lệnh chỉ chạy một lần
+    RequestHeader req;
+    const char* parsed = parseRequest(msg, req);
+    if(!parsed) {
+        BLOG(REQ_BAD_HEADER);
+        replyLan(ACK_FAIL, EVT_BAD_REQUEST);
+        return;
+    }
+    char* cmd = msg + (parsed - msg);
+    if(req.id[0]) {
+        req.rxMs = rxMs;
+        const auto* seen = requestCache.find(req.id);
+        if(seen) {
+            BLOG(REQ_DUPLICATE, req.id);
+            if(seen->done) {
+                char ack[128];
+                formatAck(ack, sizeof(ack), req, millis(), ACK_DUP, seen->event);
+                publishEvent(topics.ack, ack);
+            }
+            replyLan(ACK_DUP, seen->done ? seen->event : "");
             return;
         }
-        
-        // Lưu mật khẩu mới
-        String oldPassword = password;
-        password = msg;
-        
-        // Lưu vào flash
-        bool saved = prefs.putString("password", password);
-        
-        Serial.println("========================================");
-        Serial.println("✓✓✓ PASSWORD CHANGED SUCCESSFULLY ✓✓✓");
-        Serial.println("   Old: " + oldPassword);
-        Serial.println("   New: " + password);
-        Serial.printf("   Saved to flash: %s\n", saved ? "YES" : "NO");
-        Serial.println("========================================");
-        
-        // Thông báo thành công
-        mqttClient.publish(TOPIC_STATUS, "password_changed");
-        
-        // Hiển thị LCD
-        lcdMsg("Password Changed", "New: " + password);
-        beep(100);
-        delay(2000);
-        
-        // Quay về màn hình khóa
-        inputPassword = "";
-        failCount = 0;
+        requestCache.insert(req.id);
+        activeRequest = req;
+        requestPending = true;
+    }
+
+    // Lệnh bị bỏ do rate limit không in Serial để bão lệnh không làm chậm loop()
+    CommandResult r;
+    // Chỉ log tên lệnh: tham số có thể là mật khẩu, token hoặc secret
+    char verb[24];
+    commandVerb(cmd, verb, sizeof(verb));
+    if(startsWith(cmd, CMD_BATCH)) {
+        BLOG(CMD_IN, source, verb, CMDC_NONE);
+        r = runBatch(cmd + strlen(CMD_BATCH), allow);
+    } else if(!(allow & commandClass(cmd))) {
+        BLOG(CMD_NOT_ALLOWED, source);
+        r = {false, nullptr, EVT_NOT_ALLOWED};
+    } else if(!admitCommand(cmd)) {
+        r = {false, nullptr, EVT_RATE_LIMITED};
+    } else {
+        BLOG(CMD_IN, source, verb, commandClass(cmd));
+        r = runCommand(cmd, RUN_SINGLE);
+    }
+    if(r.topic) publishEvent(r.topic, r.event);
+    finishRequest(r.ok, r.event ? r.event : ACK_OK); // unlock đã ack lúc vào menu
+    if(r.event == EVT_RATE_LIMITED && req.id[0]) requestCache.forget(req.id); // cho phép gửi lại cùng ID
+}
+
+// ===================== MQTT CALLBACK =====================
+void mqttCallback(char* topic, byte* payload, unsigned int length){
+    // Bản vá là nhị phân: không qua bộ ghi input và không cắt như lệnh văn bản
+    if(strcmp(topic, topics.ota) == 0) {
+        handleOtaChunk(payload, length);
+        return;
+    }
+    uint32_t rxMs = millis();
+    char msg[512];
+    copyCommand(msg, sizeof(msg), payload, length);
+
+    // Chỉ chạy lệnh đến từ topic trong bảng và thuộc nhóm topic đó cho phép
+    const Route* route = findRoute(commandRoutes, sizeof(commandRoutes) / sizeof(commandRoutes[0]), topic);
+    if(!route) return;
+#ifdef INPUT_RECORDER
+    // Log xuất được ra ngoài qua dump_inputs: lệnh mang bí mật chỉ ghi tên lệnh
+    char redacted[256];
+    size_t redactedLen = redactSecrets(msg, redacted, sizeof(redacted));
+    inputRecorder.recordMqtt(route->allow, (const uint8_t*)redacted, redactedLen);
+#endif
+    dispatchCommand(msg, route->allow, topic, rxMs);
+}
+
+#ifdef INPUT_RECORDER
+// ===================== INPUT RECORDER =====================
+// Ghi thay đổi WiFi và bơm payload MQTT khi phát lại, với quyền của topic đã nhận nó lúc ghi
+void pollInputRecorder() {
+    uint8_t wifi = WiFi.status();
+    if(wifi != lastWifiStatus) {
+        inputRecorder.recordWifi(wifi);
+        lastWifiStatus = wifi;
+    }
+
+    if(inputRecorder.replaying()) {
+        uint8_t recorded;
+        if(inputRecorder.nextWifi(recorded)) BLOG(REPLAY_WIFI, recorded);
+
+        uint8_t allow;
+        uint8_t payload[256];
+        int len = inputRecorder.nextMqtt(allow, payload, sizeof(payload));
+        if(len >= 0) {
+            char msg[256];
+            copyCommand(msg, sizeof(msg), payload, len);
+            dispatchCommand(msg, allow, "replay", millis());
+        }
+    }
+}
+#endif
+
+#ifdef LAN_SERVER
+// ===================== LAN SERVER =====================
+// Mỗi vòng loop() chạy nhiều nhất một lệnh từ LAN; kết quả về client qua finishRequest()/replyLan()
+void pollLan() {
+    LanServer::Command cmd;
+    if(!lanServer.poll(cmd, millis())) return;
+    lanReplySlot = cmd.slot;
+    dispatchCommand(cmd.text, LAN_ALLOW, "lan", millis());
+}
+#endif
+
+#ifdef AS608_EMULATOR
+// Mô hình thời gian khớp theo cỡ thư viện: tìm 1:N cả thư viện so với xác minh 1:1 (một
+// slot, dải 4 slot). Số đo chỉ phản ánh độ trễ cấu hình của giả lập (setSearchCost, emu lat),
+// không phải AS608 thật; đo thật bằng bench_report (xem README). Ghi đè thư viện giả lập
+void emuSweep() {
+    STALL_SCOPE(SITE_FINGER_ADMIN);
+    static const uint8_t SIZES[] = {1, 8, 32, 64, 127};
+    Serial.println("[emu] model, not hardware: emulator latency settings only");
+    Serial.println("[emu] templates  search_ms  verify1_ms  verify4_ms");
+    for(uint8_t size : SIZES) {
+        finger.emptyDatabase();
+        for(uint8_t slot = 1; slot <= size; slot++) fingerEmulator.preload(slot, 1000 + slot);
+        fingerEmulator.placeFinger(1000 + size);
+        uint8_t first = size > 4 ? size - 3 : 1;
+        uint32_t us[3];
+        int id[3];
+        for(uint8_t mode = 0; mode < 3; mode++) {
+            finger.getImage();
+            uint32_t start = micros();
+            id[mode] = mode == 0 ? finger.match() : mode == 1 ? finger.verify(size, 1) : finger.verify(first, size - first + 1);
+            us[mode] = micros() - start;
+        }
+        bool ok = id[0] == size && id[1] == size && id[2] == size;
+        Serial.printf("[emu] %9u  %9lu  %10lu  %10lu%s\n", size, (unsigned long)us[0] / 1000,
+                      (unsigned long)us[1] / 1000, (unsigned long)us[2] / 1000, ok ? "" : "  (id mismatch)");
+        stallWatchdog.beat(HB_LOOP);
+    }
+    fingerEmulator.liftFinger();
+}
+#endif
+
+// ===================== SERIAL CONSOLE =====================
+// Chỉ qua USB: khóa OTA không bao giờ đi qua MQTT
+void handleConsoleLine(char* line) {
+    uint8_t otaKey[OtaUpdater::KEY_LEN];
+    if(startsWith(line, "ota_key ")) {
+        if(!parseHex(line + strlen("ota_key "), otaKey, sizeof(otaKey))) {
+            Serial.println("[ota] key must be 64 hex chars");
+            return;
+        }
+        prefs.putBytes("ota_key", otaKey, sizeof(otaKey));
+        ota.setKey(otaKey);
+        BLOG(OTA_KEY, "set");
+        Serial.println("[ota] key saved");
+        return;
+    }
+#ifdef INPUT_RECORDER
+    static bool loading = false;
+    if(strcmp(line, "rec dump") == 0) {
+        inputRecorder.dump(Serial);
+    } else if(strcmp(line, "rec clear") == 0) {
+        inputRecorder.clear();
+        Serial.println("[rec] cleared");
+    } else if(strcmp(line, "rec load") == 0) {
+        inputRecorder.clear();
+        loading = true;
+        Serial.println("[rec] paste hex lines, then 'rec play'");
+    } else if(strcmp(line, "rec play") == 0) {
+        loading = false;
+        Serial.printf("[rec] replaying %u bytes\n", (unsigned)inputRecorder.size());
+        clearInput();
         lockMenu();
+        requestCache.clear(); // payload phát lại mang request ID cũ
+        inputRecorder.startReplay();
+    } else if(loading) {
+        if(!inputRecorder.appendHex(line)) Serial.println("[rec] bad hex line");
+    }
+#endif
+#ifdef AS608_EMULATOR
+    // emu place <identity> [quality] | emu lift | emu preload <slot> <identity>
+    // emu lat <cmd> <ms> | emu err <cmd> <code> [count] | emu stats | emu sweep
+    unsigned a = 0, b = 0, c = 1;
+    if(sscanf(line, "emu place %u %u", &a, &b) >= 1) {
+        fingerEmulator.placeFinger(a, b ? b : 100);
+    } else if(strcmp(line, "emu lift") == 0) {
+        fingerEmulator.liftFinger();
+    } else if(sscanf(line, "emu preload %u %u", &a, &b) == 2) {
+        fingerEmulator.preload(a, b);
+    } else if(sscanf(line, "emu lat %x %u", &a, &b) == 2) {
+        fingerEmulator.setLatency(a, b);
+    } else if(sscanf(line, "emu err %x %x %u", &a, &b, &c) >= 2) {
+        fingerEmulator.injectError(a, b, c);
+    } else if(strcmp(line, "emu stats") == 0) {
+        fingerEmulator.printStats(Serial);
+        fingerEmulator.resetStats();
+    } else if(strcmp(line, "emu sweep") == 0) {
+        emuSweep();
+    }
+#endif
+}
+
+void pollSerialConsole() {
+    static char line[96];
+    static uint8_t lineLen = 0;
+    while(Serial.available()) {
+        char c = Serial.read();
+        if(c != '\n' && c != '\r') {
+            if(lineLen < sizeof(line) - 1) line[lineLen++] = c;
+            continue;
+        }
+        if(lineLen == 0) continue;
+        line[lineLen] = '\0';
+        lineLen = 0;
+        handleConsoleLine(line);
     }
 }
 
 // ===================== MQTT ERROR HANDLER =====================
-void printMQTTError(int errorCode) {
-    Serial.print("⚠️  MQTT Error: ");
+const char* mqttErrorName(int errorCode) {
     switch(errorCode) {
-        case -4: Serial.println("CONNECTION_TIMEOUT"); break;
-        case -3: Serial.println("CONNECTION_LOST"); break;
-        case -2: Serial.println("CONNECT_FAILED"); break;
-        case -1: Serial.println("DISCONNECTED"); break;
-        case  1: Serial.println("BAD_PROTOCOL"); break;
-        case  2: Serial.println("BAD_CLIENT_ID"); break;
-        case  3: Serial.println("UNAVAILABLE"); break;
-        case  4: Serial.println("BAD_CREDENTIALS"); break;
-        case  5: Serial.println("UNAUTHORIZED"); break;
-        default: Serial.println("UNKNOWN"); break;
+        case -4: return "CONNECTION_TIMEOUT";
+        case -3: return "CONNECTION_LOST";
+        case -2: return "CONNECT_FAILED";
+        case -1: return "DISCONNECTED";
+        case  1: return "BAD_PROTOCOL";
+        case  2: return "BAD_CLIENT_ID";
+        case  3: return "UNAVAILABLE";
+        case  4: return "BAD_CREDENTIALS";
+        case  5: return "UNAUTHORIZED";
+        default: return "UNKNOWN";
     }
 }
 
+// ===================== MQTT TOPICS =====================
+void subscribeCommandTopics() {
+    for(const Route& route : commandRoutes) {
+        mqttClient.subscribe(route.topic);
+        BLOG(MQTT_SUB, route.topic);
+    }
+    mqttClient.subscribe(topics.ota, 1);
+    BLOG(MQTT_SUB, topics.ota);
+}
+
+// Đổi nhóm: lưu flash, dựng lại topic nhóm và đăng ký lại
+bool setGroup(const char* group) {
+    if(!validGroupName(group)) return false;
+    char name[GROUP_LEN];
+    strlcpy(name, group, sizeof(name)); // group có thể trỏ vào topics.group
+    if(mqttClient.connected()) mqttClient.unsubscribe(topics.groupCommand);
+    prefs.putString("group", name);
+    topics.build(topics.doorId, name);
+    if(mqttClient.connected()) mqttClient.subscribe(topics.groupCommand);
+    BLOG(GROUP_CHANGED, topics.groupCommand);
+    return true;
+}
+
 // ===================== MQTT RECONNECT =====================
 void mqttReconnect(){
     // Không thử quá thường xuyên
@@ -402,141 +1717,181 @@ void mqttReconnect(){
     lastMqttAttempt = now;
 
     if(!mqttClient.connected()){
-        Serial.print("MQTT connecting to ");
-        Serial.print(MQTT_HOST);
-        Serial.print(":");
-        Serial.println(MQTT_PORT);
+        char clientId[CLIENT_ID_LEN];
+        formatClientId(clientId, sizeof(clientId), topics.doorId);
+        BLOG(MQTT_CONNECTING, clientId, MQTT_USER);
         
-        String clientId="ESP32_Door_";
-        clientId+=String((uint32_t)ESP.getEfuseMac(), HEX);
-        
-        Serial.print("Client ID: ");
-        Serial.println(clientId);
-        Serial.print("Username: ");
-        Serial.println(MQTT_USER);
-        
-        if(mqttClient.connect(clientId.c_str(), MQTT_USER, MQTT_PASS)){
-            Serial.println("✓ MQTT connected!");
+        bool connected;
+        {
+            STALL_SCOPE(SITE_MQTT_CONNECT);
+            connected = mqttClient.connect(clientId, MQTT_USER, MQTT_PASS);
+        }
+        if(connected){
+            BLOG(MQTT_CONNECTED);
             
             // Subscribe topics
-            mqttClient.subscribe(TOPIC_CMD);
-            
-            Serial.println("✓ Subscribed to topics");
+            subscribeCommandTopics();
             
             // Publish online status
-            mqttClient.publish(TOPIC_STATUS,"connected", true);
+            mqttClient.publish(topics.status, EVT_CONNECTED, true);
             
         } else {
-            Serial.print("✗ MQTT connect failed, rc=");
-            Serial.println(mqttClient.state());
-            printMQTTError(mqttClient.state());
+            BLOG(MQTT_CONNECT_FAILED, mqttClient.state(), mqttErrorName(mqttClient.state()));
         }
     }
 }
 
+// ===================== WIFI =====================
+// Chờ WiFi tối đa 20 s và báo kết quả trên LCD (chỉ lúc cold boot)
+void waitForWifi() {
+    unsigned long startWifi = millis();
+    {
+        STALL_SCOPE(SITE_WIFI_CONNECT);
+        while(WiFi.status() != WL_CONNECTED && millis() - startWifi < 20000){
+            delay(200);
+        }
+    }
+    uint32_t waitedMs = millis() - startWifi;
+    
+    if(WiFi.status() == WL_CONNECTED){
+        IPAddress ip = WiFi.localIP();
+        BLOG(WIFI_CONNECTED, waitedMs, ip[0], ip[1], ip[2], ip[3], (int)WiFi.RSSI());
+        lcdMsg("WiFi Connected", LcdLine("%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]).text);
+        delay(1500);
+    } else {
+        BLOG(WIFI_FAILED, waitedMs);
+        lcdMsg("WiFi Failed", "Offline Mode");
+        delay(2000);
+    }
+}
+
 // ===================== SETUP =====================
 void setup(){
     Serial.begin(115200);
+    binLog.begin(Serial);
+    BLOG(BOOT, LogTable::hash(), (unsigned)esp_reset_reason());
+    stallWatchdog.begin(LOOP_STALL_MS, NET_STALL_MS, TWDT_TIMEOUT_S);
+    WarmState warm;
+    warmBoot = restoreWarmState(warm);
     
-    pinMode(BUZZER_PIN,OUTPUT);
+    buzzer.begin(BUZZER_PIN);
 
+    // Warm restart: LCD vẫn có nguồn, bỏ chờ power-up và màn hình khởi động
     Wire.begin(LCD_SDA, LCD_SCL);
-    lcd.begin();
+    lcd.begin(warmBoot);
     lcd.backlight();
-    lcdMsg("System Starting...");
+    if(!warmBoot) lcdMsg("System Starting...");
 
+    // Servo tiếp tục từ góc cũ rồi chạy êm về góc khóa thay vì giật về 0
     doorServo.attach(SERVO_PIN,0);
-    doorServo.write(0);
+    doorServo.write(warmBoot ? warm.servoAngle : 0);
 
+    ledRed.begin();
+    ledGreen.begin();
     ledRed.on();
     ledGreen.off();
 
     keypad.begin();
     finger.begin();
+#ifdef FINGER_TOUCH_PIN
+    pinMode(FINGER_TOUCH_PIN, INPUT);
+#endif
 
     prefs.begin("locksys", false);
-    password=prefs.getString("password", DEFAULT_PASSWORD);
-    
-    Serial.print("Password loaded: ");
-    Serial.println(password);
+    schedulePrefs.begin("schedule", false);
+    loadSchedules();
+    setPassword(DEFAULT_PASSWORD);
+    size_t stored = prefs.getString("password", password, sizeof(password)); // không có key thì giữ mặc định
+    BLOG(PASSWORD_LOADED, stored ? "flash" : "default");
+    auth.setPolicy(prefs.getUChar("auth_policy", AuthPipeline::ANY) == AuthPipeline::BOTH ? AuthPipeline::BOTH
+                                                                                           : AuthPipeline::ANY);
+    uint8_t totpSecret[Totp::SECRET_LEN];
+    if(prefs.getBytes("totp_secret", totpSecret, sizeof(totpSecret)) == sizeof(totpSecret)) totp.setSecret(totpSecret);
+    totp.setLastStep(prefs.getUInt("totp_last", 0));
+    loadFingerUsers();
+
+    // Door ID = đủ 48 bit eFuse MAC (12 hex), giống client ID; 32 bit thấp có thể trùng giữa hai board
+    char doorId[DOOR_ID_LEN];
+    snprintf(doorId, sizeof(doorId), "%012llx", (unsigned long long)ESP.getEfuseMac());
+    char group[GROUP_LEN] = "";
+    prefs.getString("group", group, sizeof(group));
+    topics.build(doorId, validGroupName(group) ? group : DEFAULT_GROUP);
+    BLOG(DOOR_ID, topics.doorId, topics.group);
+    if(ota.beginBoot()) BLOG(OTA_PENDING_VERIFY);
+    uint8_t otaKey[OtaUpdater::KEY_LEN];
+    if(prefs.getBytes("ota_key", otaKey, sizeof(otaKey)) == sizeof(otaKey)) ota.setKey(otaKey);
+    BLOG(OTA_KEY, ota.hasKey() ? "loaded" : "missing, type ota_key <hex> on Serial");
+#ifdef LAN_SERVER
+    char lanToken[LanProtocol::TOKEN_LEN] = "";
+    prefs.getString("lan_token", lanToken, sizeof(lanToken));
+    lanServer.setToken(lanToken);
+#endif
 
     // ==================== WIFI ====================
-    Serial.println("\n========================================");
-    Serial.print("Connecting to WiFi: ");
-    Serial.println(WIFI_SSID);
-    Serial.println("========================================");
-    
+    BLOG(WIFI_CONNECTING, WIFI_SSID);
     WiFi.mode(WIFI_STA);
     WiFi.begin(WIFI_SSID, WIFI_PASS);
+    configTzTime(TZ_INFO, NTP_SERVER); // SNTP tự thử lại, đồng bộ khi WiFi lên
+#ifdef LAN_SERVER
+    lanServer.begin(); // lắng nghe mọi interface, nhận kết nối khi WiFi lên
+    BLOG(LAN_LISTENING, LAN_PORT, lanToken[0] != '\0');
+#endif
     
-    unsigned long startWifi = millis();
-    int dots = 0;
-    while(WiFi.status() != WL_CONNECTED && millis() - startWifi < 20000){
-        Serial.print(".");
-        dots++;
-        if(dots % 50 == 0) Serial.println();
-        delay(200);
-    }
-    
-    Serial.println();
-    
-    if(WiFi.status() == WL_CONNECTED){
-        Serial.println("✓✓✓ WiFi CONNECTED ✓✓✓");
-        Serial.print("✓ IP Address: ");
-        Serial.println(WiFi.localIP());
-        Serial.print("✓ Signal: ");
-        Serial.print(WiFi.RSSI());
-        Serial.println(" dBm");
-        Serial.println("========================================\n");
-        
-        lcdMsg("WiFi Connected", WiFi.localIP().toString());
-        delay(1500);
-    } else {
-        Serial.println("✗✗✗ WiFi NOT CONNECTED ✗✗✗");
-        Serial.println("System will work in OFFLINE mode");
-        Serial.println("========================================\n");
-        
-        lcdMsg("WiFi Failed", "Offline Mode");
-        delay(2000);
-    }
+    // Warm restart: không chặn chờ WiFi, loop() kết nối MQTT khi WiFi lên
+    if(warmBoot) BLOG(WIFI_BACKGROUND);
+    else waitForWifi();
 
     // ==================== MQTT SETUP ====================
-    Serial.println("Configuring MQTT...");
-    
-    // ← QUAN TRỌNG: Bỏ qua xác thực SSL certificate
-    espClient.setInsecure();  // Cho phép kết nối mà không cần verify CA
+    // Xác thực broker bằng CA gốc (DigiCert Global Root G2) thay vì tin mọi chứng chỉ
+    espClient.setCACert(ca_cert);
     
     mqttClient.setServer(MQTT_HOST, MQTT_PORT);
     mqttClient.setCallback(mqttCallback);
     mqttClient.setKeepAlive(60);
     mqttClient.setSocketTimeout(30);
     mqttClient.setBufferSize(512);
-    
-    Serial.print("MQTT Server: ");
-    Serial.print(MQTT_HOST);
-    Serial.print(":");
-    Serial.println(MQTT_PORT);
-    Serial.println("========================================\n");
+    BLOG(MQTT_SERVER, MQTT_HOST, MQTT_PORT);
 
     closeDoor();
     lockMenu();
     
-    Serial.println("System Ready!\n");
+    resumeMs = millis();
+    if(warmBoot) {
+        BLOG(WARM_RESUMED, warmSnapshot.seq, resumeMs, failCount, relockedOnBoot);
+    }
+    BLOG(READY);
 }
 
 // ===================== LOOP =====================
 void loop(){
-    ledRed.loop();
-    ledGreen.loop();
+    stallWatchdog.beat(HB_LOOP);
+    saveWarmState();
+    binLog.report();
+    heapTracker.sample();
+    pollTimeSync();
+    pollDoorEvents();
 
     // MQTT handling
     if(WiFi.status() == WL_CONNECTED){
         if(!mqttClient.connected()) {
             mqttReconnect();
         } else {
-            mqttClient.loop();
+            {
+                STALL_SCOPE(SITE_MQTT_LOOP);
+                mqttClient.loop();
+            }
+            flushWrongPass();
+            reportStall();
+            reportWarmRestart();
         }
+        stallWatchdog.beat(HB_NET);
+    } else {
+        stallWatchdog.park(HB_NET);
     }
+    pollOta();
+#ifdef LAN_SERVER
+    pollLan(); // không phụ thuộc broker: vẫn mở khóa được trong LAN khi MQTT rớt
+#endif
 
     // Khóa nếu nhập sai quá nhiều lần
     //if(failCount >= MAX_FAIL_COUNT){
@@ -545,61 +1900,89 @@ void loop(){
     //        Serial.println("SYSTEM LOCKED due to too many failed attempts!");
     //    }
     //   unsigned long remain = (LOCKOUT_TIME - (millis() - lockoutTimer)) / 1000;
-    //   lcdMsg("Locked!", String(remain) + "s");
+    //   lcdMsg("Locked!", LcdLine("%lus", remain).text);
     //    
     //    if(millis() - lockoutTimer >= LOCKOUT_TIME){
     //        Serial.println("✓ Lockout period ended");
     //        failCount = 0;
     //        lockoutTimer = 0;
-    //        inputPassword = "";
+    //        clearInput();
     //        lockMenu();
     //    }
     //    return;
     // }
 
+#ifdef INPUT_RECORDER
+    pollInputRecorder();
+#endif
+    pollSerialConsole();
+
     // Password input
-    char key = keypad.getKey();
-    if(key >= '0' && key <= '9' && inputPassword.length() < 4){
-        inputPassword += key;
-        lcd.setCursor(inputPassword.length(), 1);
+    char key = readKey(true);
+
+    // '*' khi chưa gõ gì: nhập mã một lần thay cho PIN (chỉ khi đã cấp secret)
+    if(key == '*' && inputLen == 0 && !otpEntry && totp.enabled()){
+        otpEntry = true;
+        lcdMsg("One-Time Code:");
+        buzzer.play(Beep::KEYPRESS);
+    }
+
+    uint8_t inputMax = otpEntry ? Totp::DIGITS : PASS_LEN;
+    if(key >= '0' && key <= '9' && inputLen < inputMax){
+        inputPassword[inputLen++] = key;
+        inputPassword[inputLen] = '\0';
+        lcd.setCursor(inputLen, 1);
         lcd.print("*");
-        beep(30);
+        buzzer.play(Beep::KEYPRESS);
         
-        if(inputPassword.length() == 4){
-            if(inputPassword == password){
-                Serial.println("✓ Password correct!");
-                lcd.clear();
-                lcd.print("Correct Pass!");
-                beep(100);
-                ledGreen.on(); 
-                ledRed.off();
-                inputPassword = "";
-                failCount = 0;
-                delay(500);
-                firsttimeEnteringMenu = true;
-                handleMenu();
-            } else {
-                Serial.println("✗ Wrong password! Attempt: " + String(failCount + 1));
-                lcd.clear();
-                lcd.print("Wrong Pass!");
-                beep(200);
-                failCount++;
-                if(mqttClient.connected()) {
-                    mqttClient.publish(TOPIC_STATUS, ("wrong_pass: " + String(failCount)).c_str());
-                }
-                inputPassword = "";
-                delay(500);
-                lockMenu();
-            }
+        if(otpEntry && inputLen == Totp::DIGITS){
+            checkOtp();
+        } else if(!otpEntry && inputLen == PASS_LEN){
+            BENCH_BEGIN(BENCH_KEYPAD_PIN);
+            bool ok = strcmp(inputPassword, password) == 0;
+#ifdef INPUT_RECORDER
+            ok = inputRecorder.verdict(ok);
+#endif
+            clearInput();
+            authFactor(AuthPipeline::PIN, ok, 0);
         }
     }
 
+    // '#' sau 1-3 số: mã người dùng, vân tay kế tiếp xác minh 1:1 (chỉ khi đã cấp finger_user).
+    // '#' còn lại: xóa PIN đang gõ và yếu tố 2FA đang giữ
     if(key == '#'){
-        Serial.println("Fingerprint mode activated");
-        inputPassword = "";
-        lcd.clear();
-        lcd.print("Scan Finger...");
-        beep(50);
-        FingerSearchMode();
+        if(!otpEntry && inputLen > 0 && inputLen < PASS_LEN && fingerUsers.count() > 0) {
+            selectFingerUser(atoi(inputPassword));
+        } else {
+            clearInput();
+            auth.reset();
+            ledGreen.off();
+            lockMenu();
+        }
+    }
+
+    // Vân tay quét song song với bàn phím, không cần bấm # trước.
+    // Job enroll đang chạy thì cảm biến thuộc về job, ngón tay đặt lên không dùng để mở khóa
+    if(enrollJob.active()) {
+        pollEnroll();
+    } else {
+        int fingerId = pollFinger();
+        if(fingerId != AS608FingerSensor::NO_FINGER) authFactor(AuthPipeline::FINGER, fingerId > 0, fingerId);
+    }
+
+    if(verifyUser.code && millis() - verifySince >= AuthPipeline::WINDOW_MS){
+        lcdMsg("Verify Timeout");
+        buzzer.play(Beep::FAILURE, true);
+        clearInput();
+        lockMenu();
+    }
+
+    if(auth.expire(millis())){
+        BLOG(AUTH_EXPIRED);
+        lcdMsg("2FA Timeout");
+        ledGreen.off();
+        buzzer.play(Beep::FAILURE, true);
+        clearInput();
+        lockMenu();
     }
 }
\ No newline at end of file
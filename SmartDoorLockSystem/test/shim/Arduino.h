@@ -0,0 +1,50 @@
+/***
+ * Arduino.h tối thiểu cho test trên PC (env native): chỉ những gì các thư
+ * viện header-only trong lib/ dùng khi không chạm phần cứng. millis() và số
+ * liệu heap của ESP do test đặt.
+ ***/
+
+#pragma once
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// glibc trước 2.38 chưa có strlcpy
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+inline size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t n = strlen(src);
+    if (size)
+    {
+        size_t k = n < size - 1 ? n : size - 1;
+        memcpy(dst, src, k);
+        dst[k] = '\0';
+    }
+    return n;
+}
+#endif
+
+// Đồng hồ do test đặt; us cộng thêm phần lẻ cho micros() (LatencyBench)
+namespace ShimClock
+{
+    inline uint32_t ms = 0;
+    inline uint32_t us = 0;
+}
+inline uint32_t millis() { return ShimClock::ms + ShimClock::us / 1000; }
+inline uint32_t micros() { return ShimClock::ms * 1000 + ShimClock::us; }
+
+// Số liệu heap ESP do test đặt (HeapTracker)
+struct ShimEsp
+{
+    uint32_t freeHeap = 0;
+    uint32_t maxAllocHeap = 0;
+    uint32_t minFreeHeap = 0;
+
+    uint32_t getFreeHeap() const { return freeHeap; }
+    uint32_t getMaxAllocHeap() const { return maxAllocHeap; }
+    uint32_t getMinFreeHeap() const { return minFreeHeap; }
+};
+inline ShimEsp ESP;
@@ -0,0 +1,111 @@
+/***
+ * Socket giả cho test LanServer trên PC: mỗi kết nối là hai hàng byte trong RAM.
+ *
+ * Test mở kết nối bằng ShimSocket::connect(), đẩy dữ liệu client vào rx và đọc
+ * những gì khóa gửi trong tx. room giới hạn buffer gửi của send(MSG_DONTWAIT)
+ * (lwip/sockets.h) để giả một client đọc chậm; write() của WiFiClient là ghi
+ * chặn nên luôn ghi hết.
+ ***/
+
+#pragma once
+#include <Arduino.h>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+
+struct ShimSocket
+{
+    int fd = -1;
+    std::string rx;          // client -> khóa, chưa đọc
+    std::string tx;          // khóa -> client
+    size_t room = SIZE_MAX;  // chỗ trống trong buffer gửi
+    bool open = true;        // phía client còn kết nối
+    bool stopped = false;    // khóa đã gọi stop()
+
+    static std::map<int, std::shared_ptr<ShimSocket>> &table()
+    {
+        static std::map<int, std::shared_ptr<ShimSocket>> t;
+        return t;
+    }
+
+    // Kết nối chờ WiFiServer::available()
+    static std::deque<std::shared_ptr<ShimSocket>> &pending()
+    {
+        static std::deque<std::shared_ptr<ShimSocket>> q;
+        return q;
+    }
+
+    static std::shared_ptr<ShimSocket> connect()
+    {
+        static int nextFd = 3;
+        auto s = std::make_shared<ShimSocket>();
+        s->fd = nextFd++;
+        table()[s->fd] = s;
+        pending().push_back(s);
+        return s;
+    }
+
+    static void reset()
+    {
+        table().clear();
+        pending().clear();
+    }
+};
+
+class WiFiClient
+{
+public:
+    WiFiClient() = default;
+    explicit WiFiClient(std::shared_ptr<ShimSocket> s) : _s(std::move(s)) {}
+
+    int available() { return _s && !_s->stopped ? (int)_s->rx.size() : 0; }
+
+    int read(uint8_t *buf, size_t len)
+    {
+        if (!_s || _s->rx.empty()) return -1;
+        size_t n = len < _s->rx.size() ? len : _s->rx.size();
+        memcpy(buf, _s->rx.data(), n);
+        _s->rx.erase(0, n);
+        return (int)n;
+    }
+
+    size_t write(const uint8_t *buf, size_t len)
+    {
+        if (!_s || _s->stopped || !_s->open) return 0;
+        _s->tx.append((const char *)buf, len);
+        return len;
+    }
+
+    uint8_t connected() { return _s && _s->open && !_s->stopped; }
+
+    void stop()
+    {
+        if (_s) _s->stopped = true;
+        _s.reset();
+    }
+
+    int setNoDelay(bool) { return 0; }
+    int fd() const { return _s ? _s->fd : -1; }
+    explicit operator bool() const { return (bool)_s; }
+
+private:
+    std::shared_ptr<ShimSocket> _s;
+};
+
+class WiFiServer
+{
+public:
+    explicit WiFiServer(uint16_t) {}
+    void begin() {}
+    void setNoDelay(bool) {}
+
+    WiFiClient available()
+    {
+        auto &q = ShimSocket::pending();
+        if (q.empty()) return WiFiClient();
+        auto s = q.front();
+        q.pop_front();
+        return WiFiClient(s);
+    }
+};
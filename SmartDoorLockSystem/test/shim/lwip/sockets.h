@@ -0,0 +1,38 @@
+/***
+ * send() của lwip cho socket giả trong WiFi.h: chỉ hỗ trợ MSG_DONTWAIT, ghi
+ * nhiều nhất room byte như buffer gửi TCP còn chỗ.
+ ***/
+
+#pragma once
+#include <WiFi.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#ifndef MSG_DONTWAIT
+#define MSG_DONTWAIT 0x08
+#endif
+
+inline ssize_t send(int fd, const void *data, size_t len, int)
+{
+    auto it = ShimSocket::table().find(fd);
+    if (it == ShimSocket::table().end() || it->second->stopped)
+    {
+        errno = EBADF;
+        return -1;
+    }
+    ShimSocket &s = *it->second;
+    if (!s.open)
+    {
+        errno = ECONNRESET;
+        return -1;
+    }
+    if (s.room == 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    size_t n = len < s.room ? len : s.room;
+    s.tx.append((const char *)data, n);
+    if (s.room != SIZE_MAX) s.room -= n;
+    return (ssize_t)n;
+}
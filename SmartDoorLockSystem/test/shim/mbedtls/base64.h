@@ -0,0 +1,31 @@
+/***
+ * mbedtls_base64_encode cho test trên PC, cùng quy ước trả về với mbedtls.
+ ***/
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL -0x002A
+
+inline int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen)
+{
+    static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t need = (slen + 2) / 3 * 4;
+    *olen = need + 1;
+    if (dlen < need + 1) return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    size_t o = 0;
+    for (size_t i = 0; i < slen; i += 3)
+    {
+        uint32_t v = (uint32_t)src[i] << 16;
+        if (i + 1 < slen) v |= (uint32_t)src[i + 1] << 8;
+        if (i + 2 < slen) v |= src[i + 2];
+        dst[o++] = ALPHABET[(v >> 18) & 63];
+        dst[o++] = ALPHABET[(v >> 12) & 63];
+        dst[o++] = i + 1 < slen ? ALPHABET[(v >> 6) & 63] : '=';
+        dst[o++] = i + 2 < slen ? ALPHABET[v & 63] : '=';
+    }
+    dst[o] = '\0';
+    *olen = o;
+    return 0;
+}
@@ -0,0 +1,293 @@
+// Baseline của LatencyBench từ mô hình trên PC: pio test -e native -f test_bench
+//
+// Đồng hồ giả (ShimClock) chạy theo chi phí ước tính của từng thao tác trên
+// đường đo: I2C tới LCD, UART tới AS608, publish MQTT qua TLS, ghi NVS. Mỗi kịch
+// bản đi qua cùng chuỗi thao tác và cùng macro BENCH_* như main.cpp, 32 mẫu có
+// nhiễu từ PRNG cố định nên kết quả lặp lại được. Test in p50/p99 theo cú pháp
+// LatencyBaseline.h, kiểm tra bảng đã check-in khớp mô hình, và kiểm tra mô hình
+// chậm đi thì bench_report báo regression.
+//
+// Sửa đường mở khóa trong main.cpp thì sửa chuỗi thao tác tương ứng ở đây rồi
+// chép bảng mới vào LatencyBaseline.h.
+#define LATENCY_BENCH
+#include <unity.h>
+#include <initializer_list>
+#include "LatencyBench.h"
+
+LatencyBench latencyBench;
+
+// ---------- Chi phí (µs) ----------
+// I2C 100 kHz (main.cpp không đổi clock của Wire): một expanderWrite là start +
+// địa chỉ + 1 byte + stop ~ 20 bit, cộng ~60 µs driver I2C của arduino-esp32
+constexpr uint32_t I2C_TXN_US = 20 * 10 + 60;
+// LiquidCrystal_I2C::send: 2 nibble, mỗi nibble 3 expanderWrite + pulseEnable chờ 1 + 50 µs
+constexpr uint32_t LCD_BYTE_US = 2 * (3 * I2C_TXN_US + 51);
+constexpr uint32_t LCD_CLEAR_US = LCD_BYTE_US + 2000; // clear() chờ 2 ms
+// AS608 ở 57600 baud, 10 bit mỗi byte; gói = 11 byte khung + payload
+constexpr uint32_t UART_BYTE_US = 10 * 1000000 / 57600;
+// Thời gian xử lý trong AS608, giống độ trễ mặc định của AS608Emulator
+constexpr uint32_t AS608_IMG2TZ_US = 40000;
+constexpr uint32_t AS608_SEARCH_US = 20000;
+constexpr uint32_t AS608_LOADCHAR_US = 10000;
+constexpr uint32_t AS608_MATCH_US = 10000;
+// PubSubClient::publish qua TLS: một record mbedtls (AES-GCM) + lwIP, không chờ broker
+constexpr uint32_t TLS_PUBLISH_US = 2500;
+constexpr uint32_t TLS_BYTE_US = 2;
+constexpr uint32_t NVS_WRITE_US = 6000;   // Preferences::putString, không tính xóa trang
+constexpr uint32_t HMAC_SHA1_US = 45;     // mbedtls_md_hmac 8 byte, SHA tăng tốc phần cứng
+constexpr uint32_t CPU_AUTH_US = 30;      // so PIN, AuthPipeline, BLOG, LED, hẹn timer còi
+constexpr uint32_t CPU_SCHEDULE_US = 2;   // chủ thể không có lịch: chỉ đọc một bit
+// Nhiễu thêm vào mỗi thao tác (tối đa)
+constexpr uint32_t NET_JITTER_US = 2000;  // WiFi/lwIP tranh CPU
+constexpr uint32_t NVS_JITTER_US = 4000;
+constexpr uint32_t CPU_JITTER_US = 10;    // ngắt WiFi/timer
+constexpr uint32_t AS608_JITTER_PCT = 10; // xử lý ảnh phụ thuộc ngón tay
+
+constexpr char DOOR_TOPIC[] = "site/4c4700000001/status";
+constexpr char ACK_TOPIC[] = "site/4c4700000001/ack";
+constexpr char FINGER_TOPIC[] = "site/4c4700000001/fingerprint";
+constexpr size_t ACK_LEN = 90; // {"id":..,"rx_ms":..,"done_ms":..,"status":"ok","event":"door_unlocked"}
+
+// ---------- Mô hình ----------
+struct Model
+{
+    uint32_t seed = 1;
+    uint32_t busSlowPct = 100; // I2C/UART/NET/NVS chậm đi (kiểm tra regression)
+    uint32_t cpuSlowPct = 100;
+    uint32_t keypadDelayUs = 500000; // delay(500) trước khi vào menu
+
+    uint32_t jitter(uint32_t maxUs)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) % (maxUs + 1);
+    }
+
+    void bus(uint32_t us) { ShimClock::us += us * busSlowPct / 100; }
+    void cpu(uint32_t us) { ShimClock::us += (us + jitter(CPU_JITTER_US)) * cpuSlowPct / 100; }
+
+    void lcdMsg(const char *l1, const char *l2 = "", const char *l3 = "", const char *l4 = "")
+    {
+        BENCH_SPAN(BENCH_COST_I2C);
+        bus(LCD_CLEAR_US);
+        for (const char *line : {l1, l2, l3, l4}) bus((1 + strlen(line)) * LCD_BYTE_US); // setCursor + chữ
+    }
+
+    void publish(const char *topic, size_t payloadLen)
+    {
+        BENCH_SPAN(BENCH_COST_NET);
+        bus(TLS_PUBLISH_US + (strlen(topic) + payloadLen) * TLS_BYTE_US + jitter(NET_JITTER_US));
+    }
+
+    // Lệnh AS608: gửi payload byte, nhận reply byte payload sau khi xử lý processUs
+    void as608(size_t payload, size_t reply, uint32_t processUs)
+    {
+        uint32_t process = processUs + jitter(processUs * AS608_JITTER_PCT / 100);
+        bus((11 + payload + 11 + reply) * UART_BYTE_US + process);
+    }
+
+    void nvsWrite() { bus(NVS_WRITE_US + jitter(NVS_JITTER_US)); }
+
+    // ---------- Đường đo, theo main.cpp ----------
+    // scheduleAllows()
+    void accessRule()
+    {
+        BENCH_SCOPE(BENCH_ACCESS_RULE);
+        cpu(CPU_SCHEDULE_US);
+    }
+
+    // handleMenu(): ack (nếu lệnh có request ID), door_unlocked rồi kết thúc mẫu
+    void handleMenu(bool ack)
+    {
+        if (ack) publish(ACK_TOPIC, ACK_LEN);
+        publish(DOOR_TOPIC, strlen("door_unlocked"));
+        BENCH_END(BENCH_KEYPAD_PIN);
+        BENCH_END(BENCH_REMOTE_UNLOCK);
+        BENCH_END(BENCH_FINGER_MATCH);
+        BENCH_END(BENCH_FINGER_VERIFY);
+    }
+
+    // Phím PIN thứ 4 -> authFactor(PIN) -> GRANTED
+    void keypadPin()
+    {
+        BENCH_BEGIN(BENCH_KEYPAD_PIN);
+        cpu(CPU_AUTH_US);
+        accessRule();
+        lcdMsg("Correct Pass!");
+        ShimClock::us += keypadDelayUs;
+        handleMenu(false);
+    }
+
+    // runCommand("unlock")
+    void remoteUnlock()
+    {
+        BENCH_BEGIN(BENCH_REMOTE_UNLOCK);
+        handleMenu(true);
+    }
+
+    // Sau match()/verify(): FingerSession chốt ngay lần chụp đầu, authFactor(FINGER) -> GRANTED
+    void fingerGranted()
+    {
+        cpu(CPU_AUTH_US);
+        publish(FINGER_TOPIC, strlen("check_success 7"));
+        accessRule();
+        lcdMsg("Finger OK!");
+        handleMenu(false);
+    }
+
+    // AS608FingerSensor::match(): Img2Tz + HiSpeedSearch
+    void fingerMatch()
+    {
+        BENCH_BEGIN(BENCH_FINGER_MATCH);
+        {
+            BENCH_SPAN(BENCH_COST_UART);
+            as608(2, 1, AS608_IMG2TZ_US);
+            as608(6, 5, AS608_SEARCH_US);
+        }
+        fingerGranted();
+    }
+
+    // AS608FingerSensor::verify() một slot: Img2Tz + LoadChar + Match
+    void fingerVerify()
+    {
+        BENCH_BEGIN(BENCH_FINGER_VERIFY);
+        {
+            BENCH_SPAN(BENCH_COST_UART);
+            as608(2, 1, AS608_IMG2TZ_US);
+            as608(4, 1, AS608_LOADCHAR_US);
+            as608(1, 3, AS608_MATCH_US);
+        }
+        fingerGranted();
+    }
+
+    // runChangePassword(): ghi flash, password_changed, ack; mẫu dừng trước phần hiển thị
+    void changePassword()
+    {
+        BENCH_BEGIN(BENCH_CHANGE_PASSWORD);
+        cpu(CPU_AUTH_US);
+        nvsWrite();
+        publish(DOOR_TOPIC, strlen("password_changed"));
+        publish(ACK_TOPIC, ACK_LEN);
+        BENCH_END(BENCH_CHANGE_PASSWORD);
+    }
+
+    // checkOtp(): Totp::verify thử 3 bước (trước, hiện tại, sau)
+    void otpVerify()
+    {
+        BENCH_SCOPE(BENCH_OTP_VERIFY);
+        cpu(3 * HMAC_SHA1_US);
+    }
+
+    void run()
+    {
+        latencyBench.reset();
+        for (uint8_t i = 0; i < LatencyBench::SAMPLES; i++)
+        {
+            keypadPin();
+            remoteUnlock();
+            fingerMatch();
+            fingerVerify();
+            changePassword();
+            otpVerify();
+        }
+    }
+};
+
+// p50/p99 của một kịch bản từ JSON của bench_report
+struct Result
+{
+    uint32_t p50, p99;
+    bool pass;
+};
+
+static Result report(BenchScenario s)
+{
+    char json[320];
+    Result r;
+    r.pass = latencyBench.report(s, json, sizeof(json));
+    unsigned long p50 = 0, p99 = 0;
+    const char *at = strstr(json, "\"p50_us\":");
+    TEST_ASSERT_NOT_NULL(at);
+    TEST_ASSERT_EQUAL(2, sscanf(at, "\"p50_us\":%lu,\"p99_us\":%lu", &p50, &p99));
+    r.p50 = p50;
+    r.p99 = p99;
+    return r;
+}
+
+void setUp()
+{
+    ShimClock::ms = 0;
+    ShimClock::us = 0;
+}
+void tearDown() {}
+
+void test_checked_in_baseline_matches_model()
+{
+    Model model;
+    model.run();
+    bool match = true;
+    printf("LATENCY_BASELINE từ mô hình:\n");
+    for (uint8_t s = 0; s < BENCH_SCENARIO_COUNT; s++)
+    {
+        Result r = report((BenchScenario)s);
+        printf("    {%lu, %lu}, // %s\n", (unsigned long)r.p50, (unsigned long)r.p99,
+               LatencyBench::scenarioName((BenchScenario)s));
+        match &= r.p50 == LATENCY_BASELINE[s].p50Us && r.p99 == LATENCY_BASELINE[s].p99Us;
+        TEST_ASSERT_TRUE(r.pass);
+    }
+    TEST_ASSERT_TRUE_MESSAGE(match, "chép bảng in ở trên vào lib/LatencyBench/LatencyBaseline.h");
+}
+
+void test_every_scenario_has_a_baseline()
+{
+    for (uint8_t s = 0; s < BENCH_SCENARIO_COUNT; s++)
+    {
+        TEST_ASSERT_NOT_EQUAL(0, LATENCY_BASELINE[s].p50Us);
+        TEST_ASSERT_GREATER_OR_EQUAL(LATENCY_BASELINE[s].p50Us, LATENCY_BASELINE[s].p99Us);
+    }
+}
+
+// Bus chậm đi 50% (ví dụ LCD thêm clear(), publish thêm một bản tin) phải bị bắt
+void test_slower_bus_is_a_regression()
+{
+    Model model;
+    model.busSlowPct = 150;
+    model.run();
+    for (BenchScenario s : {BENCH_REMOTE_UNLOCK, BENCH_FINGER_MATCH, BENCH_FINGER_VERIFY, BENCH_CHANGE_PASSWORD})
+        TEST_ASSERT_FALSE_MESSAGE(report(s).pass, LatencyBench::scenarioName(s));
+    // keypad_pin gần như toàn delay(500): bus chậm 50% chưa vượt ngưỡng, thêm một delay thì có
+    TEST_ASSERT_TRUE(report(BENCH_KEYPAD_PIN).pass);
+}
+
+void test_extra_delay_on_keypad_path_is_a_regression()
+{
+    Model model;
+    model.keypadDelayUs += 150000; // thêm 150 ms chặn trên đường mở khóa
+    model.run();
+    TEST_ASSERT_FALSE(report(BENCH_KEYPAD_PIN).pass);
+}
+
+// Kịch bản chỉ tốn CPU (vài µs) có sàn LATENCY_REGRESSION_MIN_US: nhiễu ngắt không
+// làm fail, nhưng chậm đi hàng chục lần (ví dụ đọc flash mỗi lần) thì có
+void test_cpu_scenarios_need_a_real_slowdown()
+{
+    Model model;
+    model.cpuSlowPct = 200;
+    model.run();
+    TEST_ASSERT_TRUE(report(BENCH_ACCESS_RULE).pass);
+
+    model.cpuSlowPct = 3000;
+    model.run();
+    TEST_ASSERT_FALSE(report(BENCH_ACCESS_RULE).pass);
+    TEST_ASSERT_FALSE(report(BENCH_OTP_VERIFY).pass);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_checked_in_baseline_matches_model);
+    RUN_TEST(test_every_scenario_has_a_baseline);
+    RUN_TEST(test_slower_bus_is_a_regression);
+    RUN_TEST(test_extra_delay_on_keypad_path_is_a_regression);
+    RUN_TEST(test_cpu_scenarios_need_a_real_slowdown);
+    return UNITY_END();
+}
@@ -0,0 +1,324 @@
+// Soak test cho các đường dùng buffer cố định thay String (LcdLine, client ID,
+// mật khẩu, lệnh MQTT): pio test -e native -f test_heap
+//
+// malloc/free của cả tiến trình được thay bằng một heap first-fit 64 KB (có gộp
+// khối trống kề nhau) khi "armed", nên mọi cấp phát trong lúc đo đều bị đếm và
+// để lại lỗ như heap thật. HeapTracker đọc số liệu của heap đó qua ESP giả.
+// Chỉ chạy trên glibc (thay malloc bằng __libc_malloc).
+#include <unity.h>
+#include "Arduino.h"
+#include "DoorProtocol.h"
+#include "HeapTracker.h"
+#include "LcdLine.h"
+#include "RequestCache.h"
+#include "TokenBucket.h"
+
+using namespace DoorProtocol;
+
+// ---------- Heap phân mảnh ----------
+class FragmentingHeap
+{
+public:
+    static constexpr size_t SIZE = 64 * 1024;
+
+    bool armed = false;
+    uint32_t allocations = 0;
+
+    void reset()
+    {
+        Block *b = first();
+        b->size = SIZE;
+        b->used = 0;
+        allocations = 0;
+    }
+
+    bool owns(const void *p) const { return p >= _mem && p < _mem + SIZE; }
+
+    void *alloc(size_t n)
+    {
+        allocations++;
+        size_t need = (n + 15) / 16 * 16 + sizeof(Block);
+        for (Block *b = first(); b; b = next(b))
+        {
+            if (b->used || b->size < need) continue;
+            if (b->size - need >= 2 * sizeof(Block))
+            {
+                Block *rest = (Block *)((uint8_t *)b + need);
+                rest->size = b->size - need;
+                rest->used = 0;
+                b->size = need;
+            }
+            b->used = 1;
+            return b + 1;
+        }
+        return nullptr;
+    }
+
+    void release(void *p)
+    {
+        ((Block *)p - 1)->used = 0;
+        for (Block *b = first(); b; b = next(b))
+        {
+            Block *n;
+            while (!b->used && (n = next(b)) && !n->used) b->size += n->size;
+        }
+    }
+
+    size_t payload(const void *p) const { return ((const Block *)p - 1)->size - sizeof(Block); }
+
+    // Như ESP.getFreeHeap() / getMaxAllocHeap()
+    uint32_t freeBytes() const
+    {
+        uint32_t sum = 0;
+        for (const Block *b = first(); b; b = next(b))
+            if (!b->used) sum += b->size - sizeof(Block);
+        return sum;
+    }
+
+    uint32_t largestBlock() const
+    {
+        uint32_t largest = 0;
+        for (const Block *b = first(); b; b = next(b))
+            if (!b->used && b->size - sizeof(Block) > largest) largest = b->size - sizeof(Block);
+        return largest;
+    }
+
+private:
+    struct Block
+    {
+        uint32_t size; // tính cả header
+        uint32_t used;
+        uint64_t pad;  // payload căn 16 byte
+    };
+
+    alignas(16) uint8_t _mem[SIZE];
+
+    Block *first() { return (Block *)_mem; }
+    const Block *first() const { return (const Block *)_mem; }
+    Block *next(Block *b) { return (uint8_t *)b + b->size < _mem + SIZE ? (Block *)((uint8_t *)b + b->size) : nullptr; }
+    const Block *next(const Block *b) const
+    {
+        return (const uint8_t *)b + b->size < _mem + SIZE ? (const Block *)((const uint8_t *)b + b->size) : nullptr;
+    }
+};
+
+static FragmentingHeap heap;
+
+extern "C" void *__libc_malloc(size_t);
+extern "C" void __libc_free(void *);
+extern "C" void *__libc_calloc(size_t, size_t);
+extern "C" void *__libc_realloc(void *, size_t);
+
+extern "C" void *malloc(size_t n)
+{
+    return heap.armed ? heap.alloc(n) : __libc_malloc(n);
+}
+
+extern "C" void free(void *p)
+{
+    if (heap.owns(p)) heap.release(p);
+    else __libc_free(p);
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+    if (!heap.armed) return __libc_calloc(n, size);
+    void *p = heap.alloc(n * size);
+    if (p) memset(p, 0, n * size);
+    return p;
+}
+
+extern "C" void *realloc(void *p, size_t n)
+{
+    if (!heap.owns(p))
+    {
+        if (!heap.armed || p) return __libc_realloc(p, n);
+        return heap.alloc(n);
+    }
+    void *q = heap.alloc(n);
+    if (q)
+    {
+        size_t old = heap.payload(p);
+        memcpy(q, p, old < n ? old : n);
+    }
+    heap.release(p);
+    return q;
+}
+
+static void sampleHeap(HeapTracker &tracker)
+{
+    ESP.freeHeap = heap.freeBytes();
+    ESP.maxAllocHeap = heap.largestBlock();
+    if (!ESP.minFreeHeap || ESP.freeHeap < ESP.minFreeHeap) ESP.minFreeHeap = ESP.freeHeap;
+    ShimClock::ms += 10000;
+    tracker.sample();
+}
+
+void setUp()
+{
+    heap.reset();
+    ESP = ShimEsp();
+    ShimClock::ms = 0;
+}
+
+void tearDown() { heap.armed = false; }
+
+// ---------- Đúng chức năng ----------
+void test_fixed_buffers_format_and_truncate()
+{
+    TEST_ASSERT_EQUAL_STRING("Fails: 3", LcdLine("Fails: %u", 3u).text);
+    LcdLine longLine("%s", "this line is longer than twenty columns");
+    TEST_ASSERT_EQUAL(LcdLine::COLS, strlen(longLine.text));
+
+    char clientId[CLIENT_ID_LEN];
+    TEST_ASSERT_EQUAL(CLIENT_ID_LEN - 1, formatClientId(clientId, sizeof(clientId), "a1b2c3d4e5f6"));
+    TEST_ASSERT_EQUAL_STRING("ESP32_Door_a1b2c3d4e5f6", clientId);
+
+    char msg[16];
+    const char payload[] = "unlock\r\n";
+    TEST_ASSERT_EQUAL(6, copyCommand(msg, sizeof(msg), (const uint8_t *)payload, strlen(payload)));
+    TEST_ASSERT_EQUAL_STRING("unlock", msg);
+    const char longPayload[] = "change_password12345678";
+    TEST_ASSERT_EQUAL(15, copyCommand(msg, sizeof(msg), (const uint8_t *)longPayload, strlen(longPayload)));
+
+    char pass[PASS_LEN + 1];
+    PasswordCheck ok = parseNewPassword(" 5678\n", pass);
+    TEST_ASSERT_NULL(ok.error);
+    TEST_ASSERT_EQUAL_STRING("5678", pass);
+    PasswordCheck shortPass = parseNewPassword("567", pass);
+    TEST_ASSERT_EQUAL_STRING(EVT_PASSWORD_ERROR_LENGTH, shortPass.error);
+    TEST_ASSERT_EQUAL(3, shortPass.len);
+    PasswordCheck letter = parseNewPassword("56a8", pass);
+    TEST_ASSERT_EQUAL_STRING(EVT_PASSWORD_ERROR_FORMAT, letter.error);
+    TEST_ASSERT_EQUAL(2, letter.badIndex);
+    TEST_ASSERT_EQUAL('a', letter.badChar);
+}
+
+// Kiểm tra chính heap giả: kiểu cấp phát của String (chuỗi tạm lớn dần xen với
+// chuỗi sống lâu) phải bị đếm và làm phân mảnh tăng, nếu không test soak vô nghĩa
+void test_heap_model_catches_string_churn()
+{
+    HeapTracker tracker;
+    heap.armed = true;
+    void *kept[32] = {};
+    for (unsigned i = 0; i < 2000; i++)
+    {
+        char *tmp = (char *)malloc(8);
+        tmp = (char *)realloc(tmp, 24 + i % 40); // "wrong_pass: " + String(n)
+        free(kept[i % 32]);
+        kept[i % 32] = malloc(16 + (i * 7) % 48); // String giữ lại, độ dài khác nhau
+        free(tmp);
+        if (i % 100 == 0) sampleHeap(tracker);
+    }
+    heap.armed = false;
+    TEST_ASSERT_GREATER_THAN(0, heap.allocations);
+    TEST_ASSERT_GREATER_THAN(0, tracker.worstFragmentation());
+    for (void *p : kept) free(p);
+}
+
+// ---------- Soak ----------
+static constexpr uint32_t SOAK_EVENTS = 2000000;
+
+void test_soak_fixed_buffers_never_allocate()
+{
+    static const char *const PAYLOADS[] = {
+        "req a1b2c3 1712345678\nunlock\r\n",
+        "change_password5678\n",
+        "change_password12a4",
+        "req x-9 \nset_group tang2",
+        "metrics",
+        "req this-id-is-way-too-long-for-the-cache 1\nunlock",
+    };
+    static const size_t PAYLOAD_COUNT = sizeof(PAYLOADS) / sizeof(PAYLOADS[0]);
+    size_t payloadLen[PAYLOAD_COUNT];
+    for (size_t i = 0; i < PAYLOAD_COUNT; i++) payloadLen[i] = strlen(PAYLOADS[i]);
+    static uint8_t oversize[700];
+    memset(oversize, 'x', sizeof(oversize));
+
+    char password[PASS_LEN + 1] = "1234";
+    RequestCache<8> cache;
+    TokenBucket bucket(5, 1000);
+    HeapTracker tracker;
+    sampleHeap(tracker);
+    uint8_t startFrag = tracker.worstFragmentation();
+    uint32_t startFree = heap.freeBytes();
+    uint32_t checksum = 0;
+
+    heap.armed = true;
+    for (uint32_t i = 0; i < SOAK_EVENTS; i++)
+    {
+        char msg[512];
+        char out[160];
+        switch (i % 8)
+        {
+        case 0: // keypad sai PIN
+            formatWrongPass(out, sizeof(out), i % 7);
+            checksum += LcdLine("Fails: %u", (unsigned)(i % 7)).text[7];
+            break;
+        case 1: // MQTT kết nối lại
+            formatClientId(out, CLIENT_ID_LEN, "a1b2c3d4e5f6");
+            checksum += out[11];
+            break;
+        case 2: // payload quá buffer
+            checksum += copyCommand(msg, sizeof(msg), oversize, sizeof(oversize));
+            break;
+        case 3: // màn hình mạng / chẩn đoán
+            checksum += LcdLine("%u.%u.%u.%u", 192u, 168u, (unsigned)(i & 0xFF), 7u).text[0];
+            checksum += LcdLine("Heap: %lu/%lu", (unsigned long)i, (unsigned long)(i / 3)).text[6];
+            break;
+        default: // lệnh MQTT: header, đổi mật khẩu, log, ack
+        {
+            size_t n = (i / 8 + i) % PAYLOAD_COUNT;
+            copyCommand(msg, sizeof(msg), (const uint8_t *)PAYLOADS[n], payloadLen[n]);
+            RequestHeader req;
+            const char *cmd = parseRequest(msg, req);
+            if (!cmd) break;
+            req.rxMs = i;
+            char verb[24];
+            commandVerb(cmd, verb, sizeof(verb));
+            checksum += commandClass(cmd);
+            if (req.id[0] && !cache.find(req.id)) cache.insert(req.id);
+            bucket.take(i);
+            const char *event = EVT_DOOR_UNLOCKED;
+            if (startsWith(cmd, CMD_CHANGE_PASSWORD))
+            {
+                char newPass[PASS_LEN + 1];
+                PasswordCheck check = parseNewPassword(cmd + strlen(CMD_CHANGE_PASSWORD), newPass);
+                if (check.error) event = check.error;
+                else strlcpy(password, newPass, sizeof(password));
+            }
+            if (req.id[0])
+            {
+                cache.complete(req.id, true, event);
+                formatAck(out, sizeof(out), req, i, "ok", event);
+            }
+            checksum += out[0];
+            break;
+        }
+        }
+        if (i % 100000 == 0)
+        {
+            heap.armed = false; // HeapTracker đọc heap, không tính vào số đo
+            sampleHeap(tracker);
+            heap.armed = true;
+        }
+    }
+    heap.armed = false;
+    sampleHeap(tracker);
+
+    TEST_ASSERT_EQUAL(0, heap.allocations);
+    TEST_ASSERT_EQUAL(startFree, heap.freeBytes());
+    TEST_ASSERT_EQUAL(startFrag, tracker.worstFragmentation());
+    TEST_ASSERT_EQUAL(startFree, tracker.minLargestBlock());
+    TEST_ASSERT_EQUAL_STRING("5678", password);
+    TEST_ASSERT_NOT_EQUAL(0, checksum);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_fixed_buffers_format_and_truncate);
+    RUN_TEST(test_heap_model_catches_string_churn);
+    RUN_TEST(test_soak_fixed_buffers_never_allocate);
+    return UNITY_END();
+}
@@ -0,0 +1,279 @@
+// Test LanProtocol (HTTP/WebSocket) và LanServer trên PC qua socket giả
+// trong test/shim: pio test -e native -f test_lan
+#include <unity.h>
+#include <memory>
+#include <string>
+#include "LanProtocol.h"
+#include "LanServer.h"
+
+using namespace LanProtocol;
+
+static const char *TOKEN = "0123456789abcdef";
+
+// Frame client có mask, như trình duyệt gửi
+static std::string clientFrame(uint8_t opcode, const std::string &payload, bool fin = true, bool masked = true)
+{
+    static const uint8_t MASK[4] = {0x12, 0x34, 0x56, 0x78};
+    std::string f;
+    f += (char)((fin ? 0x80 : 0) | opcode);
+    size_t n = payload.size();
+    if (n < 126)
+    {
+        f += (char)((masked ? 0x80 : 0) | n);
+    }
+    else
+    {
+        f += (char)((masked ? 0x80 : 0) | 126);
+        f += (char)(n >> 8);
+        f += (char)(n & 0xFF);
+    }
+    if (masked) f.append((const char *)MASK, 4);
+    for (size_t i = 0; i < n; i++) f += (char)(payload[i] ^ (masked ? MASK[i & 3] : 0));
+    return f;
+}
+
+// Payload của frame server (không mask) ở đầu tx, bỏ frame đó khỏi tx
+static std::string takeServerFrame(std::string &tx)
+{
+    if (tx.size() < 2) return "";
+    size_t n = (uint8_t)tx[1] & 0x7F, off = 2;
+    if (n == 126)
+    {
+        n = (size_t)(uint8_t)tx[2] << 8 | (uint8_t)tx[3];
+        off = 4;
+    }
+    std::string payload = tx.substr(off, n);
+    tx.erase(0, off + n);
+    return payload;
+}
+
+static void assertFrame(const char *expected, std::string &tx)
+{
+    std::string payload = takeServerFrame(tx);
+    TEST_ASSERT_EQUAL_STRING(expected, payload.c_str());
+}
+
+void setUp() { ShimSocket::reset(); }
+void tearDown() {}
+
+// ---------- parseHead ----------
+void test_parse_head_post_command()
+{
+    std::string req = std::string("POST /command HTTP/1.1\r\nHost: door\r\nauthorization: bearer ") + TOKEN +
+                      "\r\nContent-Length: 6\r\n\r\nunlock";
+    HttpHead h;
+    TEST_ASSERT_EQUAL(PARSE_OK, parseHead(req.data(), req.size(), h));
+    TEST_ASSERT_EQUAL_STRING("POST", h.method);
+    TEST_ASSERT_EQUAL_STRING("/command", h.path);
+    TEST_ASSERT_EQUAL_STRING(TOKEN, h.token);
+    TEST_ASSERT_EQUAL(6, h.contentLength);
+    TEST_ASSERT_EQUAL(req.size() - 6, h.headLen);
+    TEST_ASSERT_EQUAL_STRING("", h.wsKey);
+}
+
+void test_parse_head_query_token_and_ws_key()
+{
+    std::string req = std::string("GET /events?x=1&token=") + TOKEN +
+                      " HTTP/1.1\r\nUpgrade: websocket\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    HttpHead h;
+    TEST_ASSERT_EQUAL(PARSE_OK, parseHead(req.data(), req.size(), h));
+    TEST_ASSERT_EQUAL_STRING("/events", h.path);
+    TEST_ASSERT_EQUAL_STRING(TOKEN, h.token);
+    TEST_ASSERT_EQUAL_STRING("dGhlIHNhbXBsZSBub25jZQ==", h.wsKey);
+}
+
+void test_parse_head_incomplete_and_bad()
+{
+    HttpHead h;
+    const char partial[] = "POST /command HTTP/1.1\r\nContent-Length: 6\r\n";
+    TEST_ASSERT_EQUAL(PARSE_MORE, parseHead(partial, strlen(partial), h));
+
+    std::string endless(HEAD_MAX, 'a');
+    TEST_ASSERT_EQUAL(PARSE_BAD, parseHead(endless.data(), endless.size(), h));
+
+    const char noVersion[] = "POST /command\r\n\r\n";
+    TEST_ASSERT_EQUAL(PARSE_BAD, parseHead(noVersion, strlen(noVersion), h));
+    const char noColon[] = "GET / HTTP/1.1\r\nbroken header\r\n\r\n";
+    TEST_ASSERT_EQUAL(PARSE_BAD, parseHead(noColon, strlen(noColon), h));
+    const char badLength[] = "POST /command HTTP/1.1\r\nContent-Length: x\r\n\r\n";
+    TEST_ASSERT_EQUAL(PARSE_BAD, parseHead(badLength, strlen(badLength), h));
+}
+
+// ---------- wsAccept ----------
+void test_ws_accept_rfc6455_sample()
+{
+    char accept[WS_ACCEPT_LEN];
+    TEST_ASSERT_TRUE(wsAccept("dGhlIHNhbXBsZSBub25jZQ==", accept, sizeof(accept)));
+    TEST_ASSERT_EQUAL_STRING("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=", accept);
+    TEST_ASSERT_FALSE(wsAccept("", accept, sizeof(accept)));
+}
+
+// ---------- wsDecode ----------
+void test_ws_decode_masked_text()
+{
+    std::string f = clientFrame(WS_TEXT, "unlock");
+    WsFrame frame;
+    TEST_ASSERT_EQUAL((int)f.size(), wsDecode((uint8_t *)&f[0], f.size(), frame));
+    TEST_ASSERT_EQUAL(WS_TEXT, frame.opcode);
+    TEST_ASSERT_EQUAL(6, frame.len);
+    TEST_ASSERT_EQUAL_MEMORY("unlock", frame.payload, 6);
+}
+
+void test_ws_decode_partial_and_extended_length()
+{
+    std::string big(300, 'x');
+    std::string f = clientFrame(WS_TEXT, big);
+    WsFrame frame;
+    TEST_ASSERT_EQUAL(0, wsDecode((uint8_t *)&f[0], 1, frame));
+    TEST_ASSERT_EQUAL(0, wsDecode((uint8_t *)&f[0], 3, frame));
+    TEST_ASSERT_EQUAL(0, wsDecode((uint8_t *)&f[0], f.size() - 1, frame));
+    TEST_ASSERT_EQUAL((int)f.size(), wsDecode((uint8_t *)&f[0], f.size(), frame));
+    TEST_ASSERT_EQUAL(300, frame.len);
+    TEST_ASSERT_EQUAL_MEMORY(big.data(), frame.payload, 300);
+}
+
+void test_ws_decode_rejects_bad_frames()
+{
+    WsFrame frame;
+    std::string unmasked = clientFrame(WS_TEXT, "unlock", true, false);
+    TEST_ASSERT_EQUAL(-1, wsDecode((uint8_t *)&unmasked[0], unmasked.size(), frame));
+    std::string fragment = clientFrame(WS_TEXT, "unl", false);
+    TEST_ASSERT_EQUAL(-1, wsDecode((uint8_t *)&fragment[0], fragment.size(), frame));
+    std::string tooBig = clientFrame(WS_TEXT, std::string(MSG_MAX + 1, 'x'));
+    TEST_ASSERT_EQUAL(-1, wsDecode((uint8_t *)&tooBig[0], tooBig.size(), frame));
+}
+
+// ---------- LanServer qua socket giả ----------
+static std::unique_ptr<LanServer> server;
+
+static void resetServer()
+{
+    server.reset(new LanServer(8080));
+    server->setToken(TOKEN);
+    server->begin();
+}
+
+// Kết nối WS đã bắt tay xong, tx đã bỏ response 101
+static std::shared_ptr<ShimSocket> openEvents(uint32_t now)
+{
+    auto sock = ShimSocket::connect();
+    sock->rx = std::string("GET /events?token=") + TOKEN +
+               " HTTP/1.1\r\nUpgrade: websocket\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    LanServer::Command cmd;
+    TEST_ASSERT_FALSE(server->poll(cmd, now));
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, sock->tx.find("101 Switching Protocols"));
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, sock->tx.find("s3pPLMBiTxaQ9kYGzzhZRbK+xOo="));
+    sock->tx.clear();
+    return sock;
+}
+
+void test_server_post_command_and_reply()
+{
+    resetServer();
+    auto sock = ShimSocket::connect();
+    sock->rx = std::string("POST /command HTTP/1.1\r\nAuthorization: Bearer ") + TOKEN +
+               "\r\nContent-Length: 7\r\n\r\nunlock\n";
+    LanServer::Command cmd;
+    TEST_ASSERT_TRUE(server->poll(cmd, 0));
+    TEST_ASSERT_EQUAL_STRING("unlock", cmd.text);
+    server->reply(cmd.slot, "ok", "door_unlocked");
+    TEST_ASSERT_EQUAL(0, sock->tx.find("HTTP/1.1 200 OK"));
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, sock->tx.find("\r\n\r\nok\ndoor_unlocked"));
+    TEST_ASSERT_TRUE(sock->stopped);
+}
+
+void test_server_post_body_in_fragments()
+{
+    resetServer();
+    auto sock = ShimSocket::connect();
+    std::string req = std::string("POST /command HTTP/1.1\r\nAuthorization: Bearer ") + TOKEN +
+                      "\r\nContent-Length: 6\r\n\r\nunlock";
+    LanServer::Command cmd;
+    for (size_t i = 0; i + 1 < req.size(); i += 5)
+    {
+        sock->rx += req.substr(i, 5 < req.size() - 1 - i ? 5 : req.size() - 1 - i);
+        TEST_ASSERT_FALSE(server->poll(cmd, 0));
+    }
+    sock->rx += req.back();
+    TEST_ASSERT_TRUE(server->poll(cmd, 0));
+    TEST_ASSERT_EQUAL_STRING("unlock", cmd.text);
+}
+
+void test_server_rejects_bad_token()
+{
+    resetServer();
+    auto sock = ShimSocket::connect();
+    sock->rx = "POST /command HTTP/1.1\r\nAuthorization: Bearer wrong-token-000000\r\nContent-Length: 6\r\n\r\nunlock";
+    LanServer::Command cmd;
+    TEST_ASSERT_FALSE(server->poll(cmd, 0));
+    TEST_ASSERT_EQUAL(0, sock->tx.find("HTTP/1.1 401 Unauthorized"));
+    TEST_ASSERT_TRUE(sock->stopped);
+    TEST_ASSERT_EQUAL(1, server->authFailures());
+}
+
+void test_server_ws_command_reply_and_broadcast()
+{
+    resetServer();
+    auto sock = openEvents(0);
+    TEST_ASSERT_EQUAL(1, server->eventClients());
+
+    sock->rx = clientFrame(WS_TEXT, "metrics");
+    LanServer::Command cmd;
+    TEST_ASSERT_TRUE(server->poll(cmd, 1));
+    TEST_ASSERT_EQUAL_STRING("metrics", cmd.text);
+    server->reply(cmd.slot, "ok", "metrics_sent");
+    assertFrame("reply\nok\nmetrics_sent", sock->tx);
+
+    server->broadcast("site/abc/status", "door_unlocked");
+    assertFrame("site/abc/status\ndoor_unlocked", sock->tx);
+    TEST_ASSERT_EQUAL(0, server->droppedFrames());
+}
+
+void test_broadcast_drops_frame_when_send_buffer_full()
+{
+    resetServer();
+    auto slow = openEvents(0);
+    auto fast = openEvents(0);
+    slow->room = 0;
+
+    server->broadcast("site/abc/status", "door_unlocked");
+    TEST_ASSERT_TRUE(slow->tx.empty());
+    assertFrame("site/abc/status\ndoor_unlocked", fast->tx);
+    TEST_ASSERT_EQUAL(1, server->droppedFrames());
+    TEST_ASSERT_FALSE(slow->stopped); // chỉ bỏ frame, client đọc kịp lại thì nhận tiếp
+    TEST_ASSERT_EQUAL(2, server->eventClients());
+
+    slow->room = SIZE_MAX;
+    server->broadcast("site/abc/status", "door_locked");
+    assertFrame("site/abc/status\ndoor_locked", slow->tx);
+}
+
+void test_broadcast_closes_client_after_partial_frame()
+{
+    resetServer();
+    auto sock = openEvents(0);
+    sock->room = 3;
+    server->broadcast("site/abc/status", "door_unlocked");
+    TEST_ASSERT_EQUAL(1, server->droppedFrames());
+    TEST_ASSERT_TRUE(sock->stopped);
+    TEST_ASSERT_EQUAL(0, server->eventClients());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_parse_head_post_command);
+    RUN_TEST(test_parse_head_query_token_and_ws_key);
+    RUN_TEST(test_parse_head_incomplete_and_bad);
+    RUN_TEST(test_ws_accept_rfc6455_sample);
+    RUN_TEST(test_ws_decode_masked_text);
+    RUN_TEST(test_ws_decode_partial_and_extended_length);
+    RUN_TEST(test_ws_decode_rejects_bad_frames);
+    RUN_TEST(test_server_post_command_and_reply);
+    RUN_TEST(test_server_post_body_in_fragments);
+    RUN_TEST(test_server_rejects_bad_token);
+    RUN_TEST(test_server_ws_command_reply_and_broadcast);
+    RUN_TEST(test_broadcast_drops_frame_when_send_buffer_full);
+    RUN_TEST(test_broadcast_closes_client_after_partial_frame);
+    return UNITY_END();
+}
@@ -0,0 +1,221 @@
+// Bản vá OTA qua đúng đường của OtaUpdater: nén zlib -> giải nén theo luồng ->
+// DeltaPatch::feed, với mẩu vào/ra lẻ để varint, header và lệnh bị cắt ngang
+// ở mọi chỗ: pio test -e native -f test_ota
+//
+// Firmware giải nén bằng tinfl trong ROM ESP32; trên PC dùng zlib (cùng định
+// dạng), nên env native link thêm -lz.
+#include <unity.h>
+#include <zlib.h>
+#include <vector>
+#include "DeltaPatch.h"
+
+using Bytes = std::vector<uint8_t>;
+
+// ---------- Ảnh và bản vá ----------
+static Bytes randomBytes(size_t len, uint32_t seed)
+{
+    Bytes out(len);
+    for (auto &b : out)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        b = seed >> 24;
+    }
+    return out;
+}
+
+static uint32_t crcOf(const Bytes &b) { return DeltaPatch::crc32(0, b.data(), b.size()); }
+
+class PatchWriter
+{
+public:
+    Bytes raw;
+
+    void header(const Bytes &oldImage, const Bytes &newImage)
+    {
+        raw.insert(raw.end(), {'D', 'L', 'T', '1'});
+        u32(oldImage.size());
+        u32(crcOf(oldImage));
+        u32(newImage.size());
+        u32(crcOf(newImage));
+    }
+
+    void copy(uint32_t off, uint32_t len)
+    {
+        raw.push_back(DeltaPatch::OP_COPY);
+        varint(off);
+        varint(len);
+    }
+
+    void add(uint32_t off, const Bytes &diff)
+    {
+        raw.push_back(DeltaPatch::OP_ADD);
+        varint(off);
+        varint(diff.size());
+        raw.insert(raw.end(), diff.begin(), diff.end());
+    }
+
+    void insert(const Bytes &bytes)
+    {
+        raw.push_back(DeltaPatch::OP_INSERT);
+        varint(bytes.size());
+        raw.insert(raw.end(), bytes.begin(), bytes.end());
+    }
+
+    void end() { raw.push_back(DeltaPatch::OP_END); }
+
+private:
+    void u32(uint32_t v)
+    {
+        for (int i = 0; i < 4; i++) raw.push_back(v >> (8 * i));
+    }
+
+    void varint(uint32_t v)
+    {
+        while (v >= 0x80)
+        {
+            raw.push_back((v & 0x7F) | 0x80);
+            v >>= 7;
+        }
+        raw.push_back(v);
+    }
+};
+
+// Giống một bản build mới: thêm code ở giữa (INSERT), phần sau bị dời nên vài
+// byte con trỏ đổi (ADD), phần còn lại giữ nguyên (COPY), thêm đuôi.
+struct Fixture
+{
+    Bytes oldImage = randomBytes(20000, 1);
+    Bytes newImage;
+    Bytes insertMid = randomBytes(37, 2);
+    Bytes insertTail = randomBytes(100, 3);
+    Bytes addDiff = Bytes(4096, 0);
+    PatchWriter patch;
+
+    Fixture()
+    {
+        for (size_t i = 0; i < addDiff.size(); i += 64) addDiff[i] = 4;
+        newImage.assign(oldImage.begin(), oldImage.begin() + 4096);
+        newImage.insert(newImage.end(), insertMid.begin(), insertMid.end());
+        for (size_t i = 0; i < addDiff.size(); i++) newImage.push_back(oldImage[4096 + i] + addDiff[i]);
+        newImage.insert(newImage.end(), oldImage.begin() + 8192, oldImage.end());
+        newImage.insert(newImage.end(), insertTail.begin(), insertTail.end());
+
+        patch.header(oldImage, newImage);
+        patch.copy(0, 4096);
+        patch.insert(insertMid);
+        patch.add(4096, addDiff);
+        patch.copy(8192, oldImage.size() - 8192);
+        patch.insert(insertTail);
+        patch.end();
+    }
+};
+
+// ---------- Đường nhận của OtaUpdater ----------
+struct Flash
+{
+    const Bytes *oldImage;
+    Bytes written;
+};
+
+static bool readOld(void *ctx, uint32_t offset, uint8_t *buf, size_t len)
+{
+    const Bytes &old = *((Flash *)ctx)->oldImage;
+    if (offset + len > old.size()) return false;
+    memcpy(buf, old.data() + offset, len);
+    return true;
+}
+
+static bool writeNew(void *ctx, const uint8_t *buf, size_t len)
+{
+    Bytes &out = ((Flash *)ctx)->written;
+    out.insert(out.end(), buf, buf + len);
+    return true;
+}
+
+static Bytes deflate(const Bytes &raw)
+{
+    uLongf size = compressBound(raw.size());
+    Bytes out(size);
+    TEST_ASSERT_EQUAL(Z_OK, compress2(out.data(), &size, raw.data(), raw.size(), 9));
+    out.resize(size);
+    return out;
+}
+
+// Mẩu MQTT vào inChunk byte, mỗi lần giải nén ra tối đa outChunk byte
+static DeltaPatch::Status applyStreamed(const Bytes &blob, const Bytes &oldImage, size_t inChunk, size_t outChunk,
+                                        Flash &flash)
+{
+    DeltaPatch patch;
+    flash = {&oldImage, {}};
+    patch.begin(readOld, writeNew, &flash);
+
+    z_stream z = {};
+    TEST_ASSERT_EQUAL(Z_OK, inflateInit(&z));
+    Bytes out(outChunk);
+    int rc = Z_OK;
+    for (size_t off = 0; off < blob.size() && rc != Z_STREAM_END && patch.status() == DeltaPatch::IN_PROGRESS;
+         off += inChunk)
+    {
+        z.next_in = (Bytef *)blob.data() + off;
+        z.avail_in = blob.size() - off < inChunk ? blob.size() - off : inChunk;
+        // Buffer ra đầy thì có thể còn dữ liệu chờ, giải nén tiếp với cùng mẩu vào
+        do
+        {
+            z.next_out = out.data();
+            z.avail_out = outChunk;
+            rc = inflate(&z, Z_NO_FLUSH);
+            TEST_ASSERT_TRUE(rc == Z_OK || rc == Z_STREAM_END || rc == Z_BUF_ERROR);
+            if (z.avail_out < outChunk) patch.feed(out.data(), outChunk - z.avail_out);
+        } while (z.avail_out == 0 && rc != Z_STREAM_END && patch.status() == DeltaPatch::IN_PROGRESS);
+    }
+    inflateEnd(&z);
+    return patch.status();
+}
+
+// ---------- Test ----------
+void setUp() {}
+void tearDown() {}
+
+void test_patch_applies_with_odd_chunks()
+{
+    Fixture f;
+    Bytes blob = deflate(f.patch.raw);
+    const size_t sizes[][2] = {{1, 1}, {7, 13}, {61, 3}, {397, 509}, {400, 4095}, {blob.size(), 1}};
+    for (auto &s : sizes)
+    {
+        Flash flash;
+        TEST_ASSERT_EQUAL(DeltaPatch::DONE, applyStreamed(blob, f.oldImage, s[0], s[1], flash));
+        TEST_ASSERT_EQUAL(f.newImage.size(), flash.written.size());
+        TEST_ASSERT_EQUAL_MEMORY(f.newImage.data(), flash.written.data(), f.newImage.size());
+    }
+}
+
+void test_wrong_base_image_is_rejected_before_writing()
+{
+    Fixture f;
+    Bytes otherImage = f.oldImage;
+    otherImage[12345] ^= 0x01; // ảnh đang chạy không phải ảnh gốc của bản vá
+    Flash flash;
+    TEST_ASSERT_EQUAL(DeltaPatch::ERR_BASE, applyStreamed(deflate(f.patch.raw), otherImage, 13, 7, flash));
+    TEST_ASSERT_EQUAL(0, flash.written.size());
+}
+
+void test_corrupted_patch_fails_crc()
+{
+    Fixture f;
+    Bytes raw = f.patch.raw;
+    // Byte cuối của đoạn INSERT cuối, ngay trước OP_END
+    raw[raw.size() - 2] ^= 0x80;
+    Flash flash;
+    TEST_ASSERT_EQUAL(DeltaPatch::ERR_CRC, applyStreamed(deflate(raw), f.oldImage, 29, 11, flash));
+    TEST_ASSERT_EQUAL(f.newImage.size(), flash.written.size());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_patch_applies_with_odd_chunks);
+    RUN_TEST(test_wrong_base_image_is_rejected_before_writing);
+    RUN_TEST(test_corrupted_patch_fails_crc);
+    return UNITY_END();
+}
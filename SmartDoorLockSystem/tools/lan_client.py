@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Client thử cho server điều khiển trong LAN của khóa (bật bằng -D LAN_SERVER).
+
+Chỉ dùng thư viện chuẩn. Lệnh giống hệt payload trên topic site/<door-id>/command.
+
+    python3 lan_client.py --host 192.168.1.50 --token <token> command unlock
+    python3 lan_client.py --host 192.168.1.50 --token <token> command "req r1 $(date +%s%3N)
+    unlock"
+    python3 lan_client.py --host 192.168.1.50 --token <token> events           # in mọi sự kiện
+    python3 lan_client.py --host 192.168.1.50 --token <token> events unlock    # gửi lệnh qua WS rồi in sự kiện
+
+`command` in mã HTTP và body "<ok|fail|dup>\\n<sự kiện>", kèm thời gian khứ hồi.
+"""
+
+import argparse
+import base64
+import http.client
+import os
+import socket
+import struct
+import sys
+import time
+
+
+def command(args):
+    conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+    start = time.monotonic()
+    conn.request("POST", "/command", body=args.text.encode(),
+                 headers={"Authorization": "Bearer " + args.token, "Content-Type": "text/plain"})
+    resp = conn.getresponse()
+    body = resp.read().decode(errors="replace")
+    print("%d %.1f ms" % (resp.status, (time.monotonic() - start) * 1000))
+    print(body)
+    return 0 if resp.status == 200 and body.startswith("ok") else 1
+
+
+def ws_send(sock, opcode, payload):
+    mask = os.urandom(4)
+    n = len(payload)
+    head = bytes([0x80 | opcode])
+    head += bytes([0x80 | n]) if n < 126 else bytes([0x80 | 126]) + struct.pack(">H", n)
+    sock.sendall(head + mask + bytes(b ^ mask[i % 4] for i, b in enumerate(payload)))
+
+
+def recv_exact(sock, n):
+    data = b""
+    while len(data) < n:
+        chunk = sock.recv(n - len(data))
+        if not chunk:
+            raise ConnectionError("closed by door")
+        data += chunk
+    return data
+
+
+def ws_recv(sock):
+    b0, b1 = recv_exact(sock, 2)
+    n = b1 & 0x7F
+    if n == 126:
+        n = struct.unpack(">H", recv_exact(sock, 2))[0]
+    return b0 & 0x0F, recv_exact(sock, n)
+
+
+def events(args):
+    sock = socket.create_connection((args.host, args.port), timeout=args.timeout)
+    key = base64.b64encode(os.urandom(16)).decode()
+    sock.sendall(("GET /events?token=%s HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                  "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n" % (args.token, args.host, key)).encode())
+    head = b""
+    while b"\r\n\r\n" not in head:
+        head += recv_exact(sock, 1)
+    status = head.split(b"\r\n", 1)[0].decode()
+    if " 101 " not in status:
+        sys.exit(status)
+    sock.settimeout(30)
+    if args.text:
+        ws_send(sock, 0x1, args.text.encode())
+    sent = time.monotonic()
+    while True:
+        try:
+            opcode, payload = ws_recv(sock)
+        except socket.timeout:
+            ws_send(sock, 0x9, b"") # giữ kết nối, khóa đóng client im lặng quá 90 s
+            continue
+        if opcode == 0x8:
+            return 0
+        if opcode != 0x1:
+            continue
+        text = payload.decode(errors="replace")
+        topic, _, event = text.partition("\n")
+        if topic == "reply":
+            print("[reply %.1f ms] %s" % ((time.monotonic() - sent) * 1000, event.replace("\n", " ")))
+        else:
+            print("[%s] %s" % (topic, event.replace("\n", " | ")))
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("--host", required=True)
+    p.add_argument("--port", type=int, default=8080)
+    p.add_argument("--token", required=True)
+    p.add_argument("--timeout", type=float, default=15)
+    sub = p.add_subparsers(dest="cmd", required=True)
+    c = sub.add_parser("command")
+    c.add_argument("text")
+    e = sub.add_parser("events")
+    e.add_argument("text", nargs="?")
+    args = p.parse_args()
+    try:
+        sys.exit(command(args) if args.cmd == "command" else events(args))
+    except (OSError, ConnectionError) as e:
+        sys.exit(str(e))
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
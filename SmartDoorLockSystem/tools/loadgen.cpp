@@ -0,0 +1,722 @@
+/***
+ * Tạo tải cho broker MQTT và dashboard Node-RED: giả lập N khóa, mỗi khóa một
+ * kết nối, dùng đúng topic và định dạng bản tin của firmware (DoorProtocol.h).
+ *
+ * Mỗi khóa publish "connected" (retain) rồi sự kiện ngẫu nhiên trên
+ * site/<door-id>/status và site/<door-id>/fingerprint (quét vân tay, sai PIN,
+ * mở/khóa lại), và trả lời lệnh trên site/<door-id>/command như firmware:
+ * ack trên topic ack, door_unlocked trên status. Một kết nối "dashboard" đăng ký
+ * site/+/status, site/+/fingerprint, site/+/ack, gửi "req <id> <ts>\nunlock" lần
+ * lượt tới từng khóa và đo thời gian tới khi nhận ack.
+ *
+ *   g++ -std=gnu++17 -O2 -I lib/DoorProtocol tools/loadgen.cpp -o loadgen
+ *   ./loadgen --locks 10,100,300 --duration 30
+ *   ./loadgen --host 192.168.1.10 --user u --pass p --locks 50 --cmd-rate 1 --event-rate 2
+ *
+ * Mỗi N một dòng:
+ *   conn_ms   thời gian tới khi mọi khóa đã CONNACK + SUBACK
+ *   in/s      bản tin client publish lên broker mỗi giây (khóa + dashboard)
+ *   out/s     bản tin broker giao cho client mỗi giây
+ *   p50..max  thời gian khứ hồi lệnh -> ack (ms)
+ *   cmd_drop  lệnh không có ack sau --timeout ms
+ *   evt_drop  sự kiện khóa đã publish mà dashboard không nhận được
+ *   disc      kết nối bị broker đóng
+ * QoS 0 như firmware, nên bản tin broker bỏ (hàng đợi đầy, client chậm) hiện ở
+ * cột drop. Dashboard là một kết nối duy nhất nhận mọi sự kiện, giống Node-RED.
+ * Door-id giả 4c47000000xx (không trùng khóa thật); hết mỗi vòng khóa giả xóa
+ * bản tin retain của mình để dashboard không giữ khóa ma.
+ ***/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "DoorProtocol.h"
+
+using namespace DoorProtocol;
+
+static uint64_t nowUs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// ---------- MQTT 3.1.1 tối thiểu: QoS 0, clean session ----------
+namespace Mqtt
+{
+    enum Type : uint8_t
+    {
+        CONNECT = 1,
+        CONNACK = 2,
+        PUBLISH = 3,
+        SUBSCRIBE = 8,
+        SUBACK = 9,
+        PINGREQ = 12,
+        PINGRESP = 13,
+        DISCONNECT = 14,
+    };
+    constexpr uint16_t KEEPALIVE_S = 60;
+
+    static void putU16(std::string &out, size_t v)
+    {
+        out += (char)(v >> 8);
+        out += (char)(v & 0xFF);
+    }
+
+    static void putStr(std::string &out, const char *s)
+    {
+        size_t n = strlen(s);
+        putU16(out, n);
+        out.append(s, n);
+    }
+
+    // Header cố định + remaining length (7 bit mỗi byte)
+    static void frame(std::string &out, uint8_t first, const std::string &body)
+    {
+        out += (char)first;
+        size_t n = body.size();
+        do {
+            uint8_t b = n & 0x7F;
+            n >>= 7;
+            out += (char)(n ? b | 0x80 : b);
+        } while (n);
+        out += body;
+    }
+
+    static void connect(std::string &out, const char *clientId, const char *user, const char *pass)
+    {
+        std::string body;
+        putStr(body, "MQTT");
+        body += (char)4;      // 3.1.1
+        uint8_t flags = 0x02; // clean session
+        if (user) flags |= 0x80;
+        if (user && pass) flags |= 0x40;
+        body += (char)flags;
+        putU16(body, KEEPALIVE_S);
+        putStr(body, clientId);
+        if (user) putStr(body, user);
+        if (user && pass) putStr(body, pass);
+        frame(out, CONNECT << 4, body);
+    }
+
+    static void subscribe(std::string &out, uint16_t packetId, const char *topic)
+    {
+        std::string body;
+        putU16(body, packetId);
+        putStr(body, topic);
+        body += (char)0; // QoS 0
+        frame(out, SUBSCRIBE << 4 | 0x02, body);
+    }
+
+    static void publish(std::string &out, const char *topic, const char *payload, bool retain)
+    {
+        std::string body;
+        putStr(body, topic);
+        body += payload;
+        frame(out, PUBLISH << 4 | (retain ? 1 : 0), body);
+    }
+
+    static void empty(std::string &out, Type type)
+    {
+        out += (char)(type << 4);
+        out += (char)0;
+    }
+
+    struct Packet
+    {
+        uint8_t type;
+        uint8_t flags;
+        const uint8_t *body;
+        size_t len;
+    };
+
+    // Tách gói đầu tiên trong buf: trả số byte của gói, 0 nếu chưa nhận đủ, -1 nếu sai
+    static long parse(const uint8_t *buf, size_t avail, Packet &p)
+    {
+        size_t len = 0;
+        size_t i = 1;
+        for (int shift = 0;; shift += 7, i++) {
+            if (i > 4) return -1;
+            if (i >= avail) return 0;
+            len |= (size_t)(buf[i] & 0x7F) << shift;
+            if (!(buf[i] & 0x80)) break;
+        }
+        i++;
+        if (avail < i + len) return 0;
+        p = {(uint8_t)(buf[0] >> 4), (uint8_t)(buf[0] & 0x0F), buf + i, len};
+        return i + len;
+    }
+
+    // Topic và payload của PUBLISH QoS 0; payload không có '\0'
+    static bool splitPublish(const Packet &p, std::string &topic, const uint8_t *&payload, size_t &len)
+    {
+        if (p.len < 2) return false;
+        size_t n = (size_t)p.body[0] << 8 | p.body[1];
+        size_t skip = 2 + n + ((p.flags & 0x06) ? 2 : 0); // QoS > 0 có packet ID
+        if (p.len < skip) return false;
+        topic.assign((const char *)p.body + 2, n);
+        payload = p.body + skip;
+        len = p.len - skip;
+        return true;
+    }
+}
+
+// ---------- Kết nối tới broker, không chặn ----------
+static int dial(const char *host, const char *port)
+{
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *res;
+    if (getaddrinfo(host, port, &hints, &res) != 0) return -1;
+    int fd = -1;
+    for (addrinfo *ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+// Gói ra xếp trong tx, gửi khi socket ghi được; gói vào cắt từ rx
+struct Conn
+{
+    int fd = -1;
+    bool ready = false;        // đã CONNACK và SUBACK đủ
+    unsigned pendingSubs = 0;
+    std::string rx;
+    std::string tx;
+    uint64_t lastTxUs = 0;
+
+    // false nếu lỗi socket
+    bool flush()
+    {
+        while (!tx.empty()) {
+            ssize_t n = send(fd, tx.data(), tx.size(), MSG_NOSIGNAL);
+            if (n > 0) {
+                tx.erase(0, n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+        return true;
+    }
+
+    // Đọc dữ liệu đang có, gọi onPacket cho từng gói trọn vẹn; false nếu broker đóng kết nối
+    template <class F> bool receive(F onPacket)
+    {
+        char buf[16384];
+        for (int reads = 0; reads < 8; reads++) { // không để một kết nối chiếm cả vòng lặp
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                rx.append(buf, n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            return false;
+        }
+        size_t used = 0;
+        for (;;) {
+            Mqtt::Packet p;
+            long k = Mqtt::parse((const uint8_t *)rx.data() + used, rx.size() - used, p);
+            if (k < 0) return false;
+            if (k == 0) break;
+            used += k;
+            onPacket(p);
+        }
+        rx.erase(0, used);
+        return true;
+    }
+
+    void shut()
+    {
+        if (fd >= 0) close(fd);
+        fd = -1;
+        ready = false;
+    }
+};
+
+// ---------- Một vòng đo với N khóa ----------
+struct Options
+{
+    const char *host = "127.0.0.1";
+    const char *port = "1883";
+    const char *user = nullptr;
+    const char *pass = nullptr;
+    std::vector<unsigned> locks;
+    double duration = 20;    // s mỗi N
+    double eventRate = 0.5;  // sự kiện / khóa / s
+    double cmdRate = 0.2;    // lệnh / khóa / s
+    unsigned timeoutMs = 2000;
+    unsigned seed = 1;
+};
+
+static constexpr unsigned long long DOOR_ID_BASE = 0x4c4700000000ULL; // "LG"
+static constexpr const char *DOOR_ID_PREFIX = "4c47";
+static constexpr const char *REQ_ID_PREFIX = "lg";
+static constexpr uint64_t CONNECT_TIMEOUT_US = 10000000;
+static constexpr uint64_t RELOCK_US = 3000000; // khóa lại sau 3 s như firmware
+static constexpr uint64_t PING_US = Mqtt::KEEPALIVE_S * 1000000ULL / 2;
+
+struct Lock
+{
+    DoorTopics topics;
+    Conn conn;
+    double nextEventUs = 0;
+    uint64_t relockUs = 0; // 0 = đang khóa
+};
+
+struct Result
+{
+    unsigned locks = 0;
+    unsigned connected = 0;
+    double connectMs = 0;
+    double inPerS = 0;
+    double outPerS = 0;
+    uint64_t cmdsSent = 0;
+    uint64_t cmdsDropped = 0;
+    uint64_t eventsSent = 0;
+    uint64_t eventsSeen = 0;
+    unsigned disconnects = 0;
+    std::vector<uint32_t> rttUs;
+};
+
+class LoadRun
+{
+public:
+    LoadRun(const Options &o, unsigned n) : _o(o), _locks(n), _rng(o.seed + n) { _r.locks = n; }
+
+    // false nếu không kết nối được broker
+    bool run()
+    {
+        if (!connectAll()) return false;
+
+        uint64_t start = nowUs();
+        std::exponential_distribution<double> gap(_o.eventRate > 0 ? _o.eventRate : 1);
+        for (Lock &lock : _locks) lock.nextEventUs = start + gap(_rng) * 1e6;
+        double cmdGapUs = _o.cmdRate > 0 ? 1e6 / (_o.cmdRate * _locks.size()) : 0;
+        double nextCmdUs = start;
+        uint64_t published0 = _published, delivered0 = _delivered;
+
+        uint64_t end = start + (uint64_t)(_o.duration * 1e6);
+        for (uint64_t now = start; now < end; now = nowUs()) {
+            for (Lock &lock : _locks) {
+                if (!lock.conn.ready) continue;
+                while (_o.eventRate > 0 && now >= lock.nextEventUs) {
+                    emitEvent(lock, now);
+                    lock.nextEventUs += gap(_rng) * 1e6;
+                }
+                if (lock.relockUs && now >= lock.relockUs) {
+                    publishEvent(lock, lock.topics.status, EVT_DOOR_LOCKED);
+                    lock.relockUs = 0;
+                }
+            }
+            while (cmdGapUs > 0 && now >= nextCmdUs) {
+                sendCommand(now);
+                nextCmdUs += cmdGapUs;
+            }
+            expireCommands(now);
+            pump(1);
+        }
+        double seconds = (nowUs() - start) / 1e6;
+        _r.inPerS = (_published - published0) / seconds;
+        _r.outPerS = (_delivered - delivered0) / seconds;
+
+        // Chờ bản tin còn trên đường rồi mới tính drop
+        uint64_t drainEnd = nowUs() + _o.timeoutMs * 1000ULL;
+        for (uint64_t now = nowUs(); now < drainEnd; now = nowUs()) {
+            expireCommands(now);
+            pump(1);
+        }
+        expireCommands(UINT64_MAX);
+        disconnectAll();
+        return true;
+    }
+
+    const Result &result() const { return _r; }
+
+private:
+    const Options &_o;
+    std::vector<Lock> _locks;
+    Conn _dashboard;
+    std::mt19937 _rng;
+    Result _r;
+    uint64_t _published = 0;
+    uint64_t _delivered = 0;
+    std::vector<uint64_t> _cmdSentUs; // theo số thứ tự lệnh, 0 = đã có ack hoặc đã tính drop
+    size_t _oldestCmd = 0;
+    size_t _nextLock = 0;
+    bool _closing = false;
+
+    void publish(Conn &conn, const char *topic, const char *payload, bool retain = false)
+    {
+        Mqtt::publish(conn.tx, topic, payload, retain);
+        _published++;
+    }
+
+    void publishEvent(Lock &lock, const char *topic, const char *payload, bool retain = false)
+    {
+        publish(lock.conn, topic, payload, retain);
+        _r.eventsSent++;
+    }
+
+    // Tỉ lệ gần một cửa văn phòng: phần lớn là quét vân tay
+    void emitEvent(Lock &lock, uint64_t now)
+    {
+        char buf[64];
+        unsigned roll = _rng() % 100;
+        if (roll < 45) {
+            formatCheckSuccess(buf, sizeof(buf), 1 + _rng() % 127);
+            publishEvent(lock, lock.topics.finger, buf);
+            unlock(lock, now);
+        } else if (roll < 60) {
+            publishEvent(lock, lock.topics.finger, EVT_CHECK_FAIL);
+        } else if (roll < 85) {
+            formatWrongPass(buf, sizeof(buf), 1 + _rng() % 3);
+            publishEvent(lock, lock.topics.status, buf);
+        } else {
+            unlock(lock, now); // PIN đúng
+        }
+    }
+
+    void unlock(Lock &lock, uint64_t now)
+    {
+        publishEvent(lock, lock.topics.status, EVT_DOOR_UNLOCKED);
+        lock.relockUs = now + RELOCK_US;
+    }
+
+    // Như dispatchCommand của firmware, chỉ làm unlock; lệnh khác trả not_allowed
+    void handleCommand(Lock &lock, const uint8_t *payload, size_t len, uint64_t now)
+    {
+        char msg[512];
+        copyCommand(msg, sizeof(msg), payload, len);
+        RequestHeader req;
+        const char *cmd = parseRequest(msg, req);
+        if (!cmd) return;
+        bool ok = strcmp(cmd, CMD_UNLOCK) == 0;
+        const char *event = ok ? EVT_DOOR_UNLOCKED : EVT_NOT_ALLOWED;
+        req.rxMs = now / 1000;
+        if (ok) unlock(lock, now);
+        if (!req.id[0]) return;
+        char ack[128];
+        formatAck(ack, sizeof(ack), req, nowUs() / 1000, ok ? ACK_OK : ACK_FAIL, event);
+        publish(lock.conn, lock.topics.ack, ack);
+    }
+
+    void sendCommand(uint64_t now)
+    {
+        for (size_t tries = 0; tries < _locks.size(); tries++) {
+            Lock &lock = _locks[_nextLock++ % _locks.size()];
+            if (!lock.conn.ready) continue;
+            char msg[80];
+            snprintf(msg, sizeof(msg), "%s%s%zu %llu\n%s", REQ_PREFIX, REQ_ID_PREFIX, _cmdSentUs.size(),
+                     (unsigned long long)now, CMD_UNLOCK);
+            publish(_dashboard, lock.topics.command, msg);
+            _cmdSentUs.push_back(now);
+            _r.cmdsSent++;
+            return;
+        }
+    }
+
+    void expireCommands(uint64_t now)
+    {
+        uint64_t timeoutUs = _o.timeoutMs * 1000ULL;
+        while (_oldestCmd < _cmdSentUs.size()) {
+            uint64_t &sent = _cmdSentUs[_oldestCmd];
+            if (sent && now - sent <= timeoutUs) break;
+            if (sent) _r.cmdsDropped++;
+            sent = 0;
+            _oldestCmd++;
+        }
+    }
+
+    // Bản tin dashboard nhận; chỉ tính khóa giả, bỏ bản tin retain cũ và bản tin xóa retain
+    void onDashboard(const Mqtt::Packet &p, uint64_t now)
+    {
+        std::string topic;
+        const uint8_t *payload;
+        size_t len;
+        if (!Mqtt::splitPublish(p, topic, payload, len)) return;
+        if ((p.flags & 0x01) || len == 0) return;
+        const char *t = topic.c_str();
+        if (!startsWith(t, SITE) || !startsWith(t + strlen(SITE) + 1, DOOR_ID_PREFIX)) return;
+        const char *sub = strrchr(t, '/') + 1;
+        if (strcmp(sub, SUB_STATUS) == 0 || strcmp(sub, SUB_FINGER) == 0) {
+            _r.eventsSeen++;
+        } else if (strcmp(sub, SUB_ACK) == 0) {
+            char msg[128];
+            copyCommand(msg, sizeof(msg), payload, len);
+            char prefix[16];
+            snprintf(prefix, sizeof(prefix), "ack %s", REQ_ID_PREFIX);
+            if (!startsWith(msg, prefix)) return;
+            size_t seq = strtoul(msg + strlen(prefix), nullptr, 10);
+            if (seq >= _cmdSentUs.size() || !_cmdSentUs[seq]) return; // trễ quá timeout, đã tính drop
+            _r.rttUs.push_back(now - _cmdSentUs[seq]);
+            _cmdSentUs[seq] = 0;
+        }
+    }
+
+    void onLock(Lock &lock, const Mqtt::Packet &p, uint64_t now)
+    {
+        if (p.type == Mqtt::CONNACK) {
+            if (p.len < 2 || p.body[1] != 0) lock.conn.shut();
+        } else if (p.type == Mqtt::SUBACK) {
+            if (lock.conn.pendingSubs && --lock.conn.pendingSubs == 0) {
+                lock.conn.ready = true;
+                publishEvent(lock, lock.topics.status, EVT_CONNECTED, true);
+            }
+        } else if (p.type == Mqtt::PUBLISH) {
+            std::string topic;
+            const uint8_t *payload;
+            size_t len;
+            if (Mqtt::splitPublish(p, topic, payload, len) && topic == lock.topics.command)
+                handleCommand(lock, payload, len, now);
+        }
+    }
+
+    // Một lượt poll trên mọi kết nối
+    void pump(int timeoutMs)
+    {
+        std::vector<pollfd> fds;
+        std::vector<Conn *> conns;
+        std::vector<Lock *> owners; // nullptr = dashboard
+        auto add = [&](Conn &c, Lock *owner) {
+            if (c.fd < 0) return;
+            uint64_t now = nowUs();
+            if (now - c.lastTxUs > PING_US) Mqtt::empty(c.tx, Mqtt::PINGREQ);
+            if (!c.tx.empty()) {
+                c.lastTxUs = now;
+                if (!c.flush()) {
+                    c.shut();
+                    if (!_closing) _r.disconnects++;
+                    return;
+                }
+            }
+            fds.push_back({c.fd, (short)(POLLIN | (c.tx.empty() ? 0 : POLLOUT)), 0});
+            conns.push_back(&c);
+            owners.push_back(owner);
+        };
+        add(_dashboard, nullptr);
+        for (Lock &lock : _locks) add(lock.conn, &lock);
+        if (poll(fds.data(), fds.size(), timeoutMs) <= 0) return;
+
+        uint64_t now = nowUs();
+        for (size_t i = 0; i < fds.size(); i++) {
+            Conn &c = *conns[i];
+            if (!fds[i].revents) continue;
+            bool alive = true;
+            if (fds[i].revents & POLLOUT) alive = c.flush();
+            if (alive && (fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                Lock *lock = owners[i];
+                alive = c.receive([&](const Mqtt::Packet &p) {
+                    if (p.type == Mqtt::PUBLISH) _delivered++;
+                    if (lock) onLock(*lock, p, now);
+                    else if (p.type == Mqtt::CONNACK && (p.len < 2 || p.body[1] != 0)) c.shut();
+                    else if (p.type == Mqtt::SUBACK && c.pendingSubs && --c.pendingSubs == 0) c.ready = true;
+                    else if (p.type == Mqtt::PUBLISH) onDashboard(p, now);
+                });
+            }
+            if (!alive || c.fd < 0) {
+                if (c.fd >= 0) c.shut();
+                if (!_closing) _r.disconnects++; // sau DISCONNECT broker tự đóng
+            }
+        }
+    }
+
+    bool open(Conn &conn, const char *clientId, std::initializer_list<const char *> topics)
+    {
+        conn.fd = dial(_o.host, _o.port);
+        if (conn.fd < 0) return false;
+        Mqtt::connect(conn.tx, clientId, _o.user, _o.pass);
+        uint16_t packetId = 1;
+        for (const char *topic : topics) Mqtt::subscribe(conn.tx, packetId++, topic);
+        conn.pendingSubs = topics.size();
+        conn.lastTxUs = nowUs();
+        return true;
+    }
+
+    bool connectAll()
+    {
+        char status[TOPIC_LEN], finger[TOPIC_LEN], ack[TOPIC_LEN];
+        snprintf(status, sizeof(status), "%s/+/%s", SITE, SUB_STATUS);
+        snprintf(finger, sizeof(finger), "%s/+/%s", SITE, SUB_FINGER);
+        snprintf(ack, sizeof(ack), "%s/+/%s", SITE, SUB_ACK);
+        if (!open(_dashboard, "loadgen_dashboard", {status, finger, ack})) {
+            fprintf(stderr, "cannot connect to %s:%s\n", _o.host, _o.port);
+            return false;
+        }
+        uint64_t start = nowUs();
+        while (!_dashboard.ready && _dashboard.fd >= 0 && nowUs() - start < CONNECT_TIMEOUT_US) pump(10);
+        if (!_dashboard.ready) {
+            fprintf(stderr, "broker refused or did not answer CONNECT/SUBSCRIBE\n");
+            return false;
+        }
+
+        // Dashboard đăng ký trước nên "connected" của khóa nào cũng được đếm
+        start = nowUs();
+        for (size_t i = 0; i < _locks.size(); i++) {
+            char doorId[DOOR_ID_LEN];
+            snprintf(doorId, sizeof(doorId), "%012llx", DOOR_ID_BASE + i);
+            Lock &lock = _locks[i];
+            lock.topics.build(doorId, DEFAULT_GROUP);
+            char clientId[CLIENT_ID_LEN];
+            formatClientId(clientId, sizeof(clientId), doorId);
+            // Cùng các topic lệnh firmware đăng ký (trừ ota)
+            if (!open(lock.conn, clientId, {lock.topics.command, lock.topics.groupCommand, TOPIC_BROADCAST_CMD})) {
+                fprintf(stderr, "connect failed for lock %zu: %s\n", i, strerror(errno));
+                break;
+            }
+            pump(0);
+        }
+        auto pendingLocks = [&] {
+            return std::count_if(_locks.begin(), _locks.end(), [](const Lock &l) { return l.conn.fd >= 0 && !l.conn.ready; });
+        };
+        while (pendingLocks() && nowUs() - start < CONNECT_TIMEOUT_US) pump(10);
+        _r.connectMs = (nowUs() - start) / 1000.0;
+        _r.connected = std::count_if(_locks.begin(), _locks.end(), [](const Lock &l) { return l.conn.ready; });
+        return true;
+    }
+
+    // Xóa "connected" retain của khóa giả, DISCONNECT và chờ gửi hết
+    void disconnectAll()
+    {
+        for (Lock &lock : _locks) {
+            if (lock.conn.fd < 0) continue;
+            Mqtt::publish(lock.conn.tx, lock.topics.status, "", true);
+            Mqtt::empty(lock.conn.tx, Mqtt::DISCONNECT);
+        }
+        if (_dashboard.fd >= 0) Mqtt::empty(_dashboard.tx, Mqtt::DISCONNECT);
+        _closing = true;
+        uint64_t start = nowUs();
+        auto pending = [&] {
+            if (_dashboard.fd >= 0 && !_dashboard.tx.empty()) return true;
+            for (Lock &lock : _locks)
+                if (lock.conn.fd >= 0 && !lock.conn.tx.empty()) return true;
+            return false;
+        };
+        while (pending() && nowUs() - start < CONNECT_TIMEOUT_US) pump(10);
+        _dashboard.shut();
+        for (Lock &lock : _locks) lock.conn.shut();
+    }
+};
+
+// ---------- Báo cáo ----------
+static double percentileMs(const std::vector<uint32_t> &sorted, double p)
+{
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t)ceil(p * sorted.size());
+    return sorted[rank ? rank - 1 : 0] / 1000.0;
+}
+
+static void printHeader()
+{
+    printf("%6s %6s %8s %9s %9s %7s %7s %7s %7s %7s %8s %8s %5s\n", "locks", "conn", "conn_ms", "in/s", "out/s",
+           "cmds", "p50_ms", "p90_ms", "p99_ms", "max_ms", "cmd_drop", "evt_drop", "disc");
+}
+
+static void printResult(Result r)
+{
+    std::sort(r.rttUs.begin(), r.rttUs.end());
+    uint64_t eventDrop = r.eventsSent > r.eventsSeen ? r.eventsSent - r.eventsSeen : 0;
+    printf("%6u %6u %8.0f %9.1f %9.1f %7llu %7.1f %7.1f %7.1f %7.1f %8llu %8llu %5u\n", r.locks, r.connected,
+           r.connectMs, r.inPerS, r.outPerS, (unsigned long long)r.cmdsSent, percentileMs(r.rttUs, 0.5),
+           percentileMs(r.rttUs, 0.9), percentileMs(r.rttUs, 0.99), percentileMs(r.rttUs, 1.0),
+           (unsigned long long)r.cmdsDropped, (unsigned long long)eventDrop, r.disconnects);
+    fflush(stdout);
+}
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: loadgen [--host 127.0.0.1] [--port 1883] [--user u --pass p] [--locks 10,100,300]\n"
+            "               [--duration 20] [--event-rate 0.5] [--cmd-rate 0.2] [--timeout 2000] [--seed 1]\n"
+            "  --event-rate  events per lock per second on status/fingerprint\n"
+            "  --cmd-rate    unlock commands per lock per second from the dashboard\n"
+            "  --timeout     ms before a command without ack counts as dropped\n");
+}
+
+// Mỗi khóa một socket: nâng giới hạn file mở nếu cần
+static void raiseFdLimit(unsigned locks)
+{
+    rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) != 0) return;
+    rlim_t need = locks + 16;
+    if (lim.rlim_cur >= need) return;
+    lim.rlim_cur = std::min(need, lim.rlim_max);
+    setrlimit(RLIMIT_NOFILE, &lim);
+    if (lim.rlim_cur < need) fprintf(stderr, "warning: open file limit %lu < %lu, raise ulimit -n\n",
+                                     (unsigned long)lim.rlim_cur, (unsigned long)need);
+}
+
+int main(int argc, char **argv)
+{
+    Options o;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!val || strncmp(arg, "--", 2) != 0) {
+            usage();
+            return 2;
+        }
+        i++;
+        if (strcmp(arg, "--host") == 0) o.host = val;
+        else if (strcmp(arg, "--port") == 0) o.port = val;
+        else if (strcmp(arg, "--user") == 0) o.user = val;
+        else if (strcmp(arg, "--pass") == 0) o.pass = val;
+        else if (strcmp(arg, "--duration") == 0) o.duration = atof(val);
+        else if (strcmp(arg, "--event-rate") == 0) o.eventRate = atof(val);
+        else if (strcmp(arg, "--cmd-rate") == 0) o.cmdRate = atof(val);
+        else if (strcmp(arg, "--timeout") == 0) o.timeoutMs = strtoul(val, nullptr, 10);
+        else if (strcmp(arg, "--seed") == 0) o.seed = strtoul(val, nullptr, 10);
+        else if (strcmp(arg, "--locks") == 0) {
+            for (const char *p = val; *p;) {
+                char *end;
+                unsigned long n = strtoul(p, &end, 10);
+                if (end == p || n == 0 || n > 0xFFFF) {
+                    usage();
+                    return 2;
+                }
+                o.locks.push_back(n);
+                p = *end == ',' ? end + 1 : end;
+            }
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (o.locks.empty()) o.locks.push_back(10);
+    raiseFdLimit(*std::max_element(o.locks.begin(), o.locks.end()));
+
+    printf("broker %s:%s  %.0f s per step  %.2f events/lock/s  %.2f cmds/lock/s  timeout %u ms\n", o.host, o.port,
+           o.duration, o.eventRate, o.cmdRate, o.timeoutMs);
+    printHeader();
+    for (unsigned n : o.locks) {
+        LoadRun run(o, n);
+        if (!run.run()) return 1;
+        printResult(run.result());
+    }
+    return 0;
+}
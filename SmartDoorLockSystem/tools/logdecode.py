@@ -0,0 +1,194 @@
+#!/usr/bin/env python3
+"""Dịch log nhị phân BinLog (lib/BinLog) thành text.
+
+    python3 logdecode.py --port /dev/ttyUSB0      # đọc trực tiếp, gõ lệnh console (emu/rec) vẫn được gửi đi
+    python3 logdecode.py capture.bin              # file đã ghi (vd. pio device monitor --raw > capture.bin)
+    python3 logdecode.py - < capture.bin
+
+Bảng format đọc từ lib/BinLog/LogFormats.h; dùng đúng phiên bản với firmware
+đang chạy (bản ghi BOOT mang hash của bảng, lệch thì có cảnh báo). Text thường
+trên Serial (thư viện, console) được in nguyên văn.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+import threading
+
+SYNC = 0xA5
+LEVELS = {"BLOG_ERROR": 1, "BLOG_WARN": 2, "BLOG_INFO": 3, "BLOG_DEBUG": 4}
+LEVEL_TAGS = {1: "E", 2: "W", 3: "I", 4: "D"}
+DEFAULT_TABLE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "lib", "BinLog", "LogFormats.h")
+SPEC = re.compile(r"%(%|[-+ 0#]*[0-9.]*[lh]*([a-zA-Z]))")
+
+
+def load_table(path):
+    text = open(path, encoding="utf-8").read()
+    rows = re.findall(r'X\((\w+),\s*(BLOG_\w+),\s*"((?:[^"\\]|\\.)*)"\)', text)
+    return [(name, LEVELS[level], fmt.encode().decode("unicode_escape")) for name, level, fmt in rows]
+
+
+def table_hash(table):
+    """Giống LogTable::hash() trong BinLog.h."""
+    h = 2166136261
+
+    def mix(b):
+        nonlocal h
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+
+    for _, level, fmt in table:
+        mix(level)
+        for b in fmt.encode():
+            mix(b)
+        mix(0)
+    return h
+
+
+def conversions(fmt):
+    return [m.group(2) for m in SPEC.finditer(fmt) if m.group(1) != "%"]
+
+
+def render(fmt, args):
+    it = iter(args)
+
+    def sub(m):
+        if m.group(1) == "%":
+            return "%"
+        spec = "%" + re.sub(r"[lh]", "", m.group(1))
+        value = next(it)
+        if m.group(2) == "d" and isinstance(value, int) and value >= 1 << 31:
+            value -= 1 << 32
+        if m.group(2) == "u":
+            spec = spec[:-1] + "d"
+        return spec % value
+
+    return SPEC.sub(sub, fmt)
+
+
+class Decoder:
+    def __init__(self, table, out):
+        self.table = table
+        self.hash = table_hash(table)
+        self.out = out
+        self.buf = bytearray()
+        self.text = bytearray()
+        self.base = 0
+        self.last_us = None
+
+    def parse(self, frame):
+        """frame = id..args (không có sync/len/checksum); None nếu không hợp lệ."""
+        if len(frame) < 6:
+            return None
+        log_id, us = struct.unpack_from("<HI", frame)
+        if log_id >= len(self.table):
+            return None
+        name, level, fmt = self.table[log_id]
+        pos, args = 6, []
+        for conv in conversions(fmt):
+            if conv == "s":
+                if pos >= len(frame) or pos + 1 + frame[pos] > len(frame):
+                    return None
+                n = frame[pos]
+                args.append(frame[pos + 1:pos + 1 + n].decode("utf-8", "replace"))
+                pos += 1 + n
+            else:
+                if pos + 4 > len(frame):
+                    return None
+                value = struct.unpack_from("<I", frame, pos)[0]
+                args.append(chr(value & 0xFF) if conv == "c" else value)
+                pos += 4
+        if pos != len(frame):
+            return None
+        return name, level, fmt, us, args
+
+    def flush_text(self, final=False):
+        while b"\n" in self.text:
+            line, _, rest = self.text.partition(b"\n")
+            self.out.write(line.decode("utf-8", "replace").rstrip("\r") + "\n")
+            self.text = bytearray(rest)
+        if final and self.text:
+            self.out.write(self.text.decode("utf-8", "replace") + "\n")
+            self.text = bytearray()
+
+    def emit(self, record):
+        name, level, fmt, us, args = record
+        if self.last_us is not None and us < self.last_us and self.last_us - us > 1 << 31:
+            self.base += 1 << 32  # micros 32 bit quay vòng sau ~71 phút
+        self.last_us = us
+        if name == "BOOT":
+            self.base, self.last_us = 0, us
+            if args[0] != self.hash:
+                self.out.write("!! format table %08x differs from firmware %08x, output may be wrong\n" % (self.hash, args[0]))
+        t = (self.base + us) / 1e6
+        self.out.write("[%12.6f] %s %s\n" % (t, LEVEL_TAGS.get(level, "?"), render(fmt, args)))
+
+    def feed(self, data):
+        self.buf += data
+        while True:
+            i = self.buf.find(SYNC)
+            if i < 0:
+                self.text += self.buf
+                self.buf.clear()
+                break
+            self.text += self.buf[:i]
+            del self.buf[:i]
+            if len(self.buf) < 2 or len(self.buf) < self.buf[1] + 3:
+                break  # chờ thêm dữ liệu
+            n = self.buf[1]
+            frame = bytes(self.buf[2:2 + n])
+            checksum = 0
+            for b in frame:
+                checksum ^= b
+            record = self.parse(frame) if checksum == self.buf[2 + n] else None
+            if record is None:
+                self.text.append(self.buf[0])  # 0xA5 là một byte text (vd. UTF-8)
+                del self.buf[:1]
+                continue
+            self.flush_text(final=bool(self.text) and not self.text.endswith(b"\n"))
+            self.emit(record)
+            del self.buf[:n + 3]
+        self.flush_text()
+        self.out.flush()
+
+    def finish(self):
+        self.text += self.buf
+        self.buf.clear()
+        self.flush_text(final=True)
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("input", nargs="?", help="file log hoặc - cho stdin")
+    p.add_argument("--port", help="cổng serial (cần pyserial)")
+    p.add_argument("--baud", type=int, default=115200)
+    p.add_argument("--table", default=DEFAULT_TABLE)
+    args = p.parse_args()
+
+    decoder = Decoder(load_table(args.table), sys.stdout)
+    if args.port:
+        import serial
+        port = serial.Serial(args.port, args.baud, timeout=0.1)
+
+        def forward():
+            for line in sys.stdin:
+                port.write(line.encode())
+
+        threading.Thread(target=forward, daemon=True).start()
+        while True:
+            decoder.feed(port.read(4096))
+    elif args.input:
+        stream = sys.stdin.buffer if args.input == "-" else open(args.input, "rb")
+        while True:
+            chunk = stream.read(4096)
+            if not chunk:
+                break
+            decoder.feed(chunk)
+        decoder.finish()
+    else:
+        p.error("cần file log hoặc --port")
+
+
+if __name__ == "__main__":
+    main()
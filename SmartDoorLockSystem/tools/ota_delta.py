@@ -0,0 +1,242 @@
+#!/usr/bin/env python3
+"""Tạo, kiểm tra và gửi bản vá OTA cho khóa cửa.
+
+Định dạng bản vá giống lib/DeltaPatch/DeltaPatch.h, nén zlib:
+    python3 ota_delta.py diff  old.bin new.bin -o update.dlt
+    python3 ota_delta.py full  new.bin -o update.dlt            # không cần ảnh gốc
+    python3 ota_delta.py apply old.bin update.dlt -o check.bin  # áp thử trên PC
+    python3 ota_delta.py key                                    # tạo khóa OTA cho một khóa cửa
+    python3 ota_delta.py send  update.dlt --host broker --door <door-id> --key <hex> [--user u --password p]
+
+old.bin là firmware đang chạy trên khóa (.pio/build/<env>/firmware.bin của bản
+cũ), new.bin là bản mới. `send` cần paho-mqtt.
+
+Khóa OTA (32 byte) nạp một lần qua USB Serial bằng dòng `ota_key <hex>`; `send`
+ký bản vá bằng HMAC-SHA256 theo khóa đó, khóa cửa từ chối bản vá sai chữ ký.
+Kết nối TLS kiểm tra chứng chỉ broker theo CA hệ thống hoặc --ca.
+"""
+
+import argparse
+import hashlib
+import hmac
+import secrets
+import struct
+import sys
+import zlib
+
+MAGIC = b"DLT1"
+OP_END, OP_COPY, OP_ADD, OP_INSERT = 0, 1, 2, 3
+BLOCK = 32          # độ dài tối thiểu của một đoạn khớp
+STEP = 4            # firmware căn 4 byte, chỉ đánh chỉ mục ảnh gốc mỗi 4 byte
+ADD_MIN_ZERO = 0.5  # vùng lệch dùng ADD nếu >= 50% byte hiệu là 0
+CHUNK = 400         # payload MQTT: 4 byte offset + dữ liệu, dưới buffer 512 byte
+
+
+def varint(n):
+    out = bytearray()
+    while True:
+        b = n & 0x7F
+        n >>= 7
+        if n:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return bytes(out)
+
+
+def read_varint(buf, pos):
+    n = shift = 0
+    while True:
+        b = buf[pos]
+        pos += 1
+        n |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            return n, pos
+
+
+def header(old, new):
+    return MAGIC + struct.pack("<IIII", len(old), zlib.crc32(old) if old else 0, len(new), zlib.crc32(new))
+
+
+def diff(old, new):
+    """Khớp khối kiểu rsync + ADD kiểu bsdiff cho vùng bị dời địa chỉ."""
+    index = {}
+    for i in range(0, len(old) - BLOCK + 1, STEP):
+        index.setdefault(old[i:i + BLOCK], i)
+
+    ops = bytearray()
+    delta = 0        # old_pos - new_pos của đoạn khớp gần nhất
+    pending = 0      # đầu vùng chưa phát lệnh trong new
+    i = 0
+    while i <= len(new) - BLOCK:
+        src = index.get(new[i:i + BLOCK])
+        if src is None:
+            i += 1
+            continue
+        # Kéo dài đoạn khớp về hai phía
+        start, s = i, src
+        while start > pending and s > 0 and new[start - 1] == old[s - 1]:
+            start -= 1
+            s -= 1
+        end = i + BLOCK
+        e = src + BLOCK
+        while end < len(new) and e < len(old) and new[end] == old[e]:
+            end += 1
+            e += 1
+        ops += gap(old, new, pending, start, delta)
+        ops += bytes([OP_COPY]) + varint(s) + varint(end - start)
+        delta = s - start
+        pending = i = end
+    ops += gap(old, new, pending, len(new), delta)
+    ops.append(OP_END)
+    return header(old, new) + bytes(ops)
+
+
+def gap(old, new, start, end, delta):
+    """Vùng không khớp: ADD so với ảnh gốc cùng độ lệch nếu đa số byte giống, không thì INSERT."""
+    if start >= end:
+        return b""
+    src = start + delta
+    data = new[start:end]
+    if 0 <= src and src + len(data) <= len(old):
+        diffs = bytes((b - old[src + k]) & 0xFF for k, b in enumerate(data))
+        if diffs.count(0) >= ADD_MIN_ZERO * len(diffs):
+            return bytes([OP_ADD]) + varint(src) + varint(len(data)) + diffs
+    return bytes([OP_INSERT]) + varint(len(data)) + data
+
+
+def full(new):
+    return header(b"", new) + bytes([OP_INSERT]) + varint(len(new)) + new + bytes([OP_END])
+
+
+def apply(old, patch):
+    """Bản Python của DeltaPatch::feed(), dùng để kiểm tra bản vá trước khi gửi."""
+    if patch[:4] != MAGIC:
+        raise ValueError("bad magic")
+    old_size, old_crc, new_size, new_crc = struct.unpack_from("<IIII", patch, 4)
+    if old_size and (len(old) < old_size or zlib.crc32(old[:old_size]) != old_crc):
+        raise ValueError("base image mismatch")
+    out = bytearray()
+    pos = 20
+    while True:
+        op = patch[pos]
+        pos += 1
+        if op == OP_END:
+            break
+        if op in (OP_COPY, OP_ADD):
+            off, pos = read_varint(patch, pos)
+        n, pos = read_varint(patch, pos)
+        if op == OP_COPY:
+            out += old[off:off + n]
+        elif op == OP_ADD:
+            out += bytes((old[off + k] + patch[pos + k]) & 0xFF for k in range(n))
+            pos += n
+        elif op == OP_INSERT:
+            out += patch[pos:pos + n]
+            pos += n
+        else:
+            raise ValueError("bad op %d" % op)
+    if len(out) != new_size or zlib.crc32(out) != new_crc:
+        raise ValueError("result mismatch")
+    return bytes(out)
+
+
+def send(blob, args):
+    import threading
+    import paho.mqtt.client as mqtt
+
+    try:
+        key = bytes.fromhex(args.key)
+    except ValueError:
+        key = b""
+    if len(key) != 32:
+        sys.exit("--key must be 64 hex chars")
+
+    base = "site/%s" % args.door
+    next_offset = {"value": None}
+    event = threading.Event()
+
+    def on_message(client, userdata, msg):
+        text = msg.payload.decode(errors="replace")
+        if text.startswith("ota_next "):
+            next_offset["value"] = int(text.split()[1])
+        elif text.startswith("ota_error") or text.startswith("ota_done"):
+            print(text)
+            next_offset["value"] = -1
+        event.set()
+
+    client = mqtt.Client()
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+    if args.port == 8883:
+        client.tls_set(ca_certs=args.ca)
+    client.on_message = on_message
+    client.connect(args.host, args.port)
+    client.subscribe(base + "/ota_status", qos=1)
+    client.loop_start()
+
+    mac = hmac.new(key, blob, hashlib.sha256).hexdigest()
+    client.publish(base + "/command", "ota_begin %d %08x %s" % (len(blob), zlib.crc32(blob), mac), qos=1)
+    while True:
+        event.clear()
+        if not event.wait(args.timeout):
+            sys.exit("timeout waiting for ota_next")
+        off = next_offset["value"]
+        if off < 0:
+            break
+        if off >= len(blob):
+            continue  # khóa đang kiểm tra và ghi nốt, chờ ota_done
+        chunk = blob[off:off + CHUNK]
+        client.publish(base + "/ota", struct.pack("<I", off) + chunk, qos=1)
+        print("\r%d/%d" % (off + len(chunk), len(blob)), end="", flush=True)
+    client.loop_stop()
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = p.add_subparsers(dest="cmd", required=True)
+    d = sub.add_parser("diff")
+    d.add_argument("old")
+    d.add_argument("new")
+    d.add_argument("-o", "--out", required=True)
+    f = sub.add_parser("full")
+    f.add_argument("new")
+    f.add_argument("-o", "--out", required=True)
+    a = sub.add_parser("apply")
+    a.add_argument("old")
+    a.add_argument("patch")
+    a.add_argument("-o", "--out", required=True)
+    sub.add_parser("key")
+    s = sub.add_parser("send")
+    s.add_argument("patch")
+    s.add_argument("--host", required=True)
+    s.add_argument("--port", type=int, default=8883)
+    s.add_argument("--door", required=True)
+    s.add_argument("--user")
+    s.add_argument("--password")
+    s.add_argument("--key", required=True, help="khóa OTA của khóa cửa (64 hex)")
+    s.add_argument("--ca", help="CA của broker (mặc định: CA hệ thống)")
+    s.add_argument("--timeout", type=float, default=30)
+    args = p.parse_args()
+
+    if args.cmd in ("diff", "full"):
+        new = open(args.new, "rb").read()
+        raw = diff(open(args.old, "rb").read(), new) if args.cmd == "diff" else full(new)
+        blob = zlib.compress(raw, 9)
+        open(args.out, "wb").write(blob)
+        print("%s: %d bytes (raw patch %d, image %d)" % (args.out, len(blob), len(raw), len(new)))
+    elif args.cmd == "key":
+        key = secrets.token_hex(32)
+        print(key)
+        print("Nạp vào khóa cửa qua Serial Monitor (115200): ota_key %s" % key, file=sys.stderr)
+    elif args.cmd == "apply":
+        out = apply(open(args.old, "rb").read(), zlib.decompress(open(args.patch, "rb").read()))
+        open(args.out, "wb").write(out)
+        print("%s: %d bytes, CRC OK" % (args.out, len(out)))
+    else:
+        send(open(args.patch, "rb").read(), args)
+
+
+if __name__ == "__main__":
+    main()
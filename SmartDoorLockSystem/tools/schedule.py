@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""Biên dịch luật giờ truy cập thành bitmap tuần cho khóa cửa.
+
+Định dạng bitmap giống lib/AccessSchedule/AccessSchedule.h: 7 ngày × 96 ô
+15 phút = 84 byte, ô s ở byte s // 8 bit s % 8, tuần bắt đầu Chủ nhật 00:00.
+Chủ thể là "pin" (mật khẩu dùng chung) hoặc ID vân tay 1-127.
+
+    python3 schedule.py compile pin "mon-fri 08:00-18:00" "sat 09:00-12:00"
+    python3 schedule.py compile 5 "daily 22:00-06:00"           # qua đêm: sang ngày hôm sau
+    python3 schedule.py show <hex>                              # dịch ngược để kiểm tra
+    python3 schedule.py send 5 "mon-fri 08:00-18:00" --host broker --door <door-id> [--user u --password p]
+    python3 schedule.py send 5 always --host broker --door <door-id>   # bỏ giới hạn
+
+Luật: <ngày> <HH:MM>-<HH:MM>, ngày là sun..sat, khoảng "mon-fri", danh sách
+"sat,sun", hoặc "daily". Giờ phải là bội 15 phút, "24:00" là hết ngày.
+`send` cần paho-mqtt.
+"""
+
+import argparse
+import re
+import sys
+
+SLOT_MINUTES = 15
+SLOTS_PER_DAY = 24 * 60 // SLOT_MINUTES
+SLOTS = 7 * SLOTS_PER_DAY
+BYTES = SLOTS // 8
+DAYS = ["sun", "mon", "tue", "wed", "thu", "fri", "sat"]
+RULE = re.compile(r"^\s*(\S+)\s+(\d{1,2}):(\d{2})\s*-\s*(\d{1,2}):(\d{2})\s*$")
+
+
+def parse_days(spec):
+    if spec == "daily":
+        return list(range(7))
+    days = []
+    for part in spec.split(","):
+        if "-" in part:
+            a, b = part.split("-")
+            i, j = DAYS.index(a), DAYS.index(b)
+            days += [(i + k) % 7 for k in range((j - i) % 7 + 1)]
+        else:
+            days.append(DAYS.index(part))
+    return days
+
+
+def minutes(h, m):
+    value = int(h) * 60 + int(m)
+    if value > 24 * 60 or int(m) >= 60 or value % SLOT_MINUTES:
+        raise ValueError("time %s:%s must be a multiple of %d minutes up to 24:00" % (h, m, SLOT_MINUTES))
+    return value // SLOT_MINUTES
+
+
+def compile_rules(rules):
+    bits = bytearray(BYTES)
+    for rule in rules:
+        m = RULE.match(rule.lower())
+        if not m:
+            raise ValueError("bad rule %r, expected '<days> HH:MM-HH:MM'" % rule)
+        try:
+            days = parse_days(m.group(1))
+        except ValueError:
+            raise ValueError("bad days %r in rule %r" % (m.group(1), rule))
+        start, end = minutes(m.group(2), m.group(3)), minutes(m.group(4), m.group(5))
+        length = (end - start) % SLOTS_PER_DAY or SLOTS_PER_DAY  # end <= start: qua đêm
+        for day in days:
+            for k in range(length):
+                s = (day * SLOTS_PER_DAY + start + k) % SLOTS
+                bits[s // 8] |= 1 << (s % 8)
+    return bytes(bits)
+
+
+def describe(bits):
+    lines = []
+    for day in range(7):
+        ranges, start = [], None
+        for k in range(SLOTS_PER_DAY + 1):
+            s = day * SLOTS_PER_DAY + k
+            on = k < SLOTS_PER_DAY and bits[s // 8] >> (s % 8) & 1
+            if on and start is None:
+                start = k
+            elif not on and start is not None:
+                ranges.append("%02d:%02d-%02d:%02d" % (divmod(start * SLOT_MINUTES, 60) + divmod(k * SLOT_MINUTES, 60)))
+                start = None
+        lines.append("%s %s" % (DAYS[day], " ".join(ranges) or "-"))
+    return "\n".join(lines)
+
+
+def subject_arg(text):
+    if text == "pin":
+        return text
+    if text.isdigit() and 1 <= int(text) <= 127:
+        return str(int(text))
+    raise argparse.ArgumentTypeError("subject must be 'pin' or a finger ID 1-127")
+
+
+def command(subject, rules):
+    if rules == ["always"]:
+        return "schedule %s always" % subject
+    return "schedule %s %s" % (subject, compile_rules(rules).hex())
+
+
+def send(cmd, args):
+    import threading
+    import paho.mqtt.client as mqtt
+
+    base = "site/%s" % args.door
+    done = threading.Event()
+
+    def on_message(client, userdata, msg):
+        text = msg.payload.decode(errors="replace")
+        if text.startswith("schedule_") or text in ("rate_limited", "not_allowed"):
+            print(text)
+            done.set()
+
+    client = mqtt.Client()
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+    if args.port == 8883:
+        client.tls_set()
+        client.tls_insecure_set(True)
+    client.on_message = on_message
+    client.connect(args.host, args.port)
+    client.subscribe(base + "/status", qos=1)
+    client.loop_start()
+    client.publish(base + "/command", cmd, qos=1)
+    if not done.wait(args.timeout):
+        sys.exit("timeout waiting for schedule_set")
+    client.loop_stop()
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = p.add_subparsers(dest="cmd", required=True)
+    c = sub.add_parser("compile")
+    c.add_argument("subject", type=subject_arg)
+    c.add_argument("rules", nargs="+")
+    s = sub.add_parser("show")
+    s.add_argument("hex")
+    t = sub.add_parser("send")
+    t.add_argument("subject", type=subject_arg)
+    t.add_argument("rules", nargs="+")
+    t.add_argument("--host", required=True)
+    t.add_argument("--port", type=int, default=8883)
+    t.add_argument("--door", required=True)
+    t.add_argument("--user")
+    t.add_argument("--password")
+    t.add_argument("--timeout", type=float, default=10)
+    args = p.parse_args()
+
+    try:
+        if args.cmd == "show":
+            bits = bytes.fromhex(args.hex)
+            if len(bits) != BYTES:
+                sys.exit("bitmap must be %d bytes" % BYTES)
+            print(describe(bits))
+        elif args.cmd == "compile":
+            print(command(args.subject, args.rules))
+        else:
+            send(command(args.subject, args.rules), args)
+    except ValueError as e:
+        sys.exit(str(e))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""Cấp mã mở khóa một lần (TOTP, RFC 6238) cho khách, giống lib/Totp/Totp.h.
+
+Mỗi khóa một secret 20 byte. Khóa chỉ cần secret và đồng hồ SNTP, kiểm tra mã
+tại chỗ khi khách gõ '*' + 6 số, không cần mạng.
+
+    python3 totp.py new                                    # tạo secret, in lệnh totp_secret và URI cho app authenticator
+    python3 totp.py code <hex>                             # mã hiện tại (hiệu lực tới hết bước 30 s kế tiếp)
+    python3 totp.py code <hex> --at "2025-06-01 09:00"     # mã cho khách đến lúc 09:00 (giờ máy)
+    python3 totp.py send <hex> --host broker --door <door-id> [--user u --password p]
+    python3 totp.py send off --host broker --door <door-id>    # tắt mã một lần
+
+Mã được nhận trong bước của nó ±1 bước (30 s), và mỗi bước chỉ mở được một
+lần. `send` cần paho-mqtt.
+"""
+
+import argparse
+import base64
+import datetime
+import hashlib
+import hmac
+import os
+import struct
+import sys
+import time
+
+STEP_S = 30
+DIGITS = 6
+SECRET_LEN = 20
+
+
+def hotp(secret, counter):
+    mac = hmac.new(secret, struct.pack(">Q", counter), hashlib.sha1).digest()
+    off = mac[19] & 0x0F
+    return (struct.unpack(">I", mac[off:off + 4])[0] & 0x7FFFFFFF) % 10 ** DIGITS
+
+
+def secret_arg(text):
+    try:
+        secret = bytes.fromhex(text)
+    except ValueError:
+        secret = b""
+    if len(secret) != SECRET_LEN:
+        raise argparse.ArgumentTypeError("secret must be %d bytes of hex" % SECRET_LEN)
+    return secret
+
+
+def at_arg(text):
+    if text.isdigit():
+        return int(text)
+    return int(datetime.datetime.strptime(text, "%Y-%m-%d %H:%M").timestamp())
+
+
+def command(secret):
+    return "totp_secret off" if secret is None else "totp_secret " + secret.hex()
+
+
+def send(cmd, args):
+    import threading
+    import paho.mqtt.client as mqtt
+
+    base = "site/%s" % args.door
+    done = threading.Event()
+
+    def on_message(client, userdata, msg):
+        text = msg.payload.decode(errors="replace")
+        if text.startswith("totp_secret_") or text in ("rate_limited", "not_allowed"):
+            print(text)
+            done.set()
+
+    client = mqtt.Client()
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+    if args.port == 8883:
+        client.tls_set()
+        client.tls_insecure_set(True)
+    client.on_message = on_message
+    client.connect(args.host, args.port)
+    client.subscribe(base + "/status", qos=1)
+    client.loop_start()
+    client.publish(base + "/command", cmd, qos=1)
+    if not done.wait(args.timeout):
+        sys.exit("timeout waiting for totp_secret_set")
+    client.loop_stop()
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = p.add_subparsers(dest="cmd", required=True)
+    n = sub.add_parser("new")
+    n.add_argument("--label", default="door")
+    c = sub.add_parser("code")
+    c.add_argument("secret", type=secret_arg)
+    c.add_argument("--at", type=at_arg, help="giờ Unix hoặc 'YYYY-MM-DD HH:MM' (giờ máy)")
+    s = sub.add_parser("send")
+    s.add_argument("secret", type=lambda t: None if t == "off" else secret_arg(t))
+    s.add_argument("--host", required=True)
+    s.add_argument("--port", type=int, default=8883)
+    s.add_argument("--door", required=True)
+    s.add_argument("--user")
+    s.add_argument("--password")
+    s.add_argument("--timeout", type=float, default=10)
+    args = p.parse_args()
+
+    if args.cmd == "new":
+        secret = os.urandom(SECRET_LEN)
+        b32 = base64.b32encode(secret).decode().rstrip("=")
+        print(command(secret))
+        print("otpauth://totp/%s?secret=%s&algorithm=SHA1&digits=%d&period=%d" % (args.label, b32, DIGITS, STEP_S))
+    elif args.cmd == "code":
+        t = args.at if args.at is not None else int(time.time())
+        step = t // STEP_S
+        until = datetime.datetime.fromtimestamp((step + 2) * STEP_S).strftime("%H:%M:%S")
+        print("*%0*d  (valid until %s)" % (DIGITS, hotp(args.secret, step), until))
+    else:
+        send(command(args.secret), args)
+
+
+if __name__ == "__main__":
+    main()